@@ -0,0 +1,142 @@
+#include "bench/bench_scene.h"
+#include "core/level.h"
+#include "core/log.h"
+#include "core/threads.h"
+#include "graphics/render.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_PI 3.14159265358979323846f
+#define BENCH_DOLLY 3.0f  // Units moved back and forth along the start heading
+#define BENCH_NOD 0.2f    // Pitch swing in radians
+
+// The arena main.c builds at startup
+static int bench_scene_arena(BenchScene *bs)
+{
+    scene_init(&bs->scene);
+
+    int floor_tile_count = mesh_generate_floor(bs->floor_tiles);
+    texture_create_checker(&bs->floor_tex, 64, 8, 0xFFFF69B4, 0xFF808080);
+    for (int i = 0; i < floor_tile_count; i++)
+    {
+        int idx = scene_add_mesh(&bs->scene, &bs->floor_tiles[i], (Vec3){0, 0, 0}, 1.0f);
+        scene_set_texture(&bs->scene, idx, &bs->floor_tex, 0.5f);
+        bs->scene.entities[idx].pickable = false;
+    }
+
+    bs->cube_mesh = mesh_cube();
+    bs->cube_mesh.bounds = aabb_from_vertices(bs->cube_mesh.vertices, bs->cube_mesh.vertex_count);
+
+    float half_floor = FLOOR_TOTAL_SIZE / 2.0f - 2.0f;
+    Vec3 cube_positions[4] = {
+        {-half_floor, 1.1f, -half_floor},
+        {half_floor, 1.1f, -half_floor},
+        {-half_floor, 1.1f, half_floor},
+        {half_floor, 1.1f, half_floor}};
+    for (int i = 0; i < 4; i++)
+    {
+        int idx = scene_add_mesh(&bs->scene, &bs->cube_mesh, cube_positions[i], 1.0f);
+        scene_set_rotation_speed(&bs->scene, idx, (Vec3){0, 0.8f, 0});
+    }
+
+    if (obj_load(&bs->teapot, "assets/utah_teapot.obj") != 0)
+    {
+        LOG_ERROR("Failed to load teapot model");
+        return 1;
+    }
+    int teapot_idx = scene_add_obj(&bs->scene, &bs->teapot, (Vec3){3.0f, 0.0f, -3.0f}, 0.4f);
+    scene_set_rotation_speed(&bs->scene, teapot_idx, (Vec3){0, 0.8f, 0});
+
+    camera_init(&bs->camera, (Vec3){0, 2, 0}, 0.0f, 0.0f);
+    return 0;
+}
+
+int bench_scene_load(BenchScene *bs, const char *name)
+{
+    memset(bs, 0, sizeof(*bs));
+    bs->light_dir = vec3_normalize((Vec3){0.5f, 1.0f, -0.5f});
+    render_set_fog(true, 50.0f, 500.0f, 0xFF808080);
+    render_set_skybox(0xFF202050, 0xFF808080);
+
+    const char *base = strrchr(name, '/');
+    snprintf(bs->name, sizeof(bs->name), "%s", base ? base + 1 : name);
+    char *ext = strrchr(bs->name, '.');
+    if (ext)
+        *ext = '\0';
+
+    if (bench_scene_arena(bs) != 0)
+        return 1;
+
+    if (strcmp(name, "arena") != 0)
+    {
+        char map_path[LEVEL_MESH_PATH_MAX] = "";
+        if (level_load(name, &bs->scene, &bs->camera, &bs->teapot, &bs->cube_mesh,
+                       &bs->map, &bs->collision_grid, &bs->chunk_grid, map_path) != 0)
+            return 1;
+        bs->has_map = map_path[0] != '\0';
+    }
+
+    bs->initial = bs->scene;
+    bs->start = bs->camera.position;
+    bs->start_yaw = bs->camera.yaw;
+    bs->start_pitch = bs->camera.pitch;
+    LOG_INFO("Bench scene %s: %d entities, %d chunks", bs->name, bs->scene.count, bs->chunk_grid.count);
+    return 0;
+}
+
+void bench_scene_free(BenchScene *bs)
+{
+    render_finish_frames();
+    chunk_grid_free(&bs->chunk_grid);
+    grid_free(&bs->collision_grid);
+    obj_mesh_free(&bs->map);
+    obj_mesh_free(&bs->teapot);
+    texture_free(&bs->floor_tex);
+}
+
+void bench_scene_reset(BenchScene *bs)
+{
+    render_finish_frames();
+    bs->scene = bs->initial;
+    bench_scene_pose(bs, 0.0f);
+}
+
+void bench_scene_pose(BenchScene *bs, float t)
+{
+    float phase = 2.0f * BENCH_PI * t;
+    Vec3 heading = {sinf(bs->start_yaw), 0.0f, cosf(bs->start_yaw)};
+    bs->camera.position = vec3_add(bs->start, vec3_mul(heading, BENCH_DOLLY * sinf(phase)));
+    bs->camera.yaw = bs->start_yaw + phase;
+    bs->camera.pitch = bs->start_pitch - BENCH_NOD * sinf(2.0f * phase);
+    camera_update_vectors(&bs->camera);
+}
+
+void bench_scene_render(BenchScene *bs, Mat4 proj, float dt, RenderStats *stats)
+{
+    scene_update(&bs->scene, dt);
+
+    Mat4 vp = mat4_mul(proj, camera_get_view_matrix(&bs->camera));
+    Frustum frustum = frustum_extract(vp);
+    *stats = (RenderStats){0};
+
+    render_clear_gradient();
+    render_clear_zbuffer();
+    if (render_get_threaded() && threadpool_is_active())
+        render_begin_commands();
+
+    if (bs->chunk_grid.count > 0)
+    {
+        stats->chunks_total = bs->chunk_grid.count;
+        chunk_grid_render(&bs->chunk_grid, vp, bs->camera.position, bs->light_dir,
+                          &frustum, true, stats);
+        stats->chunks_culled = stats->entities_culled;
+        stats->entities_culled = 0;
+    }
+    scene_render(&bs->scene, vp, bs->camera.position, bs->light_dir, &frustum, true, stats);
+
+    if (render_get_threaded() && threadpool_is_active())
+        render_flush_commands();
+    render_collect_stats(stats);
+}
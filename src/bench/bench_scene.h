@@ -0,0 +1,51 @@
+#ifndef BENCH_SCENE_H
+#define BENCH_SCENE_H
+
+#include <stdbool.h>
+
+#include "core/camera.h"
+#include "core/chunk.h"
+#include "core/collision_grid.h"
+#include "core/entity.h"
+#include "core/obj_loader.h"
+#include "graphics/mesh.h"
+#include "graphics/texture.h"
+
+// A scene for the offscreen tools, set up the way the engine does it: the
+// default arena (floor, cubes, teapot), then optionally a .lvl loaded on
+// top like the console `load` command. Meshes are referenced by pointer,
+// so a BenchScene must not move once loaded.
+typedef struct
+{
+    char name[64];
+    Scene scene;
+    Scene initial; // Restored by bench_scene_reset
+    Camera camera;
+    Vec3 start;
+    float start_yaw, start_pitch;
+    Vec3 light_dir;
+    bool has_map; // A level mesh was loaded (false for the arena)
+
+    Mesh floor_tiles[MAX_FLOOR_TILES];
+    Texture floor_tex;
+    Mesh cube_mesh;
+    OBJMesh teapot;
+    OBJMesh map;
+    CollisionGrid collision_grid;
+    ChunkGrid chunk_grid;
+} BenchScene;
+
+// name is "arena" or the path of a .lvl file. Returns 0 on success.
+int bench_scene_load(BenchScene *bs, const char *name);
+void bench_scene_free(BenchScene *bs);
+// Back to the state right after loading (animation time, camera)
+void bench_scene_reset(BenchScene *bs);
+
+// Scripted camera at t in [0, 1): a full turn around the start point while
+// dollying back and forth and nodding, so every run sees the same views
+void bench_scene_pose(BenchScene *bs, float t);
+// Advance animation by dt and draw one frame with the current render
+// settings, as the engine's main loop does; stats receives its counters
+void bench_scene_render(BenchScene *bs, Mat4 proj, float dt, RenderStats *stats);
+
+#endif
@@ -0,0 +1,234 @@
+// Offline replay of a frame capture.
+//
+// Loads a file written by render_capture_next (console `capture <file>`,
+// render_bench --capture) and rasterizes it over and over with the given
+// settings: no scene, SDL or geometry code runs, only the clear and the
+// back end. Prints frame time statistics and triangle/pixel rates;
+// --ppm writes the last replayed frame so a capture can be checked by eye.
+// Usage: capture_replay <file> [--frames N] [--warmup N] [--threads N]
+//                       [--simd 0|1] [--isa auto|sse2|avx2|avx512]
+//                       [--hiz 0|1] [--threaded 0|tiles|sortlast|auto]
+//                       [--tile N] [--ppm file]
+
+#define _POSIX_C_SOURCE 200809L
+#include "bench/ppm.h"
+#include "core/entity.h"
+#include "core/log.h"
+#include "core/threads.h"
+#include "graphics/render.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct
+{
+    const char *path;
+    int frames;
+    int warmup;
+    int threads;
+    bool simd;
+    RenderSimdIsa isa;
+    bool hiz;
+    RenderThreadMode mode;
+    int tile_size;
+    const char *ppm;
+} ReplayOptions;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static const char *mode_name(RenderThreadMode mode)
+{
+    switch (mode)
+    {
+    case RENDER_THREAD_OFF:
+        return "off";
+    case RENDER_THREAD_TILES:
+        return "tiles";
+    case RENDER_THREAD_SORT_LAST:
+        return "sortlast";
+    case RENDER_THREAD_AUTO:
+        return "auto";
+    }
+    return "?";
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: capture_replay <file> [--frames N] [--warmup N] [--threads N]\n"
+            "                      [--simd 0|1] [--isa auto|sse2|avx2|avx512]\n"
+            "                      [--hiz 0|1] [--threaded 0|tiles|sortlast|auto]\n"
+            "                      [--tile N] [--ppm file]\n");
+}
+
+static bool parse_options(int argc, char **argv, ReplayOptions *opt)
+{
+    *opt = (ReplayOptions){
+        .frames = 200,
+        .warmup = 10,
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .simd = true,
+        .isa = RENDER_SIMD_AUTO,
+        .hiz = true,
+        .mode = RENDER_THREAD_TILES,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (arg[0] != '-')
+        {
+            opt->path = arg;
+            continue;
+        }
+
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!val)
+            return false;
+        i++;
+
+        if (strcmp(arg, "--frames") == 0)
+            opt->frames = atoi(val);
+        else if (strcmp(arg, "--warmup") == 0)
+            opt->warmup = atoi(val);
+        else if (strcmp(arg, "--threads") == 0)
+            opt->threads = atoi(val);
+        else if (strcmp(arg, "--simd") == 0)
+            opt->simd = atoi(val) != 0;
+        else if (strcmp(arg, "--isa") == 0)
+        {
+            if (strcmp(val, "auto") == 0)
+                opt->isa = RENDER_SIMD_AUTO;
+            else if (strcmp(val, "sse2") == 0)
+                opt->isa = RENDER_SIMD_SSE2;
+            else if (strcmp(val, "avx2") == 0)
+                opt->isa = RENDER_SIMD_AVX2;
+            else if (strcmp(val, "avx512") == 0)
+                opt->isa = RENDER_SIMD_AVX512;
+            else
+                return false;
+        }
+        else if (strcmp(arg, "--hiz") == 0)
+            opt->hiz = atoi(val) != 0;
+        else if (strcmp(arg, "--threaded") == 0)
+        {
+            if (strcmp(val, "0") == 0 || strcmp(val, "off") == 0)
+                opt->mode = RENDER_THREAD_OFF;
+            else if (strcmp(val, "1") == 0 || strcmp(val, "tiles") == 0)
+                opt->mode = RENDER_THREAD_TILES;
+            else if (strcmp(val, "sortlast") == 0)
+                opt->mode = RENDER_THREAD_SORT_LAST;
+            else if (strcmp(val, "auto") == 0)
+                opt->mode = RENDER_THREAD_AUTO;
+            else
+                return false;
+        }
+        else if (strcmp(arg, "--tile") == 0)
+            opt->tile_size = atoi(val);
+        else if (strcmp(arg, "--ppm") == 0)
+            opt->ppm = val;
+        else
+            return false;
+    }
+
+    if (opt->frames < 1)
+        opt->frames = 1;
+    if (opt->warmup < 0)
+        opt->warmup = 0;
+    if (opt->threads < 1)
+        opt->threads = 1;
+    return opt->path != NULL;
+}
+
+int main(int argc, char **argv)
+{
+    ReplayOptions opt;
+    if (!parse_options(argc, argv, &opt))
+    {
+        usage();
+        return 1;
+    }
+
+    RenderCapture *cap = render_capture_load(opt.path);
+    if (!cap)
+        return 1;
+
+    int width, height, cmds, vertices;
+    render_capture_get_info(cap, &width, &height, &cmds, &vertices);
+    render_set_resolution(width, height);
+    size_t pixels = (size_t)width * (size_t)height;
+    uint32_t *framebuffer = malloc(pixels * sizeof(uint32_t));
+    float *zbuffer = malloc(pixels * sizeof(float));
+    double *samples = malloc((size_t)opt.frames * sizeof(double));
+    if (!framebuffer || !zbuffer || !samples)
+    {
+        LOG_ERROR("Failed to allocate replay buffers");
+        return 1;
+    }
+
+    threadpool_init(opt.threads);
+    render_set_framebuffer(framebuffer);
+    render_set_zbuffer(zbuffer);
+    render_set_simd(opt.simd);
+    if (opt.simd && !render_set_simd_isa(opt.isa))
+        LOG_WARN("SIMD ISA not supported here, keeping %s", render_get_simd_isa_name());
+    render_set_hiz(opt.hiz);
+    render_set_tile_size(opt.tile_size);
+    render_set_threaded(opt.mode);
+
+    RenderStats stats = {0};
+    for (int i = 0; i < opt.warmup; i++)
+    {
+        render_capture_replay(cap);
+        render_collect_stats(&stats);
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < opt.frames; i++)
+    {
+        double t0 = now_ms();
+        render_capture_replay(cap);
+        samples[i] = now_ms() - t0;
+        stats = (RenderStats){0};
+        render_collect_stats(&stats);
+    }
+    double total = now_ms() - start;
+
+    qsort(samples, (size_t)opt.frames, sizeof(double), compare_double);
+    double avg = total / opt.frames;
+    printf("%-9s %-7s %2d thr %4dx%-4d %7d tri  avg %7.3f  med %7.3f  p95 %7.3f  min %7.3f ms  "
+           "%8.1f Ktri/s  %7.1f Mpix/s\n",
+           mode_name(opt.mode), opt.simd ? render_get_simd_isa_name() : "scalar",
+           threadpool_get_count(), width, height, cmds,
+           avg, samples[opt.frames / 2], samples[(int)(opt.frames * 0.95)], samples[0],
+           cmds / avg, pixels / avg / 1e3);
+    printf("          %d bin entries, %d active tiles, Hi-Z rejected %d tiles / %d blocks\n",
+           stats.bin_entries, stats.bin_active, stats.hiz_tiles_rejected, stats.hiz_blocks_rejected);
+    printf("          %d pixels tested, %d passed depth, %d shaded\n",
+           stats.pixels_tested, stats.pixels_passed, stats.pixels_shaded);
+
+    if (opt.ppm && !ppm_write(opt.ppm, render_get_framebuffer(), width, height))
+        LOG_ERROR("Cannot write %s", opt.ppm);
+
+    render_finish_frames();
+    threadpool_shutdown();
+    render_capture_free(cap);
+    free(samples);
+    free(framebuffer);
+    free(zbuffer);
+    return 0;
+}
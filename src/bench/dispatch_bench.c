@@ -0,0 +1,108 @@
+// Thread pool dispatch round-trip microbenchmark.
+//
+// For 1..max_workers workers (default 16), times threadpool_dispatch over
+// a 640x480 tile grid with an empty tile function, and job_parallel_for
+// with one index per worker, i.e. the pure cost of waking the pool and
+// waiting for it. The pool is grown in place between rows.
+// Usage: dispatch_bench [iterations] [max_workers]
+
+#define _POSIX_C_SOURCE 200809L
+#include "core/threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_TILE_SIZE 32
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void empty_tile(int tile_x, int tile_y, int tile_w, int tile_h, void *userdata)
+{
+    (void)tile_x;
+    (void)tile_y;
+    (void)tile_w;
+    (void)tile_h;
+    (void)userdata;
+}
+
+static void empty_job(int index, void *userdata)
+{
+    (void)index;
+    (void)userdata;
+}
+
+// Median of the per-call times, robust against the odd preemption
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *samples, int count)
+{
+    qsort(samples, (size_t)count, sizeof(double), compare_double);
+    return samples[count / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    if (iterations < 1)
+        iterations = 1;
+    int max_workers = argc > 2 ? atoi(argv[2]) : 16;
+    if (max_workers < 1)
+        max_workers = 1;
+
+    int tiles_x = (640 + BENCH_TILE_SIZE - 1) / BENCH_TILE_SIZE;
+    int tiles_y = (480 + BENCH_TILE_SIZE - 1) / BENCH_TILE_SIZE;
+    double *samples = malloc((size_t)iterations * sizeof(double));
+    if (!samples)
+        return 1;
+
+    printf("%-8s %14s %14s %14s\n", "workers", "tiles (us)", "run (us)", "local (us)");
+    threadpool_init(1);
+    for (int workers = 1; workers <= max_workers; workers++)
+    {
+        threadpool_resize(workers);
+
+        // Warm up: threads started, deques touched
+        for (int i = 0; i < 100; i++)
+            threadpool_dispatch(tiles_x, tiles_y, BENCH_TILE_SIZE, 640, 480, NULL, empty_tile, NULL);
+
+        for (int i = 0; i < iterations; i++)
+        {
+            double t0 = now_us();
+            threadpool_dispatch(tiles_x, tiles_y, BENCH_TILE_SIZE, 640, 480, NULL, empty_tile, NULL);
+            samples[i] = now_us() - t0;
+        }
+        double tiles = median(samples, iterations);
+
+        for (int i = 0; i < iterations; i++)
+        {
+            double t0 = now_us();
+            threadpool_run(workers, empty_job, NULL);
+            samples[i] = now_us() - t0;
+        }
+        double run = median(samples, iterations);
+
+        for (int i = 0; i < iterations; i++)
+        {
+            double t0 = now_us();
+            threadpool_dispatch_local(tiles_x, tiles_y, BENCH_TILE_SIZE, 640, 480, empty_tile, NULL);
+            samples[i] = now_us() - t0;
+        }
+        double local = median(samples, iterations);
+
+        printf("%-8d %14.2f %14.2f %14.2f\n", workers, tiles, run, local);
+    }
+    threadpool_shutdown();
+
+    free(samples);
+    return 0;
+}
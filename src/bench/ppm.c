@@ -0,0 +1,56 @@
+#include "bench/ppm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool ppm_write(const char *path, const uint32_t *pixels, int width, int height)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    unsigned char *row = malloc((size_t)width * 3);
+    bool ok = row != NULL;
+    for (int y = 0; ok && y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t c = pixels[y * width + x];
+            row[x * 3 + 0] = (c >> 16) & 0xFF;
+            row[x * 3 + 1] = (c >> 8) & 0xFF;
+            row[x * 3 + 2] = c & 0xFF;
+        }
+        ok = fwrite(row, 3, (size_t)width, f) == (size_t)width;
+    }
+    free(row);
+    return fclose(f) == 0 && ok;
+}
+
+uint32_t *ppm_read(const char *path, int width, int height)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    int w, h, maxval;
+    uint32_t *pixels = NULL;
+    if (fscanf(f, "P6 %d %d %d", &w, &h, &maxval) == 3 && fgetc(f) != EOF &&
+        w == width && h == height && maxval == 255)
+    {
+        pixels = malloc((size_t)width * height * sizeof(uint32_t));
+        unsigned char rgb[3];
+        for (int i = 0; pixels && i < width * height; i++)
+        {
+            if (fread(rgb, 1, 3, f) != 3)
+            {
+                free(pixels);
+                pixels = NULL;
+                break;
+            }
+            pixels[i] = 0xFF000000 | (uint32_t)rgb[0] << 16 | (uint32_t)rgb[1] << 8 | rgb[2];
+        }
+    }
+    fclose(f);
+    return pixels;
+}
@@ -0,0 +1,12 @@
+#ifndef PPM_H
+#define PPM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Binary PPM (P6) for the offscreen tools: ARGB pixels in, alpha dropped
+bool ppm_write(const char *path, const uint32_t *pixels, int width, int height);
+// Loads a P6 file written by ppm_write; NULL if missing or not width x height
+uint32_t *ppm_read(const char *path, int width, int height);
+
+#endif
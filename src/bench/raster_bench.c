@@ -0,0 +1,370 @@
+// Raster kernel microbenchmark.
+//
+// Draws fixed, seeded triangle mixes (tiny, medium, large, screen-filling
+// and sliver triangles; flat and textured; fog on and off; stacked layers
+// drawn back to front and front to back) with every kernel set this CPU
+// runs, and reports triangles/s and covered Mpixels/s per mix, path and
+// ISA. "immediate" times render_fill_triangle_z/_textured with threading
+// off: per-triangle setup plus the kernel over the whole screen. "binned"
+// records the same triangles as commands and flushes them through the
+// tile path on a single worker, so the kernels run per tile rect. The
+// sort-last depth composite kernel is timed on its own. Depth is cleared
+// between repetitions, outside the timed region; Hi-Z is on.
+// Usage: raster_bench [seconds_per_case] [width height]
+
+#define _POSIX_C_SOURCE 200809L
+#include "core/entity.h"
+#include "core/threads.h"
+#include "graphics/raster.h"
+#include "graphics/render.h"
+#include "graphics/texture.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PI 3.14159265358979323846f
+
+typedef struct
+{
+    float x[3], y[3], z[3], w[3], u[3], v[3];
+    uint32_t color;
+} BenchTri;
+
+typedef enum
+{
+    MIX_TINY,   // ~3 px edges
+    MIX_MEDIUM, // ~24 px edges
+    MIX_LARGE,  // ~160 px edges
+    MIX_SCREEN, // Two triangles covering the screen
+    MIX_SLIVER, // 1 px wide, ~200 px long
+} MixShape;
+
+typedef struct
+{
+    const char *name;
+    MixShape shape;
+    int count; // Base triangles, before layering
+    bool textured;
+    bool fog;
+    int layers;          // Copies of every triangle at increasing depth
+    bool front_to_back;  // Nearest layer first (Hi-Z and early-z reject the rest)
+} BenchMix;
+
+static const BenchMix s_mixes[] = {
+    {"tiny flat", MIX_TINY, 20000, false, false, 1, false},
+    {"tiny tex", MIX_TINY, 20000, true, false, 1, false},
+    {"medium flat", MIX_MEDIUM, 4000, false, false, 1, false},
+    {"medium tex", MIX_MEDIUM, 4000, true, false, 1, false},
+    {"medium flat fog", MIX_MEDIUM, 4000, false, true, 1, false},
+    {"medium tex fog", MIX_MEDIUM, 4000, true, true, 1, false},
+    {"large flat", MIX_LARGE, 300, false, false, 1, false},
+    {"large tex", MIX_LARGE, 300, true, false, 1, false},
+    {"screen flat", MIX_SCREEN, 2, false, false, 1, false},
+    {"screen tex fog", MIX_SCREEN, 2, true, true, 1, false},
+    {"sliver flat", MIX_SLIVER, 2000, false, false, 1, false},
+    {"sliver tex", MIX_SLIVER, 2000, true, false, 1, false},
+    {"overdraw4 b2f flat", MIX_SCREEN, 2, false, false, 4, false},
+    {"overdraw4 f2b flat", MIX_SCREEN, 2, false, false, 4, true},
+    {"overdraw8 b2f tex", MIX_MEDIUM, 1000, true, false, 8, false},
+    {"overdraw8 f2b tex", MIX_MEDIUM, 1000, true, false, 8, true},
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic across runs and platforms
+static uint32_t s_seed = 12345;
+
+static float rand_unit(void)
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (float)(s_seed >> 8) / (float)(1u << 24);
+}
+
+static float rand_range(float lo, float hi)
+{
+    return lo + (hi - lo) * rand_unit();
+}
+
+static void set_depth(BenchTri *t, float z)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        t->z[i] = z;
+        t->w[i] = 1.0f + 200.0f * z; // View depth, for perspective and fog
+    }
+}
+
+// Equilateral triangle of the given edge around (cx, cy), random rotation
+static void make_regular(BenchTri *t, float cx, float cy, float edge)
+{
+    float r = edge / sqrtf(3.0f);
+    float a = rand_range(0.0f, 2.0f * BENCH_PI);
+    for (int i = 0; i < 3; i++)
+    {
+        float ai = a + (float)i * 2.0f * BENCH_PI / 3.0f;
+        t->x[i] = cx + r * cosf(ai);
+        t->y[i] = cy + r * sinf(ai);
+    }
+}
+
+static void make_base(BenchTri *t, MixShape shape, int index, int width, int height)
+{
+    float w = (float)width, h = (float)height;
+    switch (shape)
+    {
+    case MIX_TINY:
+    case MIX_MEDIUM:
+    case MIX_LARGE:
+    {
+        float edge = shape == MIX_TINY ? 3.0f : shape == MIX_MEDIUM ? 24.0f : 160.0f;
+        float m = edge;
+        make_regular(t, rand_range(m, w - m), rand_range(m, h - m), edge);
+        break;
+    }
+    case MIX_SCREEN:
+    {
+        float xs[2][3] = {{0, w, 0}, {w, w, 0}};
+        float ys[2][3] = {{0, 0, h}, {0, h, h}};
+        for (int i = 0; i < 3; i++)
+        {
+            t->x[i] = xs[index & 1][i];
+            t->y[i] = ys[index & 1][i];
+        }
+        break;
+    }
+    case MIX_SLIVER:
+    {
+        float len = 200.0f;
+        float a = rand_range(0.0f, 2.0f * BENCH_PI);
+        float dx = cosf(a), dy = sinf(a);
+        float x0 = rand_range(len, w - len > len ? w - len : len);
+        float y0 = rand_range(len / 2, h - len / 2 > len / 2 ? h - len / 2 : len / 2);
+        t->x[0] = x0;
+        t->y[0] = y0;
+        t->x[1] = x0 + dx * len;
+        t->y[1] = y0 + dy * len;
+        t->x[2] = x0 + dx * len - dy;
+        t->y[2] = y0 + dy * len + dx;
+        break;
+    }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        t->u[i] = t->x[i] / 32.0f;
+        t->v[i] = t->y[i] / 32.0f;
+    }
+    t->color = 0xFF000000 | (s_seed & 0x00FFFFFF);
+}
+
+static float tri_area(const BenchTri *t)
+{
+    return 0.5f * fabsf((t->x[1] - t->x[0]) * (t->y[2] - t->y[0]) -
+                        (t->x[2] - t->x[0]) * (t->y[1] - t->y[0]));
+}
+
+// Triangles of a mix in draw order, one whole layer after the other;
+// returns the count, pixels gets the covered area summed over all of them
+static int build_mix(const BenchMix *mix, int width, int height, BenchTri **out, double *pixels)
+{
+    s_seed = 12345;
+    int count = mix->count * mix->layers;
+    BenchTri *tris = malloc((size_t)count * sizeof(BenchTri));
+    if (!tris)
+        return 0;
+
+    *pixels = 0.0;
+    for (int i = 0; i < mix->count; i++)
+    {
+        BenchTri base;
+        make_base(&base, mix->shape, i, width, height);
+        float z = rand_range(0.1f, 0.9f);
+        for (int l = 0; l < mix->layers; l++)
+        {
+            // Layer 0 is the nearest
+            int layer = mix->front_to_back ? l : mix->layers - 1 - l;
+            BenchTri *t = &tris[l * mix->count + i];
+            *t = base;
+            set_depth(t, mix->layers > 1 ? 0.1f + 0.8f * (float)layer / (float)mix->layers : z);
+            *pixels += tri_area(t);
+        }
+    }
+
+    *out = tris;
+    return count;
+}
+
+static void draw_mix(const BenchTri *tris, int count, bool textured, const Texture *tex)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const BenchTri *t = &tris[i];
+        if (textured)
+            render_fill_triangle_textured(t->x[0], t->y[0], t->z[0], t->u[0], t->v[0], t->w[0],
+                                          t->x[1], t->y[1], t->z[1], t->u[1], t->v[1], t->w[1],
+                                          t->x[2], t->y[2], t->z[2], t->u[2], t->v[2], t->w[2],
+                                          tex, 0.8f);
+        else
+            render_fill_triangle_z(t->x[0], t->y[0], t->z[0], t->w[0],
+                                   t->x[1], t->y[1], t->z[1], t->w[1],
+                                   t->x[2], t->y[2], t->z[2], t->w[2],
+                                   t->color);
+    }
+}
+
+// Seconds per repetition of one mix
+static double time_mix(const BenchTri *tris, int count, bool textured, const Texture *tex,
+                       bool binned, double budget)
+{
+    render_set_threaded(binned ? RENDER_THREAD_TILES : RENDER_THREAD_OFF);
+    RenderStats stats;
+    double spent = 0.0;
+    int reps = 0;
+    while (reps < 2 || spent < budget)
+    {
+        render_clear_zbuffer();
+        double t0 = now_s();
+        if (binned)
+            render_begin_commands();
+        draw_mix(tris, count, textured, tex);
+        if (binned)
+            render_flush_commands();
+        spent += now_s() - t0;
+        reps++;
+        render_collect_stats(&stats); // Keeps the counters from growing
+    }
+    return spent / reps;
+}
+
+static double time_composite(const RasterKernels *k, int pixels, double budget)
+{
+    uint32_t *color = malloc((size_t)pixels * sizeof(uint32_t));
+    float *depth = malloc((size_t)pixels * sizeof(float));
+    uint32_t *src_color = malloc((size_t)pixels * sizeof(uint32_t));
+    float *src_depth = malloc((size_t)pixels * sizeof(float));
+    if (!color || !depth || !src_color || !src_depth)
+    {
+        free(color);
+        free(depth);
+        free(src_color);
+        free(src_depth);
+        return 0.0;
+    }
+
+    s_seed = 12345;
+    for (int i = 0; i < pixels; i++)
+    {
+        src_color[i] = s_seed;
+        src_depth[i] = rand_unit();
+    }
+
+    double spent = 0.0;
+    int reps = 0;
+    while (reps < 2 || spent < budget)
+    {
+        for (int i = 0; i < pixels; i++)
+        {
+            color[i] = 0;
+            depth[i] = 0.5f;
+        }
+        double t0 = now_s();
+        k->composite(color, depth, src_color, src_depth, pixels);
+        spent += now_s() - t0;
+        reps++;
+    }
+
+    free(color);
+    free(depth);
+    free(src_color);
+    free(src_depth);
+    return spent / reps;
+}
+
+int main(int argc, char **argv)
+{
+    double budget = argc > 1 ? atof(argv[1]) : 0.2;
+    if (budget <= 0.0)
+        budget = 0.2;
+    int width = argc > 3 ? atoi(argv[2]) : DEFAULT_RENDER_WIDTH;
+    int height = argc > 3 ? atoi(argv[3]) : DEFAULT_RENDER_HEIGHT;
+
+    render_set_resolution(width, height);
+    width = g_render_width;
+    height = g_render_height;
+    uint32_t *framebuffer = malloc((size_t)width * height * sizeof(uint32_t));
+    float *zbuffer = malloc((size_t)width * height * sizeof(float));
+    if (!framebuffer || !zbuffer)
+        return 1;
+    memset(framebuffer, 0, (size_t)width * height * sizeof(uint32_t));
+
+    // A single worker: the binned path then measures the kernels per tile,
+    // not how well they scale
+    threadpool_init(1);
+    render_set_framebuffer(framebuffer);
+    render_set_zbuffer(zbuffer);
+    render_set_hiz(true);
+
+    Texture tex;
+    texture_create_checker(&tex, 64, 8, 0xFFFF69B4, 0xFF808080);
+
+    // Scalar first, then every SIMD set this CPU runs
+    const RenderSimdIsa isas[] = {RENDER_SIMD_AUTO, RENDER_SIMD_SSE2, RENDER_SIMD_AVX2, RENDER_SIMD_AVX512};
+    const RasterKernels *kernels[4] = {&raster_kernels_scalar};
+    for (int i = 1; i < 4; i++)
+        kernels[i] = raster_get_kernels(isas[i]);
+
+    printf("%dx%d, %.2f s per case\n", width, height, budget);
+    printf("%-20s %-10s %-8s %12s %12s\n", "mix", "path", "isa", "Ktri/s", "Mpix/s");
+    for (size_t m = 0; m < sizeof(s_mixes) / sizeof(s_mixes[0]); m++)
+    {
+        const BenchMix *mix = &s_mixes[m];
+        BenchTri *tris;
+        double pixels;
+        int count = build_mix(mix, width, height, &tris, &pixels);
+        if (count == 0)
+            continue;
+        render_set_fog(mix->fog, 0.0f, 150.0f, 0xFF808080);
+
+        for (int path = 0; path < 2; path++)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (!kernels[i])
+                    continue;
+                render_set_simd(i > 0);
+                if (i > 0)
+                    render_set_simd_isa(isas[i]);
+
+                double t = time_mix(tris, count, mix->textured, &tex, path == 1, budget);
+                printf("%-20s %-10s %-8s %12.1f %12.1f\n", mix->name,
+                       path ? "binned" : "immediate", kernels[i]->name,
+                       count / t / 1e3, pixels / t / 1e6);
+                fflush(stdout);
+            }
+        }
+        free(tris);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (!kernels[i])
+            continue;
+        double t = time_composite(kernels[i], width * height, budget);
+        printf("%-20s %-10s %-8s %12s %12.1f\n", "composite", "kernel", kernels[i]->name,
+               "-", width * height / t / 1e6);
+    }
+
+    texture_free(&tex);
+    threadpool_shutdown();
+    free(framebuffer);
+    free(zbuffer);
+    return 0;
+}
@@ -0,0 +1,385 @@
+// Headless renderer benchmark.
+//
+// Loads a scene without SDL (a .lvl on top of the default arena, or just
+// "arena"), flies the scripted bench camera through it and renders frames
+// offscreen with the given settings. Per-frame times and RenderStats are
+// appended to a CSV (the header is written when the file is new); a summary
+// per pass goes to stdout. `--threaded best` runs the tile and sort-last
+// rasterizers back to back and reports the faster for the scene.
+// `--capture` flies the path again up to the slowest frame and writes that
+// frame's rasterizer input for capture_replay.
+// Usage: render_bench [--level <file.lvl|arena>] [--frames N] [--warmup N]
+//                     [--res WxH] [--threads N] [--simd 0|1]
+//                     [--isa auto|sse2|avx2|avx512] [--hiz 0|1] [--overdraw 0|1]
+//                     [--threaded 0|1|tiles|sortlast|auto|best]
+//                     [--pipeline 0|1] [--tile N] [--csv file] [--trace file]
+//                     [--capture file]
+
+#define _POSIX_C_SOURCE 200809L
+#include "bench/bench_scene.h"
+#include "core/log.h"
+#include "core/profile.h"
+#include "core/threads.h"
+#include "graphics/render.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_PI 3.14159265358979323846f
+#define BENCH_DT (1.0f / 60.0f) // Animation step per frame
+
+typedef struct
+{
+    const char *level;
+    int frames;
+    int warmup;
+    int width, height;
+    int threads;
+    bool simd;
+    RenderSimdIsa isa;
+    bool hiz;
+    bool overdraw; // Count per-pixel overdraw, for the pixels_visible column
+    RenderThreadMode mode;
+    bool best; // Time tiles and sort-last, keep the faster
+    bool pipeline;
+    int tile_size;
+    const char *csv;
+    const char *trace;
+    const char *capture;
+} BenchOptions;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static const char *mode_name(RenderThreadMode mode)
+{
+    switch (mode)
+    {
+    case RENDER_THREAD_OFF:
+        return "off";
+    case RENDER_THREAD_TILES:
+        return "tiles";
+    case RENDER_THREAD_SORT_LAST:
+        return "sortlast";
+    case RENDER_THREAD_AUTO:
+        return "auto";
+    }
+    return "?";
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: render_bench [--level <file.lvl|arena>] [--frames N] [--warmup N]\n"
+            "                    [--res WxH] [--threads N] [--simd 0|1]\n"
+            "                    [--isa auto|sse2|avx2|avx512] [--hiz 0|1] [--overdraw 0|1]\n"
+            "                    [--threaded 0|1|tiles|sortlast|auto|best]\n"
+            "                    [--pipeline 0|1] [--tile N] [--csv file] [--trace file]\n"
+            "                    [--capture file]\n");
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *opt)
+{
+    *opt = (BenchOptions){
+        .level = "assets/curvedm.lvl",
+        .frames = 300,
+        .warmup = 30,
+        .width = DEFAULT_RENDER_WIDTH,
+        .height = DEFAULT_RENDER_HEIGHT,
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .simd = true,
+        .isa = RENDER_SIMD_AUTO,
+        .hiz = true,
+        .mode = RENDER_THREAD_TILES,
+        .csv = "bench.csv",
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!val)
+            return false;
+        i++;
+
+        if (strcmp(arg, "--level") == 0)
+            opt->level = val;
+        else if (strcmp(arg, "--frames") == 0)
+            opt->frames = atoi(val);
+        else if (strcmp(arg, "--warmup") == 0)
+            opt->warmup = atoi(val);
+        else if (strcmp(arg, "--res") == 0)
+        {
+            if (sscanf(val, "%dx%d", &opt->width, &opt->height) != 2)
+                return false;
+        }
+        else if (strcmp(arg, "--threads") == 0)
+            opt->threads = atoi(val);
+        else if (strcmp(arg, "--simd") == 0)
+            opt->simd = atoi(val) != 0;
+        else if (strcmp(arg, "--isa") == 0)
+        {
+            if (strcmp(val, "auto") == 0)
+                opt->isa = RENDER_SIMD_AUTO;
+            else if (strcmp(val, "sse2") == 0)
+                opt->isa = RENDER_SIMD_SSE2;
+            else if (strcmp(val, "avx2") == 0)
+                opt->isa = RENDER_SIMD_AVX2;
+            else if (strcmp(val, "avx512") == 0)
+                opt->isa = RENDER_SIMD_AVX512;
+            else
+                return false;
+        }
+        else if (strcmp(arg, "--hiz") == 0)
+            opt->hiz = atoi(val) != 0;
+        else if (strcmp(arg, "--overdraw") == 0)
+            opt->overdraw = atoi(val) != 0;
+        else if (strcmp(arg, "--threaded") == 0)
+        {
+            opt->best = false;
+            if (strcmp(val, "0") == 0 || strcmp(val, "off") == 0)
+                opt->mode = RENDER_THREAD_OFF;
+            else if (strcmp(val, "1") == 0 || strcmp(val, "tiles") == 0)
+                opt->mode = RENDER_THREAD_TILES;
+            else if (strcmp(val, "sortlast") == 0)
+                opt->mode = RENDER_THREAD_SORT_LAST;
+            else if (strcmp(val, "auto") == 0)
+                opt->mode = RENDER_THREAD_AUTO;
+            else if (strcmp(val, "best") == 0)
+                opt->best = true;
+            else
+                return false;
+        }
+        else if (strcmp(arg, "--pipeline") == 0)
+            opt->pipeline = atoi(val) != 0;
+        else if (strcmp(arg, "--tile") == 0)
+            opt->tile_size = atoi(val);
+        else if (strcmp(arg, "--csv") == 0)
+            opt->csv = val;
+        else if (strcmp(arg, "--trace") == 0)
+            opt->trace = val;
+        else if (strcmp(arg, "--capture") == 0)
+            opt->capture = val;
+        else
+            return false;
+    }
+
+    if (opt->frames < 1)
+        opt->frames = 1;
+    if (opt->warmup < 0)
+        opt->warmup = 0;
+    if (opt->threads < 1)
+        opt->threads = 1;
+    return true;
+}
+
+static void csv_row(FILE *csv, const BenchOptions *opt, const BenchScene *bs,
+                    RenderThreadMode mode, int frame, double ms, const RenderStats *st)
+{
+    fprintf(csv, "%s,%s,%d,%s,%d,%d,%d,%d,%.4f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+            bs->name, mode_name(mode), opt->simd, opt->simd ? render_get_simd_isa_name() : "scalar",
+            threadpool_get_count(), g_render_width, g_render_height, frame, ms,
+            st->triangles_drawn, st->backface_culled, st->clip_trivial, st->entities_culled,
+            st->chunks_total, st->chunks_culled, st->cmd_count, st->cmd_vertices,
+            st->bin_entries, st->bin_active, st->bin_max,
+            st->hiz_tiles_rejected, st->hiz_blocks_rejected,
+            st->pixels_tested, st->pixels_passed, st->pixels_shaded, st->pixels_visible);
+}
+
+// One timed pass over the camera path; returns the median frame time and
+// the index of the slowest frame
+static double run_pass(BenchScene *bs, const BenchOptions *opt, RenderThreadMode mode,
+                       Mat4 proj, FILE *csv, double *samples, RenderStats *frame_stats,
+                       bool trace, int *worst)
+{
+    render_set_threaded(mode);
+    bench_scene_reset(bs);
+
+    RenderStats stats;
+    for (int i = 0; i < opt->warmup; i++)
+    {
+        bench_scene_pose(bs, (float)i / (float)opt->warmup);
+        bench_scene_render(bs, proj, BENCH_DT, &stats);
+    }
+    bench_scene_reset(bs);
+
+    if (trace)
+        profile_capture(opt->frames, opt->trace);
+
+    // Frame i's time runs from the end of frame i-1 to its own end, so
+    // with pipelining it is the steady-state interval, not the record time
+    double start = now_ms();
+    double prev = start;
+    for (int i = 0; i < opt->frames; i++)
+    {
+        bench_scene_pose(bs, (float)i / (float)opt->frames);
+        bench_scene_render(bs, proj, BENCH_DT, &frame_stats[i]);
+        profile_frame_end();
+
+        double end = now_ms();
+        samples[i] = end - prev;
+        prev = end;
+    }
+    render_finish_frames();
+    double total = now_ms() - start;
+
+    long triangles = 0;
+    long tested = 0, passed = 0, shaded = 0, visible = 0;
+    *worst = 0;
+    for (int i = 0; i < opt->frames; i++)
+    {
+        if (samples[i] > samples[*worst])
+            *worst = i;
+        triangles += frame_stats[i].triangles_drawn;
+        tested += frame_stats[i].pixels_tested;
+        passed += frame_stats[i].pixels_passed;
+        shaded += frame_stats[i].pixels_shaded;
+        visible += frame_stats[i].pixels_visible;
+        if (csv)
+            csv_row(csv, opt, bs, mode, i, samples[i], &frame_stats[i]);
+    }
+
+    qsort(samples, (size_t)opt->frames, sizeof(double), compare_double);
+    double median = samples[opt->frames / 2];
+    double p95 = samples[(int)(opt->frames * 0.95)];
+    printf("%-10s %-9s %-7s %2d thr %4dx%-4d  avg %7.3f  med %7.3f  p95 %7.3f  min %7.3f ms  "
+           "%6.1f fps  %ld tri/frame\n",
+           bs->name, mode_name(mode), opt->simd ? render_get_simd_isa_name() : "scalar",
+           threadpool_get_count(), g_render_width, g_render_height,
+           total / opt->frames, median, p95, samples[0],
+           1000.0 * opt->frames / total, triangles / opt->frames);
+    printf("%-10s %ld pix tested/frame, %.1f%% passed depth, %.1f%% shaded",
+           "", tested / opt->frames, tested ? 100.0 * passed / tested : 0.0,
+           tested ? 100.0 * shaded / tested : 0.0);
+    if (visible)
+        printf(", overdraw %.2f", (double)passed / visible);
+    printf("\n");
+    return median;
+}
+
+// Replay the path up to frame `worst` and capture it. The command stream
+// does not depend on how it is rasterized, so this records through tiles.
+static void capture_worst(BenchScene *bs, const BenchOptions *opt, Mat4 proj, int worst)
+{
+    RenderThreadMode mode = render_get_thread_mode();
+    render_set_threaded(RENDER_THREAD_TILES);
+    bench_scene_reset(bs);
+
+    RenderStats stats;
+    for (int i = 0; i <= worst; i++)
+    {
+        if (i == worst)
+            render_capture_next(opt->capture);
+        bench_scene_pose(bs, (float)i / (float)opt->frames);
+        bench_scene_render(bs, proj, BENCH_DT, &stats);
+    }
+    render_finish_frames();
+    render_set_threaded(mode);
+    printf("%-10s slowest frame %d captured to %s\n", bs->name, worst, opt->capture);
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt;
+    if (!parse_options(argc, argv, &opt))
+    {
+        usage();
+        return 1;
+    }
+
+    render_set_resolution(opt.width, opt.height);
+    size_t pixels = (size_t)g_render_width * (size_t)g_render_height;
+    uint32_t *framebuffer = malloc(pixels * sizeof(uint32_t));
+    float *zbuffer = malloc(pixels * sizeof(float));
+    uint32_t *back_framebuffer = opt.pipeline ? malloc(pixels * sizeof(uint32_t)) : NULL;
+    float *back_zbuffer = opt.pipeline ? malloc(pixels * sizeof(float)) : NULL;
+    double *samples = malloc((size_t)opt.frames * sizeof(double));
+    RenderStats *frame_stats = malloc((size_t)opt.frames * sizeof(RenderStats));
+    BenchScene *bs = malloc(sizeof(BenchScene));
+    if (!framebuffer || !zbuffer || !samples || !frame_stats || !bs ||
+        (opt.pipeline && (!back_framebuffer || !back_zbuffer)))
+    {
+        LOG_ERROR("Failed to allocate bench buffers");
+        return 1;
+    }
+
+    threadpool_init(opt.threads);
+    render_set_framebuffer(framebuffer);
+    render_set_zbuffer(zbuffer);
+    render_set_pipeline_buffers(back_framebuffer, back_zbuffer);
+    render_set_pipelined(opt.pipeline);
+    render_set_simd(opt.simd);
+    if (opt.simd && !render_set_simd_isa(opt.isa))
+        LOG_WARN("SIMD ISA not supported here, keeping %s", render_get_simd_isa_name());
+    render_set_hiz(opt.hiz);
+    render_set_overdraw(opt.overdraw);
+    render_set_tile_size(opt.tile_size);
+
+    if (bench_scene_load(bs, opt.level) != 0)
+    {
+        LOG_ERROR("Failed to load bench scene: %s", opt.level);
+        threadpool_shutdown();
+        return 1;
+    }
+
+    FILE *csv = NULL;
+    if (opt.csv && opt.csv[0])
+    {
+        csv = fopen(opt.csv, "a");
+        if (!csv)
+            LOG_ERROR("Cannot open %s, timings go to stdout only", opt.csv);
+        else if (fseek(csv, 0, SEEK_END) == 0 && ftell(csv) == 0)
+            fprintf(csv, "scene,mode,simd,isa,threads,width,height,frame,ms,triangles,"
+                         "backface_culled,clip_trivial,entities_culled,chunks_total,chunks_culled,"
+                         "cmd_count,cmd_vertices,bin_entries,bin_active,bin_max,"
+                         "hiz_tiles_rejected,hiz_blocks_rejected,"
+                         "pixels_tested,pixels_passed,pixels_shaded,pixels_visible\n");
+    }
+
+    float aspect = (float)g_render_width / (float)g_render_height;
+    Mat4 proj = mat4_perspective(BENCH_PI / 3.0f, aspect, 0.1f, 10000.0f);
+
+    int worst;
+    if (opt.best)
+    {
+        double tiles = run_pass(bs, &opt, RENDER_THREAD_TILES, proj, csv, samples, frame_stats,
+                                opt.trace != NULL, &worst);
+        double sort_last = run_pass(bs, &opt, RENDER_THREAD_SORT_LAST, proj, csv, samples, frame_stats,
+                                    false, &worst);
+        printf("%-10s best: %s (tiles %.3f ms, sort-last %.3f ms median)\n", bs->name,
+               sort_last < tiles ? "sortlast" : "tiles", tiles, sort_last);
+    }
+    else
+    {
+        run_pass(bs, &opt, opt.mode, proj, csv, samples, frame_stats, opt.trace != NULL, &worst);
+    }
+    if (opt.capture)
+        capture_worst(bs, &opt, proj, worst);
+
+    if (csv)
+        fclose(csv);
+    bench_scene_free(bs);
+    threadpool_shutdown();
+    profile_shutdown();
+    free(bs);
+    free(samples);
+    free(frame_stats);
+    free(framebuffer);
+    free(zbuffer);
+    free(back_framebuffer);
+    free(back_zbuffer);
+    return 0;
+}
@@ -0,0 +1,349 @@
+// Golden-image regression harness.
+//
+// Renders fixed camera poses of the bundled scenes offscreen with every
+// raster variant (scalar, each SIMD ISA, Hi-Z off, the tile and sort-last
+// threaded paths) and compares each image against the scene's golden PPM.
+// A pixel is bad when a channel differs by more than --tolerance; a pose
+// fails when more than --max-bad percent of its pixels are bad. Failing
+// images and an amplified diff go to --out. Every pose's median frame time
+// is printed (and optionally written as CSV).
+//
+// Goldens come from the scalar immediate path, the reference for all the
+// others. Missing ones are written on the first run (reported as NEW);
+// --update rewrites them all, e.g. on a known-good build before optimizing.
+// Scenes whose level mesh is not available (fc4.obj is not bundled) are
+// skipped. Exits non-zero if any pose failed.
+// Usage: render_golden [--dir golden] [--out golden_out] [--res WxH]
+//                      [--tolerance N] [--max-bad PCT] [--reps N]
+//                      [--csv file] [--update]
+
+#define _POSIX_C_SOURCE 200809L
+#include "bench/bench_scene.h"
+#include "bench/ppm.h"
+#include "core/log.h"
+#include "core/threads.h"
+#include "graphics/render.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GOLDEN_PI 3.14159265358979323846f
+#define GOLDEN_POSES 4
+#define GOLDEN_PATH_MAX 1024
+
+static const char *s_scenes[] = {"assets/curvedm.lvl", "assets/fc4.lvl", "arena"};
+
+typedef struct
+{
+    char name[32];
+    RenderThreadMode mode;
+    bool simd;
+    RenderSimdIsa isa;
+    bool hiz;
+} GoldenVariant;
+
+typedef struct
+{
+    const char *dir;
+    const char *out;
+    int width, height;
+    int tolerance;
+    double max_bad_pct;
+    int reps;
+    const char *csv;
+    bool update;
+} GoldenOptions;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static bool make_dir(const char *path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static int channel_diff(uint32_t a, uint32_t b)
+{
+    int max = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        int d = abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+        max = d > max ? d : max;
+    }
+    return max;
+}
+
+// Bad pixel count; diff (optional) receives the per-pixel difference x16
+static int compare_images(const uint32_t *image, const uint32_t *golden, int count,
+                          int tolerance, int *max_diff, uint32_t *diff)
+{
+    int bad = 0;
+    *max_diff = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int d = channel_diff(image[i], golden[i]);
+        if (d > *max_diff)
+            *max_diff = d;
+        if (d > tolerance)
+            bad++;
+        if (diff)
+        {
+            int v = d * 16 > 255 ? 255 : d * 16;
+            diff[i] = 0xFF000000 | (uint32_t)v << 16 | (uint32_t)(d > tolerance ? 0 : v) << 8;
+        }
+    }
+    return bad;
+}
+
+static int build_variants(GoldenVariant *out)
+{
+    int count = 0;
+    out[count++] = (GoldenVariant){"scalar", RENDER_THREAD_OFF, false, RENDER_SIMD_AUTO, true};
+    out[count++] = (GoldenVariant){"scalar-nohiz", RENDER_THREAD_OFF, false, RENDER_SIMD_AUTO, false};
+
+    static const RenderSimdIsa isas[] = {RENDER_SIMD_SSE2, RENDER_SIMD_AVX2, RENDER_SIMD_AVX512};
+    static const char *names[] = {"sse2", "avx2", "avx512"};
+    for (int i = 0; i < 3; i++)
+    {
+        render_set_simd(true);
+        if (!render_set_simd_isa(isas[i]))
+            continue;
+        GoldenVariant *v = &out[count++];
+        *v = (GoldenVariant){"", RENDER_THREAD_OFF, true, isas[i], true};
+        snprintf(v->name, sizeof(v->name), "%s", names[i]);
+    }
+
+    out[count++] = (GoldenVariant){"tiles-scalar", RENDER_THREAD_TILES, false, RENDER_SIMD_AUTO, true};
+    out[count++] = (GoldenVariant){"tiles-simd", RENDER_THREAD_TILES, true, RENDER_SIMD_AUTO, true};
+    out[count++] = (GoldenVariant){"sortlast-scalar", RENDER_THREAD_SORT_LAST, false, RENDER_SIMD_AUTO, true};
+    out[count++] = (GoldenVariant){"sortlast-simd", RENDER_THREAD_SORT_LAST, true, RENDER_SIMD_AUTO, true};
+    return count;
+}
+
+static void apply_variant(const GoldenVariant *v)
+{
+    render_set_threaded(v->mode);
+    render_set_simd(v->simd);
+    if (v->simd)
+        render_set_simd_isa(v->isa);
+    render_set_hiz(v->hiz);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: render_golden [--dir golden] [--out golden_out] [--res WxH]\n"
+            "                     [--tolerance N] [--max-bad PCT] [--reps N]\n"
+            "                     [--csv file] [--update]\n");
+}
+
+static bool parse_options(int argc, char **argv, GoldenOptions *opt)
+{
+    *opt = (GoldenOptions){
+        .dir = "golden",
+        .out = "golden_out",
+        .width = DEFAULT_RENDER_WIDTH,
+        .height = DEFAULT_RENDER_HEIGHT,
+        .tolerance = 2,
+        .max_bad_pct = 0.1,
+        .reps = 5,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--update") == 0)
+        {
+            opt->update = true;
+            continue;
+        }
+
+        const char *val = i + 1 < argc ? argv[++i] : NULL;
+        if (!val)
+            return false;
+        if (strcmp(arg, "--dir") == 0)
+            opt->dir = val;
+        else if (strcmp(arg, "--out") == 0)
+            opt->out = val;
+        else if (strcmp(arg, "--res") == 0)
+        {
+            if (sscanf(val, "%dx%d", &opt->width, &opt->height) != 2)
+                return false;
+        }
+        else if (strcmp(arg, "--tolerance") == 0)
+            opt->tolerance = atoi(val);
+        else if (strcmp(arg, "--max-bad") == 0)
+            opt->max_bad_pct = atof(val);
+        else if (strcmp(arg, "--reps") == 0)
+            opt->reps = atoi(val);
+        else if (strcmp(arg, "--csv") == 0)
+            opt->csv = val;
+        else
+            return false;
+    }
+    if (opt->reps < 1)
+        opt->reps = 1;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    GoldenOptions opt;
+    if (!parse_options(argc, argv, &opt))
+    {
+        usage();
+        return 1;
+    }
+
+    render_set_resolution(opt.width, opt.height);
+    int width = g_render_width;
+    int height = g_render_height;
+    int pixels = width * height;
+    uint32_t *framebuffer = malloc((size_t)pixels * sizeof(uint32_t));
+    float *zbuffer = malloc((size_t)pixels * sizeof(float));
+    uint32_t *diff = malloc((size_t)pixels * sizeof(uint32_t));
+    double *samples = malloc((size_t)opt.reps * sizeof(double));
+    BenchScene *bs = malloc(sizeof(BenchScene));
+    if (!framebuffer || !zbuffer || !diff || !samples || !bs)
+    {
+        LOG_ERROR("Failed to allocate golden buffers");
+        return 1;
+    }
+    if (!make_dir(opt.dir) || !make_dir(opt.out))
+    {
+        LOG_ERROR("Cannot create %s or %s", opt.dir, opt.out);
+        return 1;
+    }
+
+    threadpool_init((int)sysconf(_SC_NPROCESSORS_ONLN));
+    render_set_framebuffer(framebuffer);
+    render_set_zbuffer(zbuffer);
+
+    GoldenVariant variants[16];
+    int variant_count = build_variants(variants);
+
+    FILE *csv = opt.csv ? fopen(opt.csv, "w") : NULL;
+    if (csv)
+        fprintf(csv, "scene,pose,variant,ms,max_diff,bad_pixels,result\n");
+
+    float aspect = (float)width / (float)height;
+    Mat4 proj = mat4_perspective(GOLDEN_PI / 3.0f, aspect, 0.1f, 10000.0f);
+    int failures = 0, passes = 0, created = 0, skipped = 0;
+    int max_bad = (int)(pixels * opt.max_bad_pct / 100.0);
+
+    printf("%dx%d, tolerance %d, max bad %.3f%% (%d px)\n", width, height, opt.tolerance,
+           opt.max_bad_pct, max_bad);
+    printf("%-8s %-4s %-16s %9s %5s %8s  %s\n", "scene", "pose", "variant", "ms", "diff", "bad px", "result");
+
+    for (size_t s = 0; s < sizeof(s_scenes) / sizeof(s_scenes[0]); s++)
+    {
+        bool arena = strcmp(s_scenes[s], "arena") == 0;
+        if (bench_scene_load(bs, s_scenes[s]) != 0 || (!arena && !bs->has_map))
+        {
+            printf("%-8s skipped: scene or its level mesh could not be loaded\n", bs->name);
+            bench_scene_free(bs);
+            skipped++;
+            continue;
+        }
+
+        for (int pose = 0; pose < GOLDEN_POSES; pose++)
+        {
+            char golden_path[GOLDEN_PATH_MAX];
+            snprintf(golden_path, sizeof(golden_path), "%s/%s_%dx%d_%d.ppm",
+                     opt.dir, bs->name, width, height, pose);
+            uint32_t *golden = opt.update ? NULL : ppm_read(golden_path, width, height);
+
+            for (int v = 0; v < variant_count; v++)
+            {
+                apply_variant(&variants[v]);
+                bench_scene_pose(bs, (float)pose / GOLDEN_POSES);
+
+                RenderStats stats;
+                for (int r = 0; r < opt.reps; r++)
+                {
+                    double t0 = now_ms();
+                    bench_scene_render(bs, proj, 0.0f, &stats);
+                    samples[r] = now_ms() - t0;
+                }
+                qsort(samples, (size_t)opt.reps, sizeof(double), compare_double);
+                double ms = samples[opt.reps / 2];
+
+                const char *result;
+                int max_diff = 0, bad = 0;
+                if (!golden)
+                {
+                    // The first variant is the scalar reference
+                    if (!ppm_write(golden_path, framebuffer, width, height))
+                    {
+                        LOG_ERROR("Cannot write %s", golden_path);
+                        result = "FAIL";
+                        failures++;
+                    }
+                    else
+                    {
+                        golden = ppm_read(golden_path, width, height);
+                        result = opt.update ? "UPDATED" : "NEW";
+                        created++;
+                    }
+                }
+                else
+                {
+                    bad = compare_images(framebuffer, golden, pixels, opt.tolerance, &max_diff, diff);
+                    if (bad > max_bad)
+                    {
+                        char path[GOLDEN_PATH_MAX];
+                        snprintf(path, sizeof(path), "%s/%s_%d_%s.ppm", opt.out, bs->name, pose,
+                                 variants[v].name);
+                        ppm_write(path, framebuffer, width, height);
+                        snprintf(path, sizeof(path), "%s/%s_%d_%s_diff.ppm", opt.out, bs->name, pose,
+                                 variants[v].name);
+                        ppm_write(path, diff, width, height);
+                        result = "FAIL";
+                        failures++;
+                    }
+                    else
+                    {
+                        result = "ok";
+                        passes++;
+                    }
+                }
+
+                printf("%-8s %-4d %-16s %9.3f %5d %8d  %s\n", bs->name, pose, variants[v].name,
+                       ms, max_diff, bad, result);
+                if (csv)
+                    fprintf(csv, "%s,%d,%s,%.4f,%d,%d,%s\n", bs->name, pose, variants[v].name,
+                            ms, max_diff, bad, result);
+            }
+            free(golden);
+        }
+        bench_scene_free(bs);
+    }
+
+    printf("%d passed, %d failed, %d goldens written, %d scenes skipped\n",
+           passes, failures, created, skipped);
+
+    if (csv)
+        fclose(csv);
+    threadpool_shutdown();
+    free(bs);
+    free(samples);
+    free(diff);
+    free(framebuffer);
+    free(zbuffer);
+    return failures > 0 ? 1 : 0;
+}
@@ -1,7 +1,10 @@
 #include "core/chunk.h"
 #include "core/entity.h"
 #include "core/log.h"
+#include "core/profile.h"
+#include "core/threads.h"
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
@@ -24,8 +27,22 @@ typedef struct
 {
     const WorldChunk *chunk;
     float dist_sq;
+    int bf_culled; // Per-chunk stats, summed once all packets are drawn
+    int tri_drawn;
+    int clip_trivial;
 } RenderPacket;
 
+// Inputs shared by the parallel chunk jobs; job i draws packets[i]
+typedef struct
+{
+    RenderPacket *packets;
+    const ChunkGrid *grid;
+    Mat4 vp;
+    Vec3 camera_pos;
+    Vec3 light_dir;
+    bool backface_cull;
+} ChunkRenderJobs;
+
 static int compare_packets_asc(const void *a, const void *b)
 {
     float da = ((const RenderPacket *)a)->dist_sq;
@@ -253,7 +270,23 @@ void chunk_grid_free(ChunkGrid *grid)
     memset(grid, 0, sizeof(ChunkGrid));
 }
 
-static uint32_t s_chunk_gen = 0;
+// Chunks may be transformed on several threads at once; every pass still
+// needs its own generation for the chunk's TransformCache
+static atomic_uint s_chunk_gen = 0;
+
+// Render vertex for a trivially accepted corner, shared with the earlier
+// faces of this pass that used the same position (and UV when textured)
+static int chunk_push_vertex(TransformCache *tc, float u, float v, bool textured)
+{
+    if (tc->vertex >= 0 && (!textured || (tc->u == u && tc->v == v)))
+        return tc->vertex;
+
+    ProjectedVertex pv = render_project_vertex(tc->clip);
+    tc->vertex = render_push_vertex(pv.screen.x, pv.screen.y, pv.z, tc->clip.w, u, v);
+    tc->u = u;
+    tc->v = v;
+    return tc->vertex;
+}
 
 static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
                               Vec3 cam_pos, Vec3 light_dir,
@@ -263,9 +296,12 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
                               int *clip_trivial)
 {
     // Identity model matrix (map is at origin, scale 1)
-    uint32_t gen = ++s_chunk_gen;
+    uint32_t gen = atomic_fetch_add(&s_chunk_gen, 1) + 1;
     TransformCache *cache = ch->cache;
 
+    // While recording, trivially accepted faces index shared vertices
+    bool indexed = render_is_recording();
+
     for (int i = 0; i < ch->face_count; i++)
     {
         OBJFace face = ch->faces[i];
@@ -273,6 +309,7 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
 
         Vec3 wv[3];
         Vec4 cv[3];
+        TransformCache *tcs[3];
         for (int k = 0; k < 3; k++)
         {
             OBJVertex *vert = &ch->vertices[idx[k]];
@@ -284,9 +321,11 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
                 tc->world = pos4;
                 tc->clip = mat4_mul_vec4(vp, pos4);
                 tc->gen = gen;
+                tc->vertex = -1;
             }
             wv[k] = vec3_from_vec4(tc->world);
             cv[k] = tc->clip;
+            tcs[k] = tc;
         }
 
         Vec3 edge1 = vec3_sub(wv[1], wv[0]);
@@ -334,6 +373,17 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
             if (cr == CLIP_ACCEPT && clip_trivial)
                 (*clip_trivial)++;
 
+            if (cr == CLIP_ACCEPT && indexed)
+            {
+                render_push_triangle_textured(chunk_push_vertex(tcs[0], u0, v0, true),
+                                              chunk_push_vertex(tcs[1], u1, v1, true),
+                                              chunk_push_vertex(tcs[2], u2, v2, true),
+                                              tex, intensity);
+                if (tri_drawn)
+                    (*tri_drawn)++;
+                continue;
+            }
+
             ProjectedVertex pv0 = render_project_vertex(poly.vertices[0].position);
             for (int j = 1; j < poly.count - 1; j++)
             {
@@ -341,11 +391,11 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
                 ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
                 render_fill_triangle_textured(
-                    (int)pv0.screen.x, (int)pv0.screen.y, pv0.z,
+                    pv0.screen.x, pv0.screen.y, pv0.z,
                     poly.vertices[0].u, poly.vertices[0].v, poly.vertices[0].position.w,
-                    (int)pv1.screen.x, (int)pv1.screen.y, pv1.z,
+                    pv1.screen.x, pv1.screen.y, pv1.z,
                     poly.vertices[j].u, poly.vertices[j].v, poly.vertices[j].position.w,
-                    (int)pv2.screen.x, (int)pv2.screen.y, pv2.z,
+                    pv2.screen.x, pv2.screen.y, pv2.z,
                     poly.vertices[j + 1].u, poly.vertices[j + 1].v, poly.vertices[j + 1].position.w,
                     tex, intensity);
                 if (tri_drawn)
@@ -371,6 +421,17 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
             if (cr == CLIP_ACCEPT && clip_trivial)
                 (*clip_trivial)++;
 
+            if (cr == CLIP_ACCEPT && indexed)
+            {
+                render_push_triangle(chunk_push_vertex(tcs[0], 0, 0, false),
+                                     chunk_push_vertex(tcs[1], 0, 0, false),
+                                     chunk_push_vertex(tcs[2], 0, 0, false),
+                                     shaded);
+                if (tri_drawn)
+                    (*tri_drawn)++;
+                continue;
+            }
+
             ProjectedVertex pv0 = render_project_vertex(poly.vertices[0].position);
             for (int j = 1; j < poly.count - 1; j++)
             {
@@ -378,9 +439,9 @@ static void render_chunk_flat(const WorldChunk *ch, Mat4 vp,
                 ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
                 render_fill_triangle_z(
-                    (int)pv0.screen.x, (int)pv0.screen.y, pv0.z, poly.vertices[0].position.w,
-                    (int)pv1.screen.x, (int)pv1.screen.y, pv1.z, poly.vertices[j].position.w,
-                    (int)pv2.screen.x, (int)pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
+                    pv0.screen.x, pv0.screen.y, pv0.z, poly.vertices[0].position.w,
+                    pv1.screen.x, pv1.screen.y, pv1.z, poly.vertices[j].position.w,
+                    pv2.screen.x, pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
                     poly.vertices[0].color);
                 if (tri_drawn)
                     (*tri_drawn)++;
@@ -395,7 +456,7 @@ static void render_chunk_wireframe(const WorldChunk *ch, Mat4 vp,
                                    int *bf_culled, int *tri_drawn,
                                    int *clip_trivial)
 {
-    uint32_t gen = ++s_chunk_gen;
+    uint32_t gen = atomic_fetch_add(&s_chunk_gen, 1) + 1;
     TransformCache *cache = ch->cache;
 
     for (int i = 0; i < ch->face_count; i++)
@@ -463,6 +524,23 @@ static void render_chunk_wireframe(const WorldChunk *ch, Mat4 vp,
     }
 }
 
+static void render_packet(const ChunkRenderJobs *jobs, RenderPacket *p)
+{
+    render_chunk_flat(p->chunk, jobs->vp, jobs->camera_pos, jobs->light_dir,
+                      jobs->backface_cull,
+                      jobs->grid->textures, jobs->grid->texture_count,
+                      &p->bf_culled, &p->tri_drawn, &p->clip_trivial);
+}
+
+static void chunk_render_job(int index, void *userdata)
+{
+    ChunkRenderJobs *jobs = userdata;
+    PROFILE_SCOPE(PROFILE_GEOMETRY);
+    render_begin_batch(index);
+    render_packet(jobs, &jobs->packets[index]);
+    render_end_batch();
+}
+
 void chunk_grid_render(const ChunkGrid *grid, Mat4 vp,
                        Vec3 camera_pos, Vec3 light_dir,
                        const Frustum *frustum, bool backface_cull,
@@ -476,6 +554,7 @@ void chunk_grid_render(const ChunkGrid *grid, Mat4 vp,
     // Collect visible chunks with distance for front-to-back sorting
     RenderPacket packets[MAX_CHUNKS];
     int packet_count = 0;
+    ProfileScope cull_scope = profile_begin(PROFILE_CULL);
 
     for (int i = 0; i < grid->count; i++)
     {
@@ -493,21 +572,43 @@ void chunk_grid_render(const ChunkGrid *grid, Mat4 vp,
         Vec3 diff = vec3_sub(ch->center, camera_pos);
         float dist_sq = vec3_dot(diff, diff);
 
-        packets[packet_count].chunk = ch;
-        packets[packet_count].dist_sq = dist_sq;
+        packets[packet_count] = (RenderPacket){.chunk = ch, .dist_sq = dist_sq};
         packet_count++;
     }
 
     // Sort front-to-back (closest first) for Z-buffer efficiency
     qsort(packets, (size_t)packet_count, sizeof(RenderPacket), compare_packets_asc);
+    profile_end(&cull_scope);
+
+    ChunkRenderJobs jobs = {
+        .packets = packets,
+        .grid = grid,
+        .vp = vp,
+        .camera_pos = camera_pos,
+        .light_dir = light_dir,
+        .backface_cull = backface_cull,
+    };
+
+    // While commands are being recorded the pool transforms and clips chunks
+    // in parallel; batches merge back in sorted order before binning
+    if (render_is_recording() && packet_count > 1 && render_begin_batches(packet_count))
+    {
+        threadpool_run(packet_count, chunk_render_job, &jobs);
+        render_merge_batches();
+    }
+    else
+    {
+        // Draw in sorted order
+        PROFILE_SCOPE(PROFILE_GEOMETRY);
+        for (int i = 0; i < packet_count; i++)
+            render_packet(&jobs, &packets[i]);
+    }
 
-    // Draw in sorted order
     for (int i = 0; i < packet_count; i++)
     {
-        render_chunk_flat(packets[i].chunk, vp, camera_pos, light_dir,
-                          backface_cull,
-                          grid->textures, grid->texture_count,
-                          &bf_culled, &tri_drawn, &clip_triv);
+        bf_culled += packets[i].bf_culled;
+        tri_drawn += packets[i].tri_drawn;
+        clip_triv += packets[i].clip_trivial;
     }
 
     if (stats_out)
@@ -532,6 +633,7 @@ void chunk_grid_render_wireframe(const ChunkGrid *grid, Mat4 vp,
     // Collect visible chunks with distance for front-to-back sorting
     RenderPacket packets[MAX_CHUNKS];
     int packet_count = 0;
+    ProfileScope cull_scope = profile_begin(PROFILE_CULL);
 
     for (int i = 0; i < grid->count; i++)
     {
@@ -556,13 +658,16 @@ void chunk_grid_render_wireframe(const ChunkGrid *grid, Mat4 vp,
 
     // Sort front-to-back (closest first)
     qsort(packets, (size_t)packet_count, sizeof(RenderPacket), compare_packets_asc);
+    profile_end(&cull_scope);
 
     // Draw in sorted order
+    ProfileScope draw_scope = profile_begin(PROFILE_GEOMETRY);
     for (int i = 0; i < packet_count; i++)
     {
         render_chunk_wireframe(packets[i].chunk, vp, camera_pos,
                                backface_cull, &bf_culled, &tri_drawn, &clip_triv);
     }
+    profile_end(&draw_scope);
 
     if (stats_out)
     {
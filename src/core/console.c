@@ -1,6 +1,8 @@
 #include "core/console.h"
 #include "core/level.h"
 #include "core/log.h"
+#include "core/profile.h"
+#include "core/sim.h"
 #include "core/threads.h"
 #include "graphics/render.h"
 #include <SDL2/SDL.h>
@@ -214,16 +216,29 @@ void console_execute(Console *con, CommandContext *ctx)
         console_log(con, " fog_color <hex>    - fog color");
         console_log(con, " skybox <top> <bot> - skybox colors");
         console_log(con, " vsync <0/1>        - vsync");
-        console_log(con, " simd <0/1>         - (experimental)");
-        console_log(con, " threads <0/1>      - multithreading");
+        console_log(con, " simd <0/1>         - SIMD rasterizer");
+        console_log(con, " simd_isa <name>    - auto/sse2/avx2/avx512");
+        console_log(con, " hiz <0/1>          - Hi-Z culling");
+        console_log(con, " threads <mode>     - 0/1/sortlast/auto");
         console_log(con, " threads_count <N>  - set thread count");
+        console_log(con, " threads_pin <0/1>  - pin workers to CPUs");
+        console_log(con, " tile_size <N>      - raster tile px, 0=auto");
+        console_log(con, " pipeline <0/1>     - overlap frames (+1 lag)");
         console_log(con, " resolution <W> <H> - render size");
+        console_log(con, " sim_rate <Hz>      - simulation tick rate");
+        console_log(con, " profile <N> [file] - trace N frames (json)");
+        console_log(con, " record <file|stop> - record input");
+        console_log(con, " replay <file> [rt] - replay, fast or rt");
+        console_log(con, " replay stop        - end replay");
+        console_log(con, " capture <file>     - dump next frame's raster input");
         console_log(con, " toggle wireframe   - wireframe");
         console_log(con, " toggle backface    - backface cull");
         console_log(con, " toggle aabb        - bounding box");
         console_log(con, " toggle rays        - ray debug vis");
         console_log(con, " toggle debug       - toggle HUD");
         console_log(con, " toggle tiles       - tile debug vis");
+        console_log(con, " toggle overdraw    - overdraw heatmap");
+        console_log(con, " toggle profile     - stage timings HUD");
         console_log(con, " load <file>        - load level/map");
         console_log(con, " save_level <file>  - save (.lvl)");
         console_log(con, " resume             - back to game");
@@ -328,6 +343,22 @@ void console_execute(Console *con, CommandContext *ctx)
         con->debug_tiles = !con->debug_tiles;
         console_log(con, "Tile debug: %s", con->debug_tiles ? "ON" : "OFF");
     }
+    // --- toggle overdraw ---
+    else if (strcmp(tokens[0], "toggle") == 0 && ntokens >= 2 &&
+             strcmp(tokens[1], "overdraw") == 0)
+    {
+        con->debug_overdraw = !con->debug_overdraw;
+        render_set_overdraw(con->debug_overdraw);
+        console_log(con, "Overdraw debug: %s", con->debug_overdraw ? "ON" : "OFF");
+    }
+    // --- toggle profile ---
+    else if (strcmp(tokens[0], "toggle") == 0 && ntokens >= 2 &&
+             strcmp(tokens[1], "profile") == 0)
+    {
+        con->show_profile = !con->show_profile;
+        profile_set_enabled(con->show_profile);
+        console_log(con, "Profiler: %s", con->show_profile ? "ON" : "OFF");
+    }
     // --- deselect ---
     else if (strcmp(tokens[0], "deselect") == 0)
     {
@@ -546,15 +577,49 @@ void console_execute(Console *con, CommandContext *ctx)
     {
         bool enable = atoi(tokens[1]) != 0;
         render_set_simd(enable);
-        console_log(con, "SIMD: %s", enable ? "ON" : "OFF");
+        console_log(con, "SIMD: %s (%s)", enable ? "ON" : "OFF", render_get_simd_isa_name());
     }
-    // --- threads <0/1> ---
-    else if (strcmp(tokens[0], "threads") == 0 && ntokens >= 2)
+    // --- simd_isa <auto|sse2|avx2|avx512> ---
+    else if (strcmp(tokens[0], "simd_isa") == 0 && ntokens >= 2)
+    {
+        static const char *isa_names[] = {"auto", "sse2", "avx2", "avx512"};
+        int isa = -1;
+        for (int i = 0; i < (int)(sizeof(isa_names) / sizeof(isa_names[0])); i++)
+        {
+            if (strcmp(tokens[1], isa_names[i]) == 0)
+                isa = i;
+        }
+
+        if (isa < 0)
+            console_log(con, "Usage: simd_isa <auto|sse2|avx2|avx512>");
+        else if (render_set_simd_isa((RenderSimdIsa)isa))
+            console_log(con, "SIMD ISA: %s", render_get_simd_isa_name());
+        else
+            console_log(con, "SIMD ISA %s not supported on this CPU", tokens[1]);
+    }
+    // --- hiz <0/1> ---
+    else if (strcmp(tokens[0], "hiz") == 0 && ntokens >= 2)
     {
         bool enable = atoi(tokens[1]) != 0;
-        render_set_threaded(enable);
+        render_set_hiz(enable);
+        console_log(con, "Hi-Z culling: %s", enable ? "ON" : "OFF");
+    }
+    // --- threads <0|1|tiles|sortlast|auto> ---
+    else if (strcmp(tokens[0], "threads") == 0 && ntokens >= 2)
+    {
+        static const char *mode_names[] = {"off", "tiles", "sortlast", "auto"};
+        int mode = -1;
+        for (int i = 0; i < (int)(sizeof(mode_names) / sizeof(mode_names[0])); i++)
+        {
+            if (strcmp(tokens[1], mode_names[i]) == 0)
+                mode = i;
+        }
+        if (mode < 0)
+            mode = atoi(tokens[1]) != 0 ? RENDER_THREAD_TILES : RENDER_THREAD_OFF;
+
+        render_set_threaded((RenderThreadMode)mode);
         console_log(con, "Threaded rasterizer: %s (%d workers)",
-                    enable ? "ON" : "OFF", threadpool_get_count());
+                    mode_names[mode], threadpool_get_count());
     }
     // -- threads_count <N> ---
     else if (strcmp(tokens[0], "threads_count") == 0 && ntokens >= 2)
@@ -562,9 +627,33 @@ void console_execute(Console *con, CommandContext *ctx)
         int count = atoi(tokens[1]);
         if (count < 1)
             count = 1;
-        threadpool_shutdown();
-        threadpool_init(count);
-        console_log(con, "Thread pool resized: %d workers", count);
+        threadpool_resize(count);
+        console_log(con, "Thread pool resized: %d workers", threadpool_get_count());
+    }
+    // --- threads_pin <0/1> ---
+    else if (strcmp(tokens[0], "threads_pin") == 0 && ntokens >= 2)
+    {
+        bool enable = atoi(tokens[1]) != 0;
+        if (threadpool_set_pinning(enable))
+            console_log(con, "Worker pinning: %s (%d NUMA node%s)", enable ? "ON" : "OFF",
+                        threadpool_get_node_count(), threadpool_get_node_count() == 1 ? "" : "s");
+        else
+            console_log(con, "Worker pinning not supported here");
+    }
+    // --- pipeline <0/1> ---
+    else if (strcmp(tokens[0], "pipeline") == 0 && ntokens >= 2)
+    {
+        bool enable = atoi(tokens[1]) != 0;
+        render_set_pipelined(enable);
+        console_log(con, "Frame pipelining: %s%s", enable ? "ON" : "OFF",
+                    enable && !render_get_threaded() ? " (needs threads 1)" : "");
+    }
+    // --- tile_size <N> ---
+    else if (strcmp(tokens[0], "tile_size") == 0 && ntokens >= 2)
+    {
+        int size = atoi(tokens[1]);
+        render_set_tile_size(size);
+        console_log(con, "Tile size: %d px%s", render_get_tile_size(), size > 0 ? "" : " (auto)");
     } // --- resolution <w> <h> ---
     else if (strcmp(tokens[0], "resolution") == 0 && ntokens >= 3)
     {
@@ -572,6 +661,64 @@ void console_execute(Console *con, CommandContext *ctx)
         int h = atoi(tokens[2]);
         render_set_resolution(w, h);
         console_log(con, "Resolution: %dx%d", g_render_width, g_render_height);
+    } // --- sim_rate <Hz> ---
+    else if (strcmp(tokens[0], "sim_rate") == 0 && ntokens >= 2 && ctx->sim)
+    {
+        if (sim_set_rate(ctx->sim, atoi(tokens[1])))
+            console_log(con, "Simulation rate: %d Hz", sim_get_rate(ctx->sim));
+        else
+            console_log(con, "sim_rate: not while recording or replaying");
+    } // --- profile <frames> [file] ---
+    else if (strcmp(tokens[0], "profile") == 0 && ntokens >= 2)
+    {
+        int frames = atoi(tokens[1]);
+        const char *path = ntokens >= 3 ? tokens[2] : "profile.json";
+        if (profile_capture(frames, path))
+            console_log(con, "Profiling %d frames to %s", frames, path);
+        else
+            console_log(con, "ERROR: capture running or bad frame count");
+    } // --- record <file|stop> ---
+    else if (strcmp(tokens[0], "record") == 0 && ntokens >= 2 && ctx->sim)
+    {
+        if (strcmp(tokens[1], "stop") == 0)
+        {
+            int ticks = sim_record_stop(ctx->sim);
+            if (ticks >= 0)
+                console_log(con, "Recorded %d ticks", ticks);
+            else
+                console_log(con, "ERROR: not recording or save failed");
+        }
+        else if (sim_record_start(ctx->sim, tokens[1], ctx->current_map_path))
+            console_log(con, "Recording to %s ('record stop' ends)", tokens[1]);
+        else
+            console_log(con, "ERROR: already recording or replaying");
+    } // --- replay <file> [rt] | replay stop ---
+    else if (strcmp(tokens[0], "replay") == 0 && ntokens >= 2 && ctx->sim)
+    {
+        if (strcmp(tokens[1], "stop") == 0)
+        {
+            sim_replay_stop(ctx->sim);
+        }
+        else
+        {
+            bool realtime = ntokens >= 3 && strcmp(tokens[2], "rt") == 0;
+            if (sim_replay_start(ctx->sim, tokens[1], realtime, ctx->current_map_path))
+            {
+                console_log(con, "Replaying %s (%s)", tokens[1], realtime ? "real time" : "fast");
+                *ctx->state = GAME_STATE_PLAYING;
+            }
+            else
+                console_log(con, "ERROR: cannot replay %s", tokens[1]);
+        }
+    } // --- capture <file> ---
+    else if (strcmp(tokens[0], "capture") == 0 && ntokens >= 2)
+    {
+        if (!render_get_threaded())
+            console_log(con, "ERROR: capture needs threads 1/sortlast/auto");
+        else if (render_capture_next(tokens[1]))
+            console_log(con, "Capturing next frame to %s", tokens[1]);
+        else
+            console_log(con, "ERROR: bad capture path");
     } // --- unknown command ---
     else
     {
@@ -35,6 +35,8 @@ typedef struct
     bool backface_cull;
     bool show_debug;
     bool debug_tiles;
+    bool debug_overdraw;
+    bool show_profile;
 } Console;
 
 void console_init(Console *con);
@@ -61,6 +63,7 @@ typedef struct
     int *selected_entity;
     bool *debug_aabb;
     struct SDL_Renderer *renderer;
+    struct SimThread *sim;
 } CommandContext;
 
 void console_execute(Console *con, CommandContext *ctx);
@@ -199,9 +199,9 @@ static void render_mesh_flat(const Entity *ent, Mat4 model, Mat4 vp,
             ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
             render_fill_triangle_z(
-                (int)pv0.screen.x, (int)pv0.screen.y, pv0.z, poly.vertices[0].position.w,
-                (int)pv1.screen.x, (int)pv1.screen.y, pv1.z, poly.vertices[j].position.w,
-                (int)pv2.screen.x, (int)pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
+                pv0.screen.x, pv0.screen.y, pv0.z, poly.vertices[0].position.w,
+                pv1.screen.x, pv1.screen.y, pv1.z, poly.vertices[j].position.w,
+                pv2.screen.x, pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
                 poly.vertices[0].color);
             if (tri_drawn)
                 (*tri_drawn)++;
@@ -282,11 +282,11 @@ static void render_mesh_textured(const Entity *ent, Mat4 model, Mat4 vp,
             ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
             render_fill_triangle_textured(
-                (int)pv0.screen.x, (int)pv0.screen.y, pv0.z,
+                pv0.screen.x, pv0.screen.y, pv0.z,
                 poly.vertices[0].u, poly.vertices[0].v, poly.vertices[0].position.w,
-                (int)pv1.screen.x, (int)pv1.screen.y, pv1.z,
+                pv1.screen.x, pv1.screen.y, pv1.z,
                 poly.vertices[j].u, poly.vertices[j].v, poly.vertices[j].position.w,
-                (int)pv2.screen.x, (int)pv2.screen.y, pv2.z,
+                pv2.screen.x, pv2.screen.y, pv2.z,
                 poly.vertices[j + 1].u, poly.vertices[j + 1].v, poly.vertices[j + 1].position.w,
                 ent->texture, intensity);
             if (tri_drawn)
@@ -379,11 +379,11 @@ static void render_obj_flat(const Entity *ent, Mat4 model, Mat4 vp,
                 ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
                 render_fill_triangle_textured(
-                    (int)pv0.screen.x, (int)pv0.screen.y, pv0.z,
+                    pv0.screen.x, pv0.screen.y, pv0.z,
                     poly.vertices[0].u, poly.vertices[0].v, poly.vertices[0].position.w,
-                    (int)pv1.screen.x, (int)pv1.screen.y, pv1.z,
+                    pv1.screen.x, pv1.screen.y, pv1.z,
                     poly.vertices[j].u, poly.vertices[j].v, poly.vertices[j].position.w,
-                    (int)pv2.screen.x, (int)pv2.screen.y, pv2.z,
+                    pv2.screen.x, pv2.screen.y, pv2.z,
                     poly.vertices[j + 1].u, poly.vertices[j + 1].v, poly.vertices[j + 1].position.w,
                     tex, intensity);
                 if (tri_drawn)
@@ -415,9 +415,9 @@ static void render_obj_flat(const Entity *ent, Mat4 model, Mat4 vp,
                 ProjectedVertex pv2 = render_project_vertex(poly.vertices[j + 1].position);
 
                 render_fill_triangle_z(
-                    (int)pv0.screen.x, (int)pv0.screen.y, pv0.z, poly.vertices[0].position.w,
-                    (int)pv1.screen.x, (int)pv1.screen.y, pv1.z, poly.vertices[j].position.w,
-                    (int)pv2.screen.x, (int)pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
+                    pv0.screen.x, pv0.screen.y, pv0.z, poly.vertices[0].position.w,
+                    pv1.screen.x, pv1.screen.y, pv1.z, poly.vertices[j].position.w,
+                    pv2.screen.x, pv2.screen.y, pv2.z, poly.vertices[j + 1].position.w,
                     poly.vertices[0].color);
                 if (tri_drawn)
                     (*tri_drawn)++;
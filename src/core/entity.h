@@ -52,12 +52,27 @@ typedef struct
 
 typedef struct RenderStats
 {
-    int entities_culled; // Frustum-culled entities
-    int chunks_culled;   // Frustum-culled chunks
-    int chunks_total;    // Total chunks tested
-    int backface_culled; // Triangles discarded by backface test
-    int triangles_drawn; // Triangles sent to rasterizer
-    int clip_trivial;    // Triangles that skipped clipping (trivial accept)
+    int entities_culled;     // Frustum-culled entities
+    int chunks_culled;       // Frustum-culled chunks
+    int chunks_total;        // Total chunks tested
+    int backface_culled;     // Triangles discarded by backface test
+    int triangles_drawn;     // Triangles sent to rasterizer
+    int clip_trivial;        // Triangles that skipped clipping (trivial accept)
+    int cmd_count;           // Render commands recorded this frame
+    int cmd_vertices;        // Post-transform vertices the commands index
+    int cmd_high_water;      // Most render commands in any frame so far
+    int bin_entries;         // Triangle references across all tile bins
+    int bin_active;          // Tiles with a non-empty bin
+    int bin_max;             // Largest single tile bin
+    int hiz_tiles_rejected;  // Triangle/32x32 tile pairs rejected by Hi-Z
+    int hiz_blocks_rejected; // 8x8 blocks rejected by Hi-Z
+    // Pixel work of the raster kernels. Sort-last shares each test against
+    // their own depth buffer, so they pass more pixels than tiles do.
+    int pixels_tested;       // Covered pixels depth-tested
+    int pixels_passed;       // Pixels that passed depth and were written
+    int pixels_shaded;       // Pixels shaded; SIMD shades whole chunks
+    int pixels_visible;      // Pixels holding a triangle in the frame shown;
+                             // only counted while overdraw is on
 } RenderStats;
 
 void scene_init(Scene *scene);
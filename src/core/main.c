@@ -20,6 +20,8 @@
 #include "core/collision_grid.h"
 #include "core/chunk.h"
 #include "core/threads.h"
+#include "core/sim.h"
+#include "core/profile.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
@@ -37,6 +39,105 @@
 
 static uint32_t *framebuffer = NULL;
 static float *zbuffer = NULL;
+// Second pair, drawn into while the other frame rasterizes (pipelining)
+static uint32_t *back_framebuffer = NULL;
+static float *back_zbuffer = NULL;
+
+// World-space debug overlays of one frame. A pipelined frame is shown one
+// loop iteration after it was recorded, so what its overlays need is
+// captured along with it and drawn once its tiles are done.
+typedef struct
+{
+    Mat4 vp;
+    bool hover;
+    AABB hover_box;
+    bool select;
+    AABB select_box;
+    int hit_count;
+    AABB hit_boxes[MAX_ENTITIES];
+    int projectile_count;
+    Vec3 projectiles[MAX_PROJECTILES];
+    bool ray;
+    Vec3 ray_start;
+    Vec3 ray_end;
+} FrameOverlays;
+
+static void overlays_capture(FrameOverlays *o, Mat4 vp, const Scene *scene,
+                             const Projectile *projectiles, int hovered, int selected,
+                             bool ray, Vec3 ray_start, Vec3 ray_end)
+{
+    o->vp = vp;
+    o->hover = hovered >= 0;
+    if (o->hover)
+        o->hover_box = entity_get_world_aabb(&scene->entities[hovered]);
+
+    // Selection highlight (darker green, persistent until deselected)
+    o->select = selected >= 0 && selected < scene->count && selected != hovered;
+    if (o->select)
+        o->select_box = entity_get_world_aabb(&scene->entities[selected]);
+
+    o->hit_count = 0;
+    for (int i = 0; i < scene->count; i++)
+    {
+        if (scene->entities[i].hit_timer > 0)
+            o->hit_boxes[o->hit_count++] = entity_get_world_aabb(&scene->entities[i]);
+    }
+
+    o->projectile_count = 0;
+    for (int i = 0; i < MAX_PROJECTILES; i++)
+    {
+        if (projectiles[i].active)
+            o->projectiles[o->projectile_count++] = projectiles[i].position;
+    }
+
+    o->ray = ray;
+    o->ray_start = ray_start;
+    o->ray_end = ray_end;
+}
+
+static void overlays_draw(const FrameOverlays *o, const Camera *camera, bool debug_aabb)
+{
+    if (debug_aabb)
+    {
+        for (int i = 0; i < camera->collider_count; i++)
+        {
+            render_draw_aabb(camera->colliders[i], o->vp, COLOR_DEBUG_AABB);
+        }
+    }
+
+    if (o->hover)
+        render_draw_aabb(o->hover_box, o->vp, COLOR_HOVER_AABB);
+    if (o->select)
+        render_draw_aabb(o->select_box, o->vp, COLOR_SELECT_AABB);
+
+    for (int i = 0; i < o->hit_count; i++)
+        render_draw_aabb(o->hit_boxes[i], o->vp, COLOR_HIT_FLASH);
+
+    for (int i = 0; i < o->projectile_count; i++)
+    {
+        AABB pbox = aabb_from_center_size(o->projectiles[i],
+                                          (Vec3){PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE});
+        render_draw_aabb(pbox, o->vp, COLOR_PROJECTILE);
+
+        // Draw a bright center dot for visibility at distance
+        Vec4 cc = mat4_mul_vec4(o->vp, vec4_from_vec3(o->projectiles[i], 1.0f));
+        if (cc.w > 0.1f)
+        {
+            ProjectedVertex pv = render_project_vertex(cc);
+            int px = (int)pv.screen.x;
+            int py = (int)pv.screen.y;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                    render_set_pixel(px + dx, py + dy, 0xFFFF0000);
+        }
+    }
+
+    // Debug ray visualization
+    if (o->ray)
+    {
+        render_draw_3d_line(o->ray_start, o->ray_end, o->vp, COLOR_DEBUG_RAY);
+    }
+}
 
 int main(int argc, char *argv[])
 {
@@ -44,6 +145,7 @@ int main(int argc, char *argv[])
     (void)argv;
 
     LOG_INFO("Initializing engine...");
+    profile_set_thread_name("main");
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
@@ -91,11 +193,20 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Pool first, so the render buffers can be first-touched from it
+    int num_cores = SDL_GetCPUCount();
+    if (num_cores < 1)
+        num_cores = 4;
+    threadpool_init(num_cores);
+
     framebuffer = malloc(g_render_width * g_render_height * sizeof(uint32_t));
     zbuffer = malloc(g_render_width * g_render_height * sizeof(float));
-    if (!framebuffer || !zbuffer)
+    back_framebuffer = malloc(g_render_width * g_render_height * sizeof(uint32_t));
+    back_zbuffer = malloc(g_render_width * g_render_height * sizeof(float));
+    if (!framebuffer || !zbuffer || !back_framebuffer || !back_zbuffer)
     {
         LOG_ERROR("Failed to allocate render buffers");
+        threadpool_shutdown();
         SDL_DestroyTexture(texture);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
@@ -105,13 +216,8 @@ int main(int argc, char *argv[])
 
     render_set_framebuffer(framebuffer);
     render_set_zbuffer(zbuffer);
-
-    int num_cores = SDL_GetCPUCount();
-    if (num_cores < 1)
-        num_cores = 4;
-    if (num_cores > MAX_WORKER_THREADS)
-        num_cores = MAX_WORKER_THREADS;
-    threadpool_init(num_cores);
+    render_set_pipeline_buffers(back_framebuffer, back_zbuffer);
+    LOG_INFO("SIMD kernels: %s", render_get_simd_isa_name());
 
     float fog_start = 50.0f;
     float fog_end = 500.0f;
@@ -193,6 +299,7 @@ int main(int argc, char *argv[])
     int window_height = WINDOW_HEIGHT;
     int tracked_rw = g_render_width;
     int tracked_rh = g_render_height;
+    int tracked_placement = threadpool_get_placement();
 
     Camera camera;
     camera_init(&camera, (Vec3){0, 2, 0}, 0.0f, 0.0f);
@@ -226,6 +333,11 @@ int main(int argc, char *argv[])
 
     Vec3 light_dir = vec3_normalize((Vec3){0.5f, 1.0f, -0.5f});
 
+    // From here on the scene and camera belong to the simulation thread;
+    // the loop below renders its snapshots
+    static SimThread sim;
+    sim_start(&sim, &scene, &camera);
+
     // Game state machine
     GameState game_state = GAME_STATE_PLAYING;
     Console console;
@@ -233,20 +345,21 @@ int main(int argc, char *argv[])
     console_log(&console, "Engine console ready. Type 'help'.");
 
     bool running = true;
-    int selected_entity = -1;
     static OBJMesh loaded_map = {0};
     static CollisionGrid collision_grid = {0};
     static ChunkGrid chunk_grid = {0};
     static char current_map_path[256] = {0};
 
     bool debug_aabb = false;
+    FrameOverlays overlays[2] = {0};
+    int overlay_slot = 0;
     bool vsync_enabled = true;
     bool threaded_enabled = false;
     int resolution_index = 1; // 0=320x240, 1=640x480, 2=800x600
 
     CommandContext cmd_ctx;
-    cmd_ctx.scene = &scene;
-    cmd_ctx.camera = &camera;
+    cmd_ctx.scene = &sim.scene;
+    cmd_ctx.camera = &sim.camera;
     cmd_ctx.teapot = &teapot;
     cmd_ctx.cube_mesh = &cube_mesh;
     cmd_ctx.loaded_map = &loaded_map;
@@ -256,26 +369,14 @@ int main(int argc, char *argv[])
     cmd_ctx.running = &running;
     cmd_ctx.console = &console;
     cmd_ctx.state = &game_state;
-    cmd_ctx.selected_entity = &selected_entity;
+    cmd_ctx.selected_entity = &sim.selected_entity;
+    cmd_ctx.sim = &sim;
     cmd_ctx.debug_aabb = &debug_aabb;
     cmd_ctx.renderer = renderer;
 
     Uint32 prev_time = SDL_GetTicks();
 
-    bool key_w = false, key_s = false, key_a = false, key_d = false;
-    bool key_space = false;
-    bool key_shift = false;
-    bool shoot_requested = false;
-    bool select_requested = false;
-
-    int hovered_entity = -1;
-
-    Projectile projectiles[MAX_PROJECTILES] = {0};
-
-    // Debug ray visualization
-    Vec3 debug_ray_start = {0, 0, 0};
-    Vec3 debug_ray_end = {0, 0, 0};
-    float debug_ray_timer = 0;
+    SimInput input = {0};
 
     bool frustum_culling = true;
     MenuState menu_state = MENU_MAIN;
@@ -294,6 +395,7 @@ int main(int argc, char *argv[])
         bool menu_clicked = false;
         menu_scroll_delta = 0;
         SDL_Event event;
+        ProfileScope events_scope = profile_begin(PROFILE_EVENTS);
         while (SDL_PollEvent(&event))
         {
             if (event.type == SDL_QUIT)
@@ -328,7 +430,12 @@ int main(int argc, char *argv[])
                     }
                     else if (key == SDLK_RETURN)
                     {
+                        // Commands may free meshes and textures a frame in
+                        // flight still reads, and edit the simulation's state
+                        render_finish_frames();
+                        sim_lock(&sim);
                         console_execute(&console, &cmd_ctx);
+                        sim_unlock(&sim);
                     }
                     else if (key == SDLK_BACKSPACE)
                     {
@@ -409,36 +516,36 @@ int main(int argc, char *argv[])
                 case SDLK_ESCAPE:
                     game_state = GAME_STATE_PAUSED;
                     SDL_SetRelativeMouseMode(SDL_FALSE);
-                    key_w = key_s = key_a = key_d = false;
+                    input.forward = input.back = input.left = input.right = false;
                     LOG_INFO("Paused");
                     break;
                 case SDLK_BACKQUOTE:
                     game_state = GAME_STATE_CONSOLE;
                     SDL_SetRelativeMouseMode(SDL_FALSE);
-                    key_w = key_s = key_a = key_d = false;
+                    input.forward = input.back = input.left = input.right = false;
                     LOG_INFO("Console opened");
                     break;
                 case SDLK_w:
-                    key_w = true;
+                    input.forward = true;
                     break;
                 case SDLK_s:
-                    key_s = true;
+                    input.back = true;
                     break;
                 case SDLK_a:
-                    key_a = true;
+                    input.left = true;
                     break;
                 case SDLK_d:
-                    key_d = true;
+                    input.right = true;
                     break;
                 case SDLK_b:
                     debug_aabb = !debug_aabb;
                     break;
                 case SDLK_SPACE:
-                    key_space = true;
+                    input.jump = true;
                     break;
                 case SDLK_LSHIFT:
                 case SDLK_RSHIFT:
-                    key_shift = true;
+                    input.sprint = true;
                     break;
                 }
             }
@@ -447,53 +554,63 @@ int main(int argc, char *argv[])
                 switch (event.key.keysym.sym)
                 {
                 case SDLK_w:
-                    key_w = false;
+                    input.forward = false;
                     break;
                 case SDLK_s:
-                    key_s = false;
+                    input.back = false;
                     break;
                 case SDLK_a:
-                    key_a = false;
+                    input.left = false;
                     break;
                 case SDLK_d:
-                    key_d = false;
+                    input.right = false;
                     break;
                 case SDLK_SPACE:
-                    key_space = false;
+                    input.jump = false;
                     break;
                 case SDLK_LSHIFT:
                 case SDLK_RSHIFT:
-                    key_shift = false;
+                    input.sprint = false;
                     break;
                 }
             }
             if (event.type == SDL_MOUSEMOTION)
             {
-                float delta_yaw = event.motion.xrel * CAMERA_SENSITIVITY;
-                float delta_pitch = -event.motion.yrel * CAMERA_SENSITIVITY;
-                camera_rotate(&camera, delta_yaw, delta_pitch);
+                input.look_yaw += event.motion.xrel * CAMERA_SENSITIVITY;
+                input.look_pitch += -event.motion.yrel * CAMERA_SENSITIVITY;
             }
             if (event.type == SDL_MOUSEBUTTONDOWN)
             {
                 if (event.button.button == SDL_BUTTON_LEFT)
-                    shoot_requested = true;
+                    input.shoot = true;
                 else if (event.button.button == SDL_BUTTON_RIGHT)
-                    select_requested = true;
+                    input.select = true;
             }
         }
+        profile_end(&events_scope);
 
         // --- Resolution change detection ---
-        if (g_render_width != tracked_rw || g_render_height != tracked_rh)
+        // (also reallocates when workers move between NUMA nodes, so the
+        // buffers get first-touched again from the right ones)
+        if (g_render_width != tracked_rw || g_render_height != tracked_rh ||
+            threadpool_get_placement() != tracked_placement)
         {
             tracked_rw = g_render_width;
             tracked_rh = g_render_height;
+            tracked_placement = threadpool_get_placement();
 
+            render_finish_frames();
             free(framebuffer);
             free(zbuffer);
+            free(back_framebuffer);
+            free(back_zbuffer);
             framebuffer = malloc(tracked_rw * tracked_rh * sizeof(uint32_t));
             zbuffer = malloc(tracked_rw * tracked_rh * sizeof(float));
+            back_framebuffer = malloc(tracked_rw * tracked_rh * sizeof(uint32_t));
+            back_zbuffer = malloc(tracked_rw * tracked_rh * sizeof(float));
             render_set_framebuffer(framebuffer);
             render_set_zbuffer(zbuffer);
+            render_set_pipeline_buffers(back_framebuffer, back_zbuffer);
 
             SDL_DestroyTexture(texture);
             texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
@@ -505,154 +622,41 @@ int main(int argc, char *argv[])
             LOG_INFO("Render buffers resized: %dx%d", tracked_rw, tracked_rh);
         }
 
-        // --- Update (only while playing) ---
-        if (game_state == GAME_STATE_PLAYING)
+        // --- Update: hand input to the simulation, take its latest state ---
+        input.playing = game_state == GAME_STATE_PLAYING;
+        input.debug_rays = console.debug_rays;
+        input.proj = proj;
+        input.screen_w = RENDER_WIDTH;
+        input.screen_h = RENDER_HEIGHT;
+        sim_push_input(&sim, &input);
+
+        SimEvent sim_event;
+        while (sim_poll_event(&sim, &sim_event))
         {
-            float current_speed = camera.fly_mode ? camera.fly_speed : CAMERA_WALK_SPEED;
-            if (key_shift)
-                current_speed *= 2.0f;
-
-            float move_speed = current_speed * dt;
-            Vec3 move_delta = {0, 0, 0};
-            if (key_w)
-                move_delta = vec3_add(move_delta, vec3_mul(camera.direction, move_speed));
-            if (key_s)
-                move_delta = vec3_add(move_delta, vec3_mul(camera.direction, -move_speed));
-            if (key_a)
-                move_delta = vec3_sub(move_delta, vec3_mul(camera.right, move_speed));
-            if (key_d)
-                move_delta = vec3_add(move_delta, vec3_mul(camera.right, move_speed));
-
-            if (move_delta.x != 0 || move_delta.y != 0 || move_delta.z != 0)
-                camera_try_move(&camera, move_delta);
-
-            // Apply gravity and handle jumping
-            camera_apply_gravity(&camera, dt);
-            if (key_space)
-                camera_jump(&camera);
-
-            scene_update(&scene, dt);
-
-            // Projectile movement and collision
-            for (int i = 0; i < MAX_PROJECTILES; i++)
+            if (sim_event.type == SIM_EVENT_HIT)
+                console_log(&console, "Hit entity %d!", sim_event.entity);
+            else if (sim_event.type == SIM_EVENT_REPLAY_DONE)
             {
-                Projectile *p = &projectiles[i];
-                if (!p->active)
-                    continue;
-
-                p->lifetime -= dt;
-                if (p->lifetime <= 0)
-                {
-                    p->active = false;
-                    continue;
-                }
-
-                p->position = vec3_add(p->position,
-                                       vec3_mul(p->direction, PROJECTILE_SPEED * dt));
-
-                // Check collision against pickable entities
-                AABB pbox = aabb_from_center_size(p->position,
-                                                  (Vec3){PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE});
-
-                for (int j = 0; j < scene.count; j++)
-                {
-                    Entity *ent = &scene.entities[j];
-                    if (!ent->active || !ent->pickable)
-                        continue;
-
-                    AABB ent_box = entity_get_world_aabb(ent);
-                    if (aabb_overlap(pbox, ent_box))
-                    {
-                        p->active = false;
-                        ent->hit_timer = HIT_FLASH_DURATION;
-                        LOG_INFO("Projectile hit entity %d!", j);
-                        console_log(&console, "Hit entity %d!", j);
-                        break;
-                    }
-                }
+                const SimReplayResult *r = &sim.replay_result;
+                console_log(&console, "Replay: %d ticks, %u frames, %.2f s", r->ticks, r->frames, r->seconds);
+                console_log(&console, "  %.3f ms/frame, drift %g",
+                            r->frames > 0 ? r->seconds * 1e3 / r->frames : 0.0, r->max_drift);
             }
-
-            if (debug_ray_timer > 0)
-                debug_ray_timer -= dt;
+            else if (sim_event.entity >= 0)
+                console_log(&console, "Selected entity %d", sim_event.entity);
         }
 
+        SimSnapshot *snap = sim_acquire(&sim);
+        Camera *cam = &snap->camera;
+
         // --- Render (always) ---
-        Mat4 view = camera_get_view_matrix(&camera);
+        Mat4 view = camera_get_view_matrix(cam);
         Mat4 vp = mat4_mul(proj, view);
 
         // Extract frustum planes for culling
         Frustum frustum = frustum_extract(vp);
         RenderStats render_stats = {0};
 
-        // Screen-to-world ray from crosshair (center of screen)
-        Mat4 inv_proj = mat4_inverse(proj);
-        Mat4 inv_view = mat4_inverse(view);
-        Ray center_ray = ray_from_screen(
-            RENDER_WIDTH / 2, RENDER_HEIGHT / 2,
-            RENDER_WIDTH, RENDER_HEIGHT,
-            inv_proj, inv_view, camera.position);
-
-        // Hover detection and queued actions (only while playing)
-        if (game_state == GAME_STATE_PLAYING)
-        {
-            float t;
-            hovered_entity = scene_ray_pick(&scene, center_ray, &t);
-
-            if (shoot_requested)
-            {
-                // Find a free projectile slot
-                for (int i = 0; i < MAX_PROJECTILES; i++)
-                {
-                    if (!projectiles[i].active)
-                    {
-                        projectiles[i].position = vec3_add(camera.position,
-                                                           vec3_mul(center_ray.direction, 0.5f));
-                        projectiles[i].direction = center_ray.direction;
-                        projectiles[i].lifetime = PROJECTILE_LIFETIME;
-                        projectiles[i].active = true;
-                        LOG_INFO("Projectile fired");
-                        break;
-                    }
-                }
-
-                if (console.debug_rays)
-                {
-                    debug_ray_start = camera.position;
-                    debug_ray_end = vec3_add(camera.position,
-                                             vec3_mul(center_ray.direction, 50.0f));
-                    debug_ray_timer = 3.0f;
-                }
-                shoot_requested = false;
-            }
-
-            if (select_requested)
-            {
-                if (hovered_entity >= 0)
-                {
-                    selected_entity = hovered_entity;
-                    LOG_INFO("Selected entity %d", hovered_entity);
-                    console_log(&console, "Selected entity %d", hovered_entity);
-                }
-                else
-                {
-                    selected_entity = -1;
-                }
-
-                if (console.debug_rays)
-                {
-                    debug_ray_start = camera.position;
-                    debug_ray_end = vec3_add(camera.position,
-                                             vec3_mul(center_ray.direction, 50.0f));
-                    debug_ray_timer = 3.0f;
-                }
-                select_requested = false;
-            }
-        }
-        else
-        {
-            hovered_entity = -1;
-        }
-
         render_clear_gradient();
         render_clear_zbuffer();
 
@@ -664,100 +668,67 @@ int main(int argc, char *argv[])
         {
             render_stats.chunks_total = chunk_grid.count;
             if (console.wireframe)
-                chunk_grid_render_wireframe(&chunk_grid, vp, camera.position,
+                chunk_grid_render_wireframe(&chunk_grid, vp, cam->position,
                                             frustum_culling ? &frustum : NULL, console.backface_cull,
                                             &render_stats);
             else
-                chunk_grid_render(&chunk_grid, vp, camera.position, light_dir,
+                chunk_grid_render(&chunk_grid, vp, cam->position, light_dir,
                                   frustum_culling ? &frustum : NULL, console.backface_cull,
                                   &render_stats);
             render_stats.chunks_culled = render_stats.entities_culled;
             render_stats.entities_culled = 0;
         }
 
+        ProfileScope scene_scope = profile_begin(PROFILE_GEOMETRY);
         if (console.wireframe)
-            scene_render_wireframe(&scene, vp, camera.position,
+            scene_render_wireframe(&snap->scene, vp, cam->position,
                                    frustum_culling ? &frustum : NULL, console.backface_cull,
                                    &render_stats);
         else
-            scene_render(&scene, vp, camera.position, light_dir,
+            scene_render(&snap->scene, vp, cam->position, light_dir,
                          frustum_culling ? &frustum : NULL, console.backface_cull,
                          &render_stats);
+        profile_end(&scene_scope);
+
+        overlays_capture(&overlays[overlay_slot], vp, &snap->scene, snap->projectiles,
+                         snap->hovered_entity, snap->selected_entity,
+                         console.debug_rays && snap->ray, snap->ray_start, snap->ray_end);
 
         if (render_get_threaded() && threadpool_is_active())
         {
             render_flush_commands();
             if (console.debug_tiles)
-                render_draw_tile_debug();
-        }
-
-        if (debug_aabb)
-        {
-            for (int i = 0; i < camera.collider_count; i++)
             {
-                render_draw_aabb(camera.colliders[i], vp, COLOR_DEBUG_AABB);
-            }
-        }
-
-        if (hovered_entity >= 0)
-        {
-            AABB box = entity_get_world_aabb(&scene.entities[hovered_entity]);
-            render_draw_aabb(box, vp, COLOR_HOVER_AABB);
-        }
-
-        // Selection highlight (darker green, persistent until deselected)
-        if (selected_entity >= 0 && selected_entity < scene.count &&
-            selected_entity != hovered_entity)
-        {
-            AABB box = entity_get_world_aabb(&scene.entities[selected_entity]);
-            render_draw_aabb(box, vp, COLOR_SELECT_AABB);
-        }
-
-        for (int i = 0; i < scene.count; i++)
-        {
-            if (scene.entities[i].hit_timer > 0)
-            {
-                AABB box = entity_get_world_aabb(&scene.entities[i]);
-                render_draw_aabb(box, vp, COLOR_HIT_FLASH);
+                PROFILE_SCOPE(PROFILE_DEBUG);
+                render_draw_tile_debug();
+                hud_draw_tile_ranks(&hud_font);
             }
         }
-
-        for (int i = 0; i < MAX_PROJECTILES; i++)
+        render_collect_stats(&render_stats);
+        if (console.debug_overdraw)
         {
-            if (!projectiles[i].active)
-                continue;
-
-            AABB pbox = aabb_from_center_size(projectiles[i].position,
-                                              (Vec3){PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE});
-            render_draw_aabb(pbox, vp, COLOR_PROJECTILE);
-
-            // Draw a bright center dot for visibility at distance
-            Vec4 cc = mat4_mul_vec4(vp,
-                                    vec4_from_vec3(projectiles[i].position, 1.0f));
-            if (cc.w > 0.1f)
-            {
-                ProjectedVertex pv = render_project_vertex(cc);
-                int px = (int)pv.screen.x;
-                int py = (int)pv.screen.y;
-                for (int dy = -1; dy <= 1; dy++)
-                    for (int dx = -1; dx <= 1; dx++)
-                        render_set_pixel(px + dx, py + dy, 0xFFFF0000);
-            }
+            PROFILE_SCOPE(PROFILE_DEBUG);
+            render_draw_overdraw_debug();
         }
 
-        // Debug ray visualization
-        if (console.debug_rays && debug_ray_timer > 0)
-        {
-            render_draw_3d_line(debug_ray_start, debug_ray_end, vp, COLOR_DEBUG_RAY);
-        }
+        // From here on drawing goes to the frame being shown: with
+        // pipelining, the one recorded last iteration
+        ProfileScope debug_scope = profile_begin(PROFILE_DEBUG);
+        overlays_draw(&overlays[render_get_frame_lag() ? overlay_slot ^ 1 : overlay_slot],
+                      cam, debug_aabb);
+        overlay_slot ^= 1;
+        profile_end(&debug_scope);
 
         // --- HUD overlays ---
+        ProfileScope hud_scope = profile_begin(PROFILE_HUD);
         hud_draw_crosshair(0xFFFFFFFF);
         if (console.show_debug)
         {
             hud_draw_fps(&hud_font, dt);
-            hud_draw_cull_stats(&hud_font, &render_stats, scene.count);
+            hud_draw_cull_stats(&hud_font, &render_stats, snap->scene.count);
         }
+        if (console.show_profile)
+            hud_draw_profile(&hud_font);
 
         if (game_state == GAME_STATE_PAUSED)
         {
@@ -801,7 +772,7 @@ int main(int argc, char *argv[])
 
             if (old_threaded != threaded_enabled)
             {
-                render_set_threaded(threaded_enabled);
+                render_set_threaded(threaded_enabled ? RENDER_THREAD_TILES : RENDER_THREAD_OFF);
             }
 
             if (old_res_index != resolution_index)
@@ -835,16 +806,24 @@ int main(int argc, char *argv[])
         {
             console_draw(&console, &hud_font);
         }
+        profile_end(&hud_scope);
 
-        SDL_UpdateTexture(texture, NULL, framebuffer, RENDER_WIDTH * sizeof(uint32_t));
+        ProfileScope present_scope = profile_begin(PROFILE_PRESENT);
+        SDL_UpdateTexture(texture, NULL, render_get_framebuffer(), RENDER_WIDTH * sizeof(uint32_t));
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
+        profile_end(&present_scope);
+
+        profile_frame_end();
     }
 
     LOG_INFO("Shutting down...");
 
+    render_finish_frames();
+    sim_stop(&sim);
     threadpool_shutdown();
+    profile_shutdown();
     chunk_grid_free(&chunk_grid);
     grid_free(&collision_grid);
     obj_mesh_free(&loaded_map);
@@ -853,6 +832,8 @@ int main(int argc, char *argv[])
     texture_free(&floor_tex);
     free(framebuffer);
     free(zbuffer);
+    free(back_framebuffer);
+    free(back_zbuffer);
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -25,6 +25,8 @@ typedef struct
     Vec4 world;
     Vec4 clip;
     uint32_t gen;
+    int vertex; // Render vertex pushed this generation, -1 = none (chunks)
+    float u, v; // UV that vertex was pushed with
 } TransformCache;
 
 #define OBJ_MAX_MATERIALS 128
@@ -0,0 +1,296 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "core/profile.h"
+#include "core/log.h"
+#include "core/threads.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROFILE_RING_MASK (PROFILE_RING_SIZE - 1)
+#define PROFILE_PATH_MAX 256
+
+typedef struct
+{
+    uint64_t start, end;
+    int stage;
+} ProfileEvent;
+
+// Written only by its thread; the main thread reads behind head
+typedef struct
+{
+    ProfileEvent events[PROFILE_RING_SIZE];
+    _Atomic uint64_t head; // Events written so far
+    _Atomic uint64_t totals[PROFILE_STAGE_COUNT]; // ns since the last frame end
+    char name[32];
+} ProfileRing;
+
+static const char *s_stage_names[PROFILE_STAGE_COUNT] = {
+    "events", "sim", "cull", "geometry", "bin", "raster",
+    "composite", "wait", "debug", "hud", "present",
+};
+
+static atomic_bool g_enabled = false;
+static bool g_enabled_before_capture = false;
+
+static pthread_mutex_t g_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileRing **g_rings = NULL;
+static int g_ring_count = 0;
+static int g_ring_capacity = 0;
+static __thread ProfileRing *t_ring = NULL;
+static __thread char t_name[32];
+
+static float g_stage_ms[PROFILE_STAGE_COUNT];
+static bool g_stage_primed = false;
+
+// Pending capture: frames left, where it started and each frame's end
+static int g_capture_left = 0;
+static int g_capture_frames = 0;
+static uint64_t g_capture_start = 0;
+static uint64_t *g_capture_marks = NULL;
+static char g_capture_path[PROFILE_PATH_MAX];
+
+uint64_t profile_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void profile_set_enabled(bool enabled)
+{
+    atomic_store_explicit(&g_enabled, enabled, memory_order_relaxed);
+}
+
+bool profile_is_enabled(void)
+{
+    return atomic_load_explicit(&g_enabled, memory_order_relaxed);
+}
+
+void profile_set_thread_name(const char *name)
+{
+    snprintf(t_name, sizeof(t_name), "%s", name);
+    if (t_ring)
+        snprintf(t_ring->name, sizeof(t_ring->name), "%s", name);
+}
+
+static ProfileRing *profile_ring(void)
+{
+    if (t_ring)
+        return t_ring;
+
+    ProfileRing *ring = calloc(1, sizeof(ProfileRing));
+    if (!ring)
+        return NULL;
+
+    pthread_mutex_lock(&g_ring_lock);
+    if (g_ring_count == g_ring_capacity)
+    {
+        int cap = g_ring_capacity ? g_ring_capacity * 2 : 16;
+        ProfileRing **rings = realloc(g_rings, (size_t)cap * sizeof(ProfileRing *));
+        if (!rings)
+        {
+            pthread_mutex_unlock(&g_ring_lock);
+            free(ring);
+            return NULL;
+        }
+        g_rings = rings;
+        g_ring_capacity = cap;
+    }
+    g_rings[g_ring_count++] = ring;
+
+    int worker = threadpool_get_worker_id();
+    if (t_name[0])
+        snprintf(ring->name, sizeof(ring->name), "%s", t_name);
+    else if (worker >= 0)
+        snprintf(ring->name, sizeof(ring->name), "worker %d", worker);
+    else
+        snprintf(ring->name, sizeof(ring->name), "thread %d", g_ring_count - 1);
+    pthread_mutex_unlock(&g_ring_lock);
+
+    t_ring = ring;
+    return ring;
+}
+
+void profile_record(ProfileStage stage, uint64_t start_ns, uint64_t end_ns)
+{
+    ProfileRing *ring = profile_ring();
+    if (!ring)
+        return;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->events[head & PROFILE_RING_MASK] = (ProfileEvent){start_ns, end_ns, (int)stage};
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->totals[stage], end_ns - start_ns, memory_order_relaxed);
+}
+
+float profile_get_stage_ms(ProfileStage stage)
+{
+    return g_stage_ms[stage];
+}
+
+const char *profile_get_stage_name(ProfileStage stage)
+{
+    return s_stage_names[stage];
+}
+
+// Copy the events of one ring that lie inside the capture. The thread keeps
+// recording meanwhile: anything it may have overwritten during the copy is
+// dropped.
+static int profile_copy_events(ProfileRing *ring, uint64_t from, uint64_t to,
+                               ProfileEvent *out, bool *lost)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+    int count = 0;
+    for (uint64_t i = first; i < head; i++)
+        out[count++] = ring->events[i & PROFILE_RING_MASK];
+
+    uint64_t after = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t valid = after > PROFILE_RING_SIZE ? after - PROFILE_RING_SIZE : 0;
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (first + (uint64_t)i < valid)
+            continue;
+        if (out[i].start >= from && out[i].end <= to)
+            out[kept++] = out[i];
+    }
+
+    // The oldest event left is past the start: the ring wrapped
+    if (count > 0 && head > PROFILE_RING_SIZE && out[0].start > from)
+        *lost = true;
+    return kept;
+}
+
+static void profile_write_capture(uint64_t end)
+{
+    FILE *f = fopen(g_capture_path, "w");
+    if (!f)
+    {
+        LOG_ERROR("Profile: cannot write %s", g_capture_path);
+        return;
+    }
+
+    ProfileEvent *events = malloc(PROFILE_RING_SIZE * sizeof(ProfileEvent));
+    if (!events)
+    {
+        LOG_ERROR("Profile: out of memory");
+        fclose(f);
+        return;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    bool lost = false;
+    long total = 0;
+
+    pthread_mutex_lock(&g_ring_lock);
+    for (int r = 0; r < g_ring_count; r++)
+    {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", r, g_rings[r]->name);
+        first = false;
+
+        int count = profile_copy_events(g_rings[r], g_capture_start, end, events, &lost);
+        for (int i = 0; i < count; i++)
+        {
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f}",
+                    s_stage_names[events[i].stage], r,
+                    (double)(events[i].start - g_capture_start) / 1000.0,
+                    (double)(events[i].end - events[i].start) / 1000.0);
+        }
+        total += count;
+    }
+    pthread_mutex_unlock(&g_ring_lock);
+
+    // Frame boundaries, as instant events on the main thread's track
+    for (int i = 0; i < g_capture_frames; i++)
+    {
+        fprintf(f, ",\n{\"name\":\"frame %d\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+                i, (double)(g_capture_marks[i] - g_capture_start) / 1000.0);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    free(events);
+
+    LOG_INFO("Profile: %d frames, %ld events written to %s", g_capture_frames, total, g_capture_path);
+    if (lost)
+        LOG_WARN("Profile: a thread recorded more than %d events, its oldest are missing",
+                 PROFILE_RING_SIZE);
+}
+
+void profile_frame_end(void)
+{
+    if (!profile_is_enabled())
+        return;
+
+    uint64_t frame_ns[PROFILE_STAGE_COUNT] = {0};
+    pthread_mutex_lock(&g_ring_lock);
+    for (int r = 0; r < g_ring_count; r++)
+    {
+        for (int s = 0; s < PROFILE_STAGE_COUNT; s++)
+            frame_ns[s] += atomic_exchange_explicit(&g_rings[r]->totals[s], 0, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&g_ring_lock);
+
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++)
+    {
+        float ms = (float)frame_ns[s] / 1e6f;
+        g_stage_ms[s] = g_stage_primed ? g_stage_ms[s] * 0.9f + ms * 0.1f : ms;
+    }
+    g_stage_primed = true;
+
+    if (g_capture_left > 0)
+    {
+        uint64_t now = profile_now();
+        g_capture_marks[g_capture_frames - g_capture_left] = now;
+        if (--g_capture_left == 0)
+        {
+            profile_write_capture(now);
+            free(g_capture_marks);
+            g_capture_marks = NULL;
+            profile_set_enabled(g_enabled_before_capture);
+        }
+    }
+}
+
+bool profile_capture(int frames, const char *path)
+{
+    if (g_capture_left > 0 || frames <= 0)
+        return false;
+
+    g_capture_marks = malloc((size_t)frames * sizeof(uint64_t));
+    if (!g_capture_marks)
+        return false;
+
+    snprintf(g_capture_path, sizeof(g_capture_path), "%s", path);
+    g_capture_frames = frames;
+    g_capture_left = frames;
+    g_enabled_before_capture = profile_is_enabled();
+    profile_set_enabled(true);
+    g_capture_start = profile_now();
+    LOG_INFO("Profile: capturing %d frames to %s", frames, path);
+    return true;
+}
+
+void profile_shutdown(void)
+{
+    pthread_mutex_lock(&g_ring_lock);
+    for (int r = 0; r < g_ring_count; r++)
+        free(g_rings[r]);
+    free(g_rings);
+    g_rings = NULL;
+    g_ring_count = 0;
+    g_ring_capacity = 0;
+    pthread_mutex_unlock(&g_ring_lock);
+    free(g_capture_marks);
+    g_capture_marks = NULL;
+    g_capture_left = 0;
+    t_ring = NULL;
+}
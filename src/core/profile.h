@@ -0,0 +1,77 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stage profiler. Scoped timers write (stage, start, end) events with
+// nanosecond timestamps into a ring buffer owned by the calling thread.
+// Per-stage totals feed the HUD every frame; `profile <frames>` copies the
+// events of a run of frames out as a Chrome trace (chrome://tracing or
+// Perfetto).
+typedef enum
+{
+    PROFILE_EVENTS,    // SDL event poll
+    PROFILE_SIM,       // Simulation tick
+    PROFILE_CULL,      // Chunk frustum culling and sorting
+    PROFILE_GEOMETRY,  // Transform, clip and record (per job when threaded)
+    PROFILE_BIN,       // Tile binning
+    PROFILE_RASTER,    // Tile or sort-last share raster, per worker
+    PROFILE_COMPOSITE, // Sort-last depth composite
+    PROFILE_WAIT,      // Waiting for a frame's raster jobs
+    PROFILE_DEBUG,     // Debug overlays
+    PROFILE_HUD,       // HUD, menu and console
+    PROFILE_PRESENT,   // SDL_UpdateTexture and present
+    PROFILE_STAGE_COUNT
+} ProfileStage;
+
+// Events kept per thread; a capture longer than this loses its oldest
+#define PROFILE_RING_SIZE 65536
+
+void profile_set_enabled(bool enabled);
+bool profile_is_enabled(void);
+// Name the calling thread in traces (pool workers name themselves)
+void profile_set_thread_name(const char *name);
+
+uint64_t profile_now(void);
+void profile_record(ProfileStage stage, uint64_t start_ns, uint64_t end_ns);
+
+typedef struct
+{
+    ProfileStage stage;
+    uint64_t start; // 0 while the profiler is off
+} ProfileScope;
+
+static inline ProfileScope profile_begin(ProfileStage stage)
+{
+    return (ProfileScope){stage, profile_is_enabled() ? profile_now() : 0};
+}
+
+static inline void profile_end(ProfileScope *scope)
+{
+    if (scope->start)
+        profile_record(scope->stage, scope->start, profile_now());
+}
+
+// Times the rest of the enclosing block
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage)                                     \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)        \
+        __attribute__((cleanup(profile_end))) = profile_begin(stage)
+
+// Call once per frame on the main thread: folds this frame's totals into
+// the smoothed stage times, and writes a pending capture once its last
+// frame is done
+void profile_frame_end(void);
+// Smoothed milliseconds per frame spent in a stage, summed over threads
+float profile_get_stage_ms(ProfileStage stage);
+const char *profile_get_stage_name(ProfileStage stage);
+
+// Record the next `frames` frames and write them to path as trace JSON.
+// Turns the profiler on for the capture. Returns false if one is running.
+bool profile_capture(int frames, const char *path);
+// Free every thread's ring; only once no other thread records any more
+void profile_shutdown(void);
+
+#endif
@@ -0,0 +1,100 @@
+#include "core/replay.h"
+#include "core/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frame_size;
+    int32_t frame_count;
+} ReplayHeader;
+
+void replay_init(Replay *replay)
+{
+    memset(replay, 0, sizeof(*replay));
+}
+
+void replay_free(Replay *replay)
+{
+    free(replay->frames);
+    replay_init(replay);
+}
+
+bool replay_append(Replay *replay, const ReplayFrame *frame)
+{
+    if (replay->frame_count >= replay->frame_capacity)
+    {
+        int new_cap = replay->frame_capacity == 0 ? 1024 : replay->frame_capacity * 2;
+        ReplayFrame *new_frames = realloc(replay->frames, new_cap * sizeof(ReplayFrame));
+        if (!new_frames)
+            return false;
+        replay->frames = new_frames;
+        replay->frame_capacity = new_cap;
+    }
+    replay->frames[replay->frame_count++] = *frame;
+    return true;
+}
+
+bool replay_save(const Replay *replay, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        LOG_ERROR("Cannot write replay: %s", path);
+        return false;
+    }
+
+    ReplayHeader header = {REPLAY_MAGIC, REPLAY_VERSION, sizeof(ReplayFrame), replay->frame_count};
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(&replay->start, sizeof(replay->start), 1, fp) == 1 &&
+              fwrite(replay->frames, sizeof(ReplayFrame), replay->frame_count, fp) ==
+                  (size_t)replay->frame_count;
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (ok)
+        LOG_INFO("Replay saved: %s (%d ticks at %d Hz)", path, replay->frame_count, replay->start.hz);
+    else
+        LOG_ERROR("Failed writing replay: %s", path);
+    return ok;
+}
+
+bool replay_load(Replay *replay, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        LOG_ERROR("Cannot open replay: %s", path);
+        return false;
+    }
+
+    replay_free(replay);
+    ReplayHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+              header.magic == REPLAY_MAGIC && header.version == REPLAY_VERSION &&
+              header.frame_size == sizeof(ReplayFrame) && header.frame_count > 0 &&
+              fread(&replay->start, sizeof(replay->start), 1, fp) == 1;
+    if (ok)
+    {
+        replay->frames = malloc(header.frame_count * sizeof(ReplayFrame));
+        ok = replay->frames &&
+             fread(replay->frames, sizeof(ReplayFrame), header.frame_count, fp) ==
+                 (size_t)header.frame_count;
+        replay->frame_count = replay->frame_capacity = ok ? header.frame_count : 0;
+    }
+    fclose(fp);
+
+    if (!ok)
+    {
+        LOG_ERROR("Not a valid replay: %s", path);
+        replay_free(replay);
+        return false;
+    }
+    replay->start.map_path[REPLAY_PATH_MAX - 1] = '\0';
+    LOG_INFO("Replay loaded: %s (%d ticks at %d Hz)", path, replay->frame_count, replay->start.hz);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "math/math.h"
+#include "core/entity.h"
+
+#define REPLAY_MAGIC 0x504C5052u // "RPLP"
+#define REPLAY_VERSION 1
+#define REPLAY_PATH_MAX 256
+
+// ReplayFrame.buttons
+#define REPLAY_FORWARD (1u << 0)
+#define REPLAY_BACK (1u << 1)
+#define REPLAY_LEFT (1u << 2)
+#define REPLAY_RIGHT (1u << 3)
+#define REPLAY_JUMP (1u << 4)
+#define REPLAY_SPRINT (1u << 5)
+#define REPLAY_SHOOT (1u << 6)
+#define REPLAY_SELECT (1u << 7)
+#define REPLAY_PLAYING (1u << 8)
+#define REPLAY_DEBUG_RAYS (1u << 9)
+
+// The input one simulation tick consumed, and the camera it ended with
+// (replays compare against it to report drift)
+typedef struct
+{
+    uint32_t buttons;
+    float look_yaw, look_pitch;
+    int32_t screen_w, screen_h;
+    Mat4 proj;
+    Vec3 camera_position;
+    float camera_yaw, camera_pitch;
+} ReplayFrame;
+
+typedef struct
+{
+    Vec3 position;
+    Vec3 rotation;
+    float hit_timer;
+    uint32_t active;
+} ReplayEntity;
+
+// World state when recording started; a replay puts it back first
+typedef struct
+{
+    int32_t hz;
+    char map_path[REPLAY_PATH_MAX]; // Level mesh loaded while recording, "" for none
+    Vec3 camera_position;
+    float camera_yaw, camera_pitch;
+    float camera_velocity_y, camera_fly_speed;
+    uint32_t camera_grounded, camera_fly_mode;
+    int32_t selected_entity;
+    int32_t entity_count;
+    ReplayEntity entities[MAX_ENTITIES];
+    Projectile projectiles[MAX_PROJECTILES];
+} ReplayStart;
+
+typedef struct
+{
+    ReplayStart start;
+    ReplayFrame *frames;
+    int frame_count;
+    int frame_capacity;
+} Replay;
+
+void replay_init(Replay *replay);
+void replay_free(Replay *replay);
+bool replay_append(Replay *replay, const ReplayFrame *frame);
+
+// Native binary layout: captures are meant to be replayed by builds for
+// the same platform, not exchanged across architectures
+bool replay_save(const Replay *replay, const char *path);
+bool replay_load(Replay *replay, const char *path);
+
+#endif
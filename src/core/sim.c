@@ -0,0 +1,567 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, clock_nanosleep
+#include "core/sim.h"
+#include "core/log.h"
+#include "core/profile.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// latest carries this bit while its slot has not been read yet
+#define SIM_SNAPSHOT_FRESH 4
+
+static double sim_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void sim_post_event(SimThread *sim, SimEventType type, int entity)
+{
+    unsigned head = atomic_load_explicit(&sim->event_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&sim->event_tail, memory_order_acquire);
+    if (head - tail >= SIM_EVENT_QUEUE)
+        return; // Main thread stalled; the log line is not worth blocking for
+
+    sim->events[head % SIM_EVENT_QUEUE] = (SimEvent){.type = type, .entity = entity};
+    atomic_store_explicit(&sim->event_head, head + 1, memory_order_release);
+}
+
+bool sim_poll_event(SimThread *sim, SimEvent *out)
+{
+    unsigned tail = atomic_load_explicit(&sim->event_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&sim->event_head, memory_order_acquire);
+    if (tail == head)
+        return false;
+
+    *out = sim->events[tail % SIM_EVENT_QUEUE];
+    atomic_store_explicit(&sim->event_tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Copy the state into the writer's slot and make it the latest; the slot
+// it replaces (unread, or handed back by the reader) is written next
+static void sim_publish(SimThread *sim)
+{
+    SimSnapshot *snap = &sim->snapshots[sim->write_slot];
+    snap->scene = sim->scene;
+    snap->camera = sim->camera;
+    memcpy(snap->projectiles, sim->projectiles, sizeof(snap->projectiles));
+    snap->hovered_entity = sim->hovered_entity;
+    snap->selected_entity = sim->selected_entity;
+    snap->ray = sim->ray_timer > 0;
+    snap->ray_start = sim->ray_start;
+    snap->ray_end = sim->ray_end;
+    snap->tick = sim->tick;
+
+    int old = atomic_exchange_explicit(&sim->latest, sim->write_slot | SIM_SNAPSHOT_FRESH,
+                                       memory_order_acq_rel);
+    sim->write_slot = old & ~SIM_SNAPSHOT_FRESH;
+}
+
+// One fixed step: the frame update main.c used to run, at a constant dt
+static void sim_step(SimThread *sim, SimInput in, float dt)
+{
+    Camera *camera = &sim->camera;
+    Scene *scene = &sim->scene;
+    sim->tick++;
+
+    if (!in.playing)
+    {
+        sim->hovered_entity = -1;
+        return;
+    }
+
+    if (in.look_yaw != 0 || in.look_pitch != 0)
+        camera_rotate(camera, in.look_yaw, in.look_pitch);
+
+    float current_speed = camera->fly_mode ? camera->fly_speed : CAMERA_WALK_SPEED;
+    if (in.sprint)
+        current_speed *= 2.0f;
+
+    float move_speed = current_speed * dt;
+    Vec3 move_delta = {0, 0, 0};
+    if (in.forward)
+        move_delta = vec3_add(move_delta, vec3_mul(camera->direction, move_speed));
+    if (in.back)
+        move_delta = vec3_add(move_delta, vec3_mul(camera->direction, -move_speed));
+    if (in.left)
+        move_delta = vec3_sub(move_delta, vec3_mul(camera->right, move_speed));
+    if (in.right)
+        move_delta = vec3_add(move_delta, vec3_mul(camera->right, move_speed));
+
+    if (move_delta.x != 0 || move_delta.y != 0 || move_delta.z != 0)
+        camera_try_move(camera, move_delta);
+
+    // Apply gravity and handle jumping
+    camera_apply_gravity(camera, dt);
+    if (in.jump)
+        camera_jump(camera);
+
+    scene_update(scene, dt);
+
+    // Projectile movement and collision
+    for (int i = 0; i < MAX_PROJECTILES; i++)
+    {
+        Projectile *p = &sim->projectiles[i];
+        if (!p->active)
+            continue;
+
+        p->lifetime -= dt;
+        if (p->lifetime <= 0)
+        {
+            p->active = false;
+            continue;
+        }
+
+        p->position = vec3_add(p->position,
+                               vec3_mul(p->direction, PROJECTILE_SPEED * dt));
+
+        // Check collision against pickable entities
+        AABB pbox = aabb_from_center_size(p->position,
+                                          (Vec3){PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE, PROJECTILE_HALF_SIZE});
+
+        for (int j = 0; j < scene->count; j++)
+        {
+            Entity *ent = &scene->entities[j];
+            if (!ent->active || !ent->pickable)
+                continue;
+
+            AABB ent_box = entity_get_world_aabb(ent);
+            if (aabb_overlap(pbox, ent_box))
+            {
+                p->active = false;
+                ent->hit_timer = HIT_FLASH_DURATION;
+                LOG_INFO("Projectile hit entity %d!", j);
+                sim_post_event(sim, SIM_EVENT_HIT, j);
+                break;
+            }
+        }
+    }
+
+    if (sim->ray_timer > 0)
+        sim->ray_timer -= dt;
+
+    // Screen-to-world ray from crosshair (center of screen)
+    Mat4 view = camera_get_view_matrix(camera);
+    Ray center_ray = ray_from_screen(in.screen_w / 2, in.screen_h / 2,
+                                     in.screen_w, in.screen_h,
+                                     mat4_inverse(in.proj), mat4_inverse(view),
+                                     camera->position);
+
+    float t;
+    sim->hovered_entity = scene_ray_pick(scene, center_ray, &t);
+
+    if (in.shoot)
+    {
+        // Find a free projectile slot
+        for (int i = 0; i < MAX_PROJECTILES; i++)
+        {
+            if (!sim->projectiles[i].active)
+            {
+                sim->projectiles[i].position = vec3_add(camera->position,
+                                                        vec3_mul(center_ray.direction, 0.5f));
+                sim->projectiles[i].direction = center_ray.direction;
+                sim->projectiles[i].lifetime = PROJECTILE_LIFETIME;
+                sim->projectiles[i].active = true;
+                LOG_INFO("Projectile fired");
+                break;
+            }
+        }
+    }
+
+    if (in.select)
+    {
+        sim->selected_entity = sim->hovered_entity;
+        if (sim->hovered_entity >= 0)
+            LOG_INFO("Selected entity %d", sim->hovered_entity);
+        sim_post_event(sim, SIM_EVENT_SELECT, sim->hovered_entity);
+    }
+
+    if ((in.shoot || in.select) && in.debug_rays)
+    {
+        sim->ray_start = camera->position;
+        sim->ray_end = vec3_add(camera->position, vec3_mul(center_ray.direction, 50.0f));
+        sim->ray_timer = 3.0f;
+    }
+}
+
+static uint32_t replay_pack_buttons(const SimInput *in)
+{
+    return (in->forward ? REPLAY_FORWARD : 0) | (in->back ? REPLAY_BACK : 0) |
+           (in->left ? REPLAY_LEFT : 0) | (in->right ? REPLAY_RIGHT : 0) |
+           (in->jump ? REPLAY_JUMP : 0) | (in->sprint ? REPLAY_SPRINT : 0) |
+           (in->shoot ? REPLAY_SHOOT : 0) | (in->select ? REPLAY_SELECT : 0) |
+           (in->playing ? REPLAY_PLAYING : 0) | (in->debug_rays ? REPLAY_DEBUG_RAYS : 0);
+}
+
+static SimInput replay_frame_input(const ReplayFrame *frame)
+{
+    SimInput in = {0};
+    in.forward = frame->buttons & REPLAY_FORWARD;
+    in.back = frame->buttons & REPLAY_BACK;
+    in.left = frame->buttons & REPLAY_LEFT;
+    in.right = frame->buttons & REPLAY_RIGHT;
+    in.jump = frame->buttons & REPLAY_JUMP;
+    in.sprint = frame->buttons & REPLAY_SPRINT;
+    in.shoot = frame->buttons & REPLAY_SHOOT;
+    in.select = frame->buttons & REPLAY_SELECT;
+    in.playing = frame->buttons & REPLAY_PLAYING;
+    in.debug_rays = frame->buttons & REPLAY_DEBUG_RAYS;
+    in.look_yaw = frame->look_yaw;
+    in.look_pitch = frame->look_pitch;
+    in.screen_w = frame->screen_w;
+    in.screen_h = frame->screen_h;
+    in.proj = frame->proj;
+    return in;
+}
+
+static void sim_replay_finish(SimThread *sim)
+{
+    SimReplayResult *r = &sim->replay_result;
+    r->ticks = sim->replay_pos;
+    r->frames = atomic_load_explicit(&sim->acquire_count, memory_order_relaxed) -
+                sim->replay_start_frames;
+    r->seconds = sim_now() - sim->replay_start_time;
+    LOG_INFO("Replay done: %d ticks, %u frames in %.3f s (%.3f ms/frame), max drift %g",
+             r->ticks, r->frames, r->seconds,
+             r->frames > 0 ? r->seconds * 1e3 / r->frames : 0.0, r->max_drift);
+
+    atomic_store_explicit(&sim->hz, sim->replay_saved_hz, memory_order_relaxed);
+    atomic_store_explicit(&sim->lockstep, false, memory_order_relaxed);
+    sim->replay_mode = SIM_REPLAY_OFF;
+    replay_free(&sim->replay);
+    sim_post_event(sim, SIM_EVENT_REPLAY_DONE, -1);
+}
+
+// Takes the live input (or the recorded one when replaying), steps, and
+// records what the tick consumed
+static void sim_tick(SimThread *sim, float dt)
+{
+    PROFILE_SCOPE(PROFILE_SIM);
+    pthread_mutex_lock(&sim->input_lock);
+    SimInput in = sim->input;
+    sim->input.look_yaw = 0;
+    sim->input.look_pitch = 0;
+    sim->input.shoot = false;
+    sim->input.select = false;
+    pthread_mutex_unlock(&sim->input_lock);
+
+    bool replaying = sim->replay_mode == SIM_REPLAY_REALTIME || sim->replay_mode == SIM_REPLAY_FAST;
+    if (replaying)
+        in = replay_frame_input(&sim->replay.frames[sim->replay_pos]);
+
+    sim_step(sim, in, dt);
+
+    if (sim->replay_mode == SIM_REPLAY_RECORDING)
+    {
+        ReplayFrame frame = {
+            .buttons = replay_pack_buttons(&in),
+            .look_yaw = in.look_yaw,
+            .look_pitch = in.look_pitch,
+            .screen_w = in.screen_w,
+            .screen_h = in.screen_h,
+            .proj = in.proj,
+            .camera_position = sim->camera.position,
+            .camera_yaw = sim->camera.yaw,
+            .camera_pitch = sim->camera.pitch,
+        };
+        if (!replay_append(&sim->replay, &frame))
+        {
+            LOG_ERROR("Out of memory recording, saving what was captured");
+            sim_record_stop(sim);
+        }
+    }
+    else if (replaying)
+    {
+        const ReplayFrame *frame = &sim->replay.frames[sim->replay_pos];
+        float drift = vec3_length(vec3_sub(sim->camera.position, frame->camera_position));
+        drift = fmaxf(drift, fabsf(sim->camera.yaw - frame->camera_yaw));
+        drift = fmaxf(drift, fabsf(sim->camera.pitch - frame->camera_pitch));
+        if (drift > sim->replay_result.max_drift)
+            sim->replay_result.max_drift = drift;
+
+        if (++sim->replay_pos >= sim->replay.frame_count)
+            sim_replay_finish(sim);
+    }
+}
+
+// Run the ticks that are due and publish the result
+static void sim_run_due(SimThread *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    double step = 1.0 / atomic_load_explicit(&sim->hz, memory_order_relaxed);
+    double now = sim_now();
+    if (atomic_load_explicit(&sim->lockstep, memory_order_relaxed))
+    {
+        // sim_acquire drives the ticks
+        sim->next_tick = now + step;
+        pthread_mutex_unlock(&sim->lock);
+        return;
+    }
+    int ticks = 0;
+    while (sim->next_tick <= now && ticks < SIM_MAX_CATCHUP)
+    {
+        sim_tick(sim, (float)step);
+        sim->next_tick += step;
+        ticks++;
+    }
+    if (sim->next_tick <= now)
+        sim->next_tick = now + step; // Too far behind, drop the backlog
+    if (ticks > 0)
+        sim_publish(sim);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+SimSnapshot *sim_acquire(SimThread *sim)
+{
+    atomic_fetch_add_explicit(&sim->acquire_count, 1, memory_order_relaxed);
+    if (atomic_load_explicit(&sim->lockstep, memory_order_relaxed))
+    {
+        // Fast replay: exactly one tick per frame, whatever the clock says
+        pthread_mutex_lock(&sim->lock);
+        if (atomic_load_explicit(&sim->lockstep, memory_order_relaxed))
+        {
+            sim_tick(sim, 1.0f / atomic_load_explicit(&sim->hz, memory_order_relaxed));
+            sim_publish(sim);
+        }
+        pthread_mutex_unlock(&sim->lock);
+    }
+    else if (!sim->threaded)
+    {
+        // No thread: run whatever ticks are due on the caller
+        sim_run_due(sim);
+    }
+
+    if (atomic_load_explicit(&sim->latest, memory_order_relaxed) & SIM_SNAPSHOT_FRESH)
+    {
+        int old = atomic_exchange_explicit(&sim->latest, sim->read_slot, memory_order_acq_rel);
+        sim->read_slot = old & ~SIM_SNAPSHOT_FRESH;
+    }
+    return &sim->snapshots[sim->read_slot];
+}
+
+static void *sim_thread_func(void *arg)
+{
+    SimThread *sim = arg;
+    profile_set_thread_name("sim");
+    while (atomic_load_explicit(&sim->running, memory_order_acquire))
+    {
+        sim_run_due(sim);
+
+        // Only this thread moves next_tick
+        struct timespec wake;
+        wake.tv_sec = (time_t)sim->next_tick;
+        wake.tv_nsec = (long)((sim->next_tick - (double)wake.tv_sec) * 1e9);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+    return NULL;
+}
+
+void sim_start(SimThread *sim, const Scene *scene, const Camera *camera)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->scene = *scene;
+    sim->camera = *camera;
+    sim->hovered_entity = -1;
+    sim->selected_entity = -1;
+    atomic_init(&sim->hz, SIM_DEFAULT_HZ);
+    atomic_init(&sim->event_head, 0);
+    atomic_init(&sim->event_tail, 0);
+    atomic_init(&sim->lockstep, false);
+    atomic_init(&sim->acquire_count, 0);
+    pthread_mutex_init(&sim->lock, NULL);
+    pthread_mutex_init(&sim->input_lock, NULL);
+
+    sim->write_slot = 0;
+    sim->read_slot = 1;
+    atomic_init(&sim->latest, 2);
+    sim_publish(sim);
+
+    sim->next_tick = sim_now();
+    atomic_init(&sim->running, true);
+    sim->threaded = pthread_create(&sim->thread, NULL, sim_thread_func, sim) == 0;
+    if (sim->threaded)
+        LOG_INFO("Simulation thread started (%d Hz)", SIM_DEFAULT_HZ);
+    else
+        LOG_WARN("Failed to start the simulation thread, ticking on the main thread");
+}
+
+void sim_stop(SimThread *sim)
+{
+    atomic_store_explicit(&sim->running, false, memory_order_release);
+    if (sim->threaded)
+        pthread_join(sim->thread, NULL);
+    sim->threaded = false;
+    replay_free(&sim->replay);
+    pthread_mutex_destroy(&sim->lock);
+    pthread_mutex_destroy(&sim->input_lock);
+}
+
+void sim_lock(SimThread *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+}
+
+void sim_unlock(SimThread *sim)
+{
+    sim_publish(sim);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+void sim_push_input(SimThread *sim, SimInput *input)
+{
+    pthread_mutex_lock(&sim->input_lock);
+    float yaw = sim->input.look_yaw + input->look_yaw;
+    float pitch = sim->input.look_pitch + input->look_pitch;
+    bool shoot = sim->input.shoot || input->shoot;
+    bool select = sim->input.select || input->select;
+    sim->input = *input;
+    sim->input.look_yaw = yaw;
+    sim->input.look_pitch = pitch;
+    sim->input.shoot = shoot;
+    sim->input.select = select;
+    pthread_mutex_unlock(&sim->input_lock);
+
+    input->look_yaw = 0;
+    input->look_pitch = 0;
+    input->shoot = false;
+    input->select = false;
+}
+
+bool sim_set_rate(SimThread *sim, int hz)
+{
+    // Replays step every tick at the recorded rate
+    if (sim->replay_mode != SIM_REPLAY_OFF)
+    {
+        LOG_WARN("Simulation rate is fixed while recording or replaying");
+        return false;
+    }
+    if (hz < SIM_MIN_HZ)
+        hz = SIM_MIN_HZ;
+    if (hz > SIM_MAX_HZ)
+        hz = SIM_MAX_HZ;
+    atomic_store_explicit(&sim->hz, hz, memory_order_relaxed);
+    LOG_INFO("Simulation rate: %d Hz", hz);
+    return true;
+}
+
+int sim_get_rate(const SimThread *sim)
+{
+    return atomic_load_explicit(&sim->hz, memory_order_relaxed);
+}
+
+bool sim_record_start(SimThread *sim, const char *path, const char *map_path)
+{
+    if (sim->replay_mode != SIM_REPLAY_OFF)
+        return false;
+
+    replay_free(&sim->replay);
+    ReplayStart *start = &sim->replay.start;
+    start->hz = atomic_load_explicit(&sim->hz, memory_order_relaxed);
+    snprintf(start->map_path, sizeof(start->map_path), "%s", map_path ? map_path : "");
+    start->camera_position = sim->camera.position;
+    start->camera_yaw = sim->camera.yaw;
+    start->camera_pitch = sim->camera.pitch;
+    start->camera_velocity_y = sim->camera.velocity_y;
+    start->camera_fly_speed = sim->camera.fly_speed;
+    start->camera_grounded = sim->camera.grounded;
+    start->camera_fly_mode = sim->camera.fly_mode;
+    start->selected_entity = sim->selected_entity;
+    start->entity_count = sim->scene.count;
+    for (int i = 0; i < sim->scene.count; i++)
+    {
+        const Entity *ent = &sim->scene.entities[i];
+        start->entities[i] = (ReplayEntity){ent->position, ent->rotation, ent->hit_timer, ent->active};
+    }
+    memcpy(start->projectiles, sim->projectiles, sizeof(start->projectiles));
+
+    // A replay starts without a debug ray on screen, so does the recording
+    sim->ray_timer = 0;
+    snprintf(sim->replay_path, sizeof(sim->replay_path), "%s", path);
+    sim->replay_mode = SIM_REPLAY_RECORDING;
+    LOG_INFO("Recording input to %s", path);
+    return true;
+}
+
+int sim_record_stop(SimThread *sim)
+{
+    if (sim->replay_mode != SIM_REPLAY_RECORDING)
+        return -1;
+
+    sim->replay_mode = SIM_REPLAY_OFF;
+    int ticks = sim->replay.frame_count;
+    bool saved = ticks > 0 && replay_save(&sim->replay, sim->replay_path);
+    replay_free(&sim->replay);
+    return saved ? ticks : -1;
+}
+
+bool sim_replay_start(SimThread *sim, const char *path, bool realtime, const char *map_path)
+{
+    if (sim->replay_mode != SIM_REPLAY_OFF || !replay_load(&sim->replay, path))
+        return false;
+
+    const ReplayStart *start = &sim->replay.start;
+    if (strcmp(start->map_path, map_path ? map_path : "") != 0 ||
+        start->entity_count != sim->scene.count ||
+        start->hz < SIM_MIN_HZ || start->hz > SIM_MAX_HZ)
+    {
+        LOG_ERROR("Replay %s was recorded on another scene (map '%s', %d entities)",
+                  path, start->map_path, start->entity_count);
+        replay_free(&sim->replay);
+        return false;
+    }
+
+    Camera *camera = &sim->camera;
+    camera->position = start->camera_position;
+    camera->yaw = start->camera_yaw;
+    camera->pitch = start->camera_pitch;
+    camera->velocity_y = start->camera_velocity_y;
+    camera->fly_speed = start->camera_fly_speed;
+    camera->grounded = start->camera_grounded;
+    camera->fly_mode = start->camera_fly_mode;
+    camera_update_vectors(camera);
+
+    for (int i = 0; i < start->entity_count; i++)
+    {
+        Entity *ent = &sim->scene.entities[i];
+        ent->position = start->entities[i].position;
+        ent->rotation = start->entities[i].rotation;
+        ent->hit_timer = start->entities[i].hit_timer;
+        ent->active = start->entities[i].active;
+    }
+    memcpy(sim->projectiles, start->projectiles, sizeof(sim->projectiles));
+    sim->selected_entity = start->selected_entity;
+    sim->hovered_entity = -1;
+    sim->ray_timer = 0;
+
+    // Live look and clicks gathered so far must not leak into the replay
+    SimInput discard = {0};
+    pthread_mutex_lock(&sim->input_lock);
+    sim->input = discard;
+    pthread_mutex_unlock(&sim->input_lock);
+
+    sim->replay_pos = 0;
+    sim->replay_result = (SimReplayResult){0};
+    sim->replay_saved_hz = atomic_load_explicit(&sim->hz, memory_order_relaxed);
+    sim->replay_start_time = sim_now();
+    sim->replay_start_frames = atomic_load_explicit(&sim->acquire_count, memory_order_relaxed);
+    sim->replay_mode = realtime ? SIM_REPLAY_REALTIME : SIM_REPLAY_FAST;
+    atomic_store_explicit(&sim->hz, start->hz, memory_order_relaxed);
+    atomic_store_explicit(&sim->lockstep, !realtime, memory_order_relaxed);
+    LOG_INFO("Replaying %s (%s)", path, realtime ? "real time" : "fast");
+    return true;
+}
+
+void sim_replay_stop(SimThread *sim)
+{
+    if (sim->replay_mode == SIM_REPLAY_REALTIME || sim->replay_mode == SIM_REPLAY_FAST)
+        sim_replay_finish(sim);
+}
+
+SimReplayMode sim_get_replay_mode(const SimThread *sim)
+{
+    return sim->replay_mode;
+}
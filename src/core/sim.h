@@ -0,0 +1,167 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "math/math.h"
+#include "core/camera.h"
+#include "core/entity.h"
+#include "core/replay.h"
+
+#define SIM_DEFAULT_HZ 120
+#define SIM_MIN_HZ 10
+#define SIM_MAX_HZ 1000
+// Ticks run back to back at most before the simulation gives up catching
+// up (after a stall) and drops the rest
+#define SIM_MAX_CATCHUP 8
+#define SIM_EVENT_QUEUE 64
+
+// Player input gathered by the main thread. Held keys and the view are
+// levels; look deltas add up and shoot/select requests stay set until the
+// next tick consumes them.
+typedef struct
+{
+    bool forward, back, left, right;
+    bool jump, sprint;
+    float look_yaw, look_pitch;
+    bool shoot, select;
+    bool playing;    // Paused or in the console: the world stands still
+    bool debug_rays; // Shots and selections leave a debug ray
+    Mat4 proj;       // For the crosshair pick ray
+    int screen_w, screen_h;
+} SimInput;
+
+// Everything the renderer needs from one tick. Published snapshots are
+// never written again until the reader has moved past them.
+typedef struct
+{
+    Scene scene;
+    Camera camera;
+    Projectile projectiles[MAX_PROJECTILES];
+    int hovered_entity;
+    int selected_entity;
+    bool ray;
+    Vec3 ray_start;
+    Vec3 ray_end;
+    unsigned tick;
+} SimSnapshot;
+
+typedef enum
+{
+    SIM_EVENT_HIT,
+    SIM_EVENT_SELECT,
+    SIM_EVENT_REPLAY_DONE // Results in SimThread.replay_result
+} SimEventType;
+
+typedef struct
+{
+    SimEventType type;
+    int entity; // -1 for a cleared selection
+} SimEvent;
+
+typedef enum
+{
+    SIM_REPLAY_OFF,
+    SIM_REPLAY_RECORDING,
+    SIM_REPLAY_REALTIME, // Ticks keep the recorded rate
+    SIM_REPLAY_FAST      // One tick per sim_acquire, as fast as frames render
+} SimReplayMode;
+
+typedef struct
+{
+    int ticks;
+    unsigned frames;  // sim_acquire calls while it ran
+    double seconds;
+    float max_drift;  // Largest camera distance from the recording
+} SimReplayResult;
+
+typedef struct SimThread
+{
+    // Authoritative state, owned by the simulation thread. Anyone else
+    // touches it only between sim_lock and sim_unlock.
+    Scene scene;
+    Camera camera;
+    Projectile projectiles[MAX_PROJECTILES];
+    int hovered_entity;
+    int selected_entity;
+    Vec3 ray_start;
+    Vec3 ray_end;
+    float ray_timer;
+    unsigned tick;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool threaded; // False if the thread could not start: ticks run in sim_acquire
+    atomic_bool running;
+    atomic_int hz;
+    double next_tick; // Seconds, monotonic clock
+
+    pthread_mutex_t input_lock;
+    SimInput input;
+
+    // Triple buffer: the writer fills snapshots[write_slot] and swaps it
+    // with latest; the reader swaps its read_slot back out whenever latest
+    // carries the fresh bit
+    SimSnapshot snapshots[3];
+    atomic_int latest;
+    int write_slot;
+    int read_slot;
+
+    // Single-producer, single-consumer, simulation to main thread
+    SimEvent events[SIM_EVENT_QUEUE];
+    atomic_uint event_head, event_tail;
+
+    // Recording or replaying (under lock). A replay feeds the recorded
+    // input to each tick in place of the live one.
+    SimReplayMode replay_mode;
+    Replay replay;
+    char replay_path[REPLAY_PATH_MAX]; // Where a recording is saved
+    int replay_pos;
+    int replay_saved_hz;
+    double replay_start_time;
+    unsigned replay_start_frames;
+    atomic_bool lockstep; // Fast replay: ticks run in sim_acquire
+    atomic_uint acquire_count;
+    SimReplayResult replay_result; // Valid after SIM_EVENT_REPLAY_DONE
+} SimThread;
+
+// Takes over a populated scene and camera (copied) and starts ticking.
+// The SimThread must stay at a fixed address until sim_stop.
+void sim_start(SimThread *sim, const Scene *scene, const Camera *camera);
+void sim_stop(SimThread *sim);
+
+// Hold the simulation between ticks to edit its scene and camera (console
+// commands). sim_unlock publishes the edited state right away.
+void sim_lock(SimThread *sim);
+void sim_unlock(SimThread *sim);
+
+// Merge input into what the next tick sees and reset the caller's deltas
+void sim_push_input(SimThread *sim, SimInput *input);
+// Newest published snapshot; it stays unchanged until the next call.
+// Only one thread may call it.
+SimSnapshot *sim_acquire(SimThread *sim);
+// Next event posted by the simulation, false when there is none
+bool sim_poll_event(SimThread *sim, SimEvent *out);
+
+// Refused (false) while recording or replaying. Call between sim_lock and
+// sim_unlock.
+bool sim_set_rate(SimThread *sim, int hz);
+int sim_get_rate(const SimThread *sim);
+
+// Record every tick's input from now on, starting from the current state.
+// map_path names the loaded level mesh so a replay can check it matches.
+// Call between sim_lock and sim_unlock.
+bool sim_record_start(SimThread *sim, const char *path, const char *map_path);
+// Save the recording; returns the tick count, -1 if nothing was saved
+int sim_record_stop(SimThread *sim);
+// Restore the recorded start state and feed the recorded input to the
+// ticks; realtime keeps the recorded tick rate, otherwise one tick runs per
+// frame. Call between sim_lock and sim_unlock.
+bool sim_replay_start(SimThread *sim, const char *path, bool realtime, const char *map_path);
+void sim_replay_stop(SimThread *sim);
+// Between sim_lock and sim_unlock as well
+SimReplayMode sim_get_replay_mode(const SimThread *sim);
+
+#endif
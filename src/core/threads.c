@@ -1,23 +1,116 @@
+#define _GNU_SOURCE // syscall(), CPU affinity
 #include "core/threads.h"
 #include "core/log.h"
 
 #include <pthread.h>
-#include <stdatomic.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Jobs per deque; a full deque runs the job inline instead
+#define JOB_DEQUE_SIZE 1024
+#define JOB_DEQUE_MASK (JOB_DEQUE_SIZE - 1)
+
+// Rounds an idle thread polls for work before blocking in the kernel,
+// roughly 20-50 us: long enough to bridge the gap between a frame's
+// dispatches, short enough not to burn a core between frames. Pools with
+// a worker per CPU or more skip the spin, it would only steal the CPU
+// from the thread doing the work.
+#define POOL_SPIN_ROUNDS 256
+#define POOL_SPIN_PAUSES 32
+
+// Highest NUMA node id looked for in sysfs
+#define TOPOLOGY_MAX_NODES 64
+
+typedef struct
+{
+    JobFunc func;
+    void *userdata;
+    int begin, end;
+    int grain;
+    JobCounter *counter;
+    int worker; // Only this worker may run it, -1 for any thread
+} Job;
+
+// The owner pushes and pops at the bottom; thieves take from the top, so
+// they get the oldest (and, for split ranges, largest) jobs. Both ends
+// only move under the lock; they are atomic so idle threads can peek.
+typedef struct
+{
+    pthread_mutex_t lock;
+    atomic_int top, bottom;
+    Job jobs[JOB_DEQUE_SIZE];
+} JobDeque;
+
+// A slot's tiles for one dispatch, tile_lists[base + head .. base + tail).
+// head and tail share one word so the owner (taking from the expensive
+// head) and thieves (taking from the cheap tail) can race with a CAS.
 typedef struct
 {
-    pthread_t threads[MAX_WORKER_THREADS];
+    _Atomic uint64_t range;
+    int base;
+} TileQueue;
+
+// Tile function of the dispatch in flight
+typedef struct
+{
+    TileFunc func;
+    void *userdata;
+} TileJobs;
+
+// Held until its dependency counter drains
+typedef struct
+{
+    Job job;
+    JobCounter *dependency; // NULL once it drained and the job can be queued
+} DeferredJob;
+
+typedef struct
+{
+    pthread_t *threads;
     int count;
+    int capacity; // Workers the per-slot arrays have room for
+
+    // deques[0 .. count - 1] belong to the workers, deques[count] is shared
+    // by every other thread. Separate allocations, so a resize never moves
+    // a lock.
+    JobDeque **deques;
+    atomic_int queued;   // Jobs sitting in deques
+    atomic_int sleepers; // Workers blocked on wake_seq
+    atomic_int wake_seq; // Futex word, bumped to wake sleepers
+    atomic_bool shutdown;
+    int spin_rounds;
 
-    pthread_mutex_t mutex;
-    pthread_cond_t start_cond;
-    pthread_cond_t done_cond;
+    // Resize handshake: workers stop at the top of their loop while
+    // parking is set, counting themselves in parked
+    atomic_int parking;
+    atomic_int parked;
 
-    atomic_int next_tile;
-    atomic_int tiles_done;
-    int total_tiles;
+    // CPUs we may run on grouped by NUMA node: node n owns
+    // cpus[node_first[n] .. node_first[n + 1])
+    int *cpus;
+    int node_first[TOPOLOGY_MAX_NODES + 1];
+    int node_count;
+#ifdef __linux__
+    cpu_set_t allowed;
+#endif
+    bool pinned;
+    int placement;  // Bumped when workers change nodes
+    int *slot_node; // Node of each slot, -1 for the shared one
+
+    pthread_mutex_t defer_lock;
+    DeferredJob *deferred;
+    int deferred_count_locked;
+    int deferred_capacity;
 
     int tiles_x;
     int tiles_y;
@@ -25,143 +118,1114 @@ typedef struct
     int screen_w;
     int screen_h;
 
-    TileFunc func;
-    void *userdata;
-
-    atomic_int frame_gen;
-    bool shutdown;
+    // Cost-ordered tile schedule: tile_order lists every tile, most
+    // expensive first; tile_lists holds each slot's share in that order and
+    // tile_queues the part of it still to be taken
+    int *tile_order;
+    int *tile_lists;
+    int *tile_slots; // Slot of tile_order[i]
+    int tile_capacity;
+    TileQueue *tile_queues;
+    TileJobs tile_jobs;
+    uint64_t *slot_load;
+    int *slot_counts;
 
-    int tile_owners[1024];
+    // Slot that drew each tile in the last dispatch, -1 when unknown;
+    // tile_capacity entries, reset whenever the tile grid changes
+    int *tile_owners;
 } ThreadPool;
 
 static ThreadPool g_pool = {0};
 
 static __thread int t_worker_id = -1;
 
-static void *worker_func(void *arg)
+static inline void cpu_relax(void)
 {
-    t_worker_id = (int)(long)arg;
-    int last_gen = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
 
-    while (1)
+// Block while *word == expected (or until woken). Elsewhere than Linux
+// this degrades to a yield, and callers simply poll again.
+static void futex_wait(atomic_int *word, int expected)
+{
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)expected;
+    sched_yield();
+#endif
+}
+
+static void futex_wake(atomic_int *word, int count)
+{
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)count;
+#endif
+}
+
+static void pool_wake(int count)
+{
+    atomic_fetch_add(&g_pool.wake_seq, 1);
+    futex_wake(&g_pool.wake_seq, count);
+}
+
+// Deque used by the calling thread
+static int pool_slot(void)
+{
+    return t_worker_id >= 0 ? t_worker_id : g_pool.count;
+}
+
+static bool deque_push(int slot, const Job *job)
+{
+    if (!g_pool.deques)
+        return false;
+
+    JobDeque *dq = g_pool.deques[slot];
+    pthread_mutex_lock(&dq->lock);
+    int bottom = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    bool room = bottom - atomic_load_explicit(&dq->top, memory_order_relaxed) < JOB_DEQUE_SIZE;
+    if (room)
     {
-        pthread_mutex_lock(&g_pool.mutex);
-        while (atomic_load(&g_pool.frame_gen) == last_gen && !g_pool.shutdown)
-            pthread_cond_wait(&g_pool.start_cond, &g_pool.mutex);
-        pthread_mutex_unlock(&g_pool.mutex);
+        dq->jobs[bottom & JOB_DEQUE_MASK] = *job;
+        atomic_store_explicit(&dq->bottom, bottom + 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    if (!room)
+        return false;
 
-        if (g_pool.shutdown)
-            return NULL;
+    // Spinning workers see queued change; only sleepers need the syscall.
+    // A pinned job has to wake its own worker, and a futex cannot pick one.
+    atomic_fetch_add(&g_pool.queued, 1);
+    if (atomic_load(&g_pool.sleepers) > 0)
+        pool_wake(job->worker >= 0 ? INT32_MAX : 1);
+    return true;
+}
 
-        last_gen = atomic_load(&g_pool.frame_gen);
+// Thieves leave a job pinned to another worker where it is, and with it
+// whatever lies below; pinned jobs are rare and short
+static bool deque_pop(int slot, Job *out, bool steal, int thief)
+{
+    JobDeque *dq = g_pool.deques[slot];
+    // Unlocked peek; rechecked under the lock
+    if (atomic_load_explicit(&dq->bottom, memory_order_relaxed) ==
+        atomic_load_explicit(&dq->top, memory_order_relaxed))
+        return false;
 
-        while (1)
+    pthread_mutex_lock(&dq->lock);
+    int top = atomic_load_explicit(&dq->top, memory_order_relaxed);
+    int bottom = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    bool found = bottom != top;
+    if (found && steal)
+    {
+        int worker = dq->jobs[top & JOB_DEQUE_MASK].worker;
+        found = worker < 0 || worker == thief;
+    }
+    if (found && steal)
+    {
+        *out = dq->jobs[top & JOB_DEQUE_MASK];
+        atomic_store_explicit(&dq->top, top + 1, memory_order_relaxed);
+    }
+    else if (found)
+    {
+        *out = dq->jobs[(bottom - 1) & JOB_DEQUE_MASK];
+        atomic_store_explicit(&dq->bottom, bottom - 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    if (found)
+        atomic_fetch_sub(&g_pool.queued, 1);
+    return found;
+}
+
+// Own deque first, then steal round-robin from the others
+static bool job_take(int slot, Job *out)
+{
+    if (!g_pool.deques)
+        return false;
+    if (deque_pop(slot, out, false, slot))
+        return true;
+
+    int n = g_pool.count + 1;
+    for (int i = 1; i < n; i++)
+    {
+        if (deque_pop((slot + i) % n, out, true, slot))
+            return true;
+    }
+    return false;
+}
+
+static void job_enqueue(const Job *job);
+
+// Queue the deferred jobs counter_done marked ready (dependency NULL)
+static void deferred_release(void)
+{
+    Job ready[64];
+    int ready_count = 0;
+    bool more = true;
+    while (more)
+    {
+        pthread_mutex_lock(&g_pool.defer_lock);
+        more = false;
+        for (int i = 0; i < g_pool.deferred_count_locked; i++)
         {
-            int tile = atomic_fetch_add(&g_pool.next_tile, 1);
-            if (tile >= g_pool.total_tiles)
+            if (g_pool.deferred[i].dependency)
+                continue;
+            if (ready_count == 64)
+            {
+                more = true;
                 break;
+            }
+            ready[ready_count++] = g_pool.deferred[i].job;
+            g_pool.deferred[i--] = g_pool.deferred[--g_pool.deferred_count_locked];
+        }
+        pthread_mutex_unlock(&g_pool.defer_lock);
 
-            if (tile < 1024)
-                g_pool.tile_owners[tile] = t_worker_id;
+        for (int i = 0; i < ready_count; i++)
+            job_enqueue(&ready[i]);
+        ready_count = 0;
+    }
+}
 
-            int tx = tile % g_pool.tiles_x;
-            int ty = tile / g_pool.tiles_x;
-            int px = tx * g_pool.tile_size;
-            int py = ty * g_pool.tile_size;
-            int pw = g_pool.tile_size;
-            int ph = g_pool.tile_size;
+// Once pending hits zero a waiter may return and the counter's memory be
+// reused for a new counter, so the last decrement happens under defer_lock
+// together with marking the jobs deferred on it ready: job_submit_to checks
+// the dependency under the same lock. Afterwards only the address is used,
+// for the futex wake (a stray wake is harmless, waits re-check).
+static void counter_done(JobCounter *counter)
+{
+    if (!counter)
+        return;
+    int pending = atomic_load(&counter->pending);
+    while (pending > 1)
+    {
+        if (atomic_compare_exchange_weak(&counter->pending, &pending, pending - 1))
+            return;
+    }
 
-            if (px + pw > g_pool.screen_w)
-                pw = g_pool.screen_w - px;
-            if (py + ph > g_pool.screen_h)
-                ph = g_pool.screen_h - py;
+    // Without a pool nothing can be deferred
+    if (!g_pool.deques)
+    {
+        if (atomic_fetch_sub(&counter->pending, 1) == 1)
+            futex_wake(&counter->pending, INT32_MAX);
+        return;
+    }
 
-            g_pool.func(px, py, pw, ph, g_pool.userdata);
+    int ready = 0;
+    pthread_mutex_lock(&g_pool.defer_lock);
+    bool last = atomic_fetch_sub(&counter->pending, 1) == 1;
+    for (int i = 0; last && i < g_pool.deferred_count_locked; i++)
+    {
+        if (g_pool.deferred[i].dependency == counter)
+        {
+            g_pool.deferred[i].dependency = NULL;
+            ready++;
+        }
+    }
+    pthread_mutex_unlock(&g_pool.defer_lock);
+
+    if (!last)
+        return;
+    futex_wake(&counter->pending, INT32_MAX);
+    if (ready > 0)
+        deferred_release();
+}
+
+static void job_execute(Job job)
+{
+    int slot = pool_slot();
+    while (job.end - job.begin > job.grain)
+    {
+        Job upper = job;
+        upper.begin = job.begin + (job.end - job.begin) / 2;
+        if (job.counter)
+            atomic_fetch_add(&job.counter->pending, 1);
+        if (!deque_push(slot, &upper))
+        {
+            counter_done(job.counter);
+            break;
+        }
+        job.end = upper.begin;
+    }
 
-            int done = atomic_fetch_add(&g_pool.tiles_done, 1) + 1;
-            if (done >= g_pool.total_tiles)
+    for (int i = job.begin; i < job.end; i++)
+        job.func(i, job.userdata);
+    counter_done(job.counter);
+}
+
+// Push to the caller's deque (a pinned job to its worker's), or run right
+// here if that is not possible
+// A job pinned to a worker that threadpool_resize removed (drained from
+// the old deques or deferred) is unpinned: thieves would leave it, and
+// everything below it, for the owner of whichever deque it lands in
+static void job_enqueue(const Job *job)
+{
+    Job j = *job;
+    if (j.worker >= g_pool.count)
+        j.worker = -1;
+    int slot = j.worker >= 0 ? j.worker : pool_slot();
+    if (!deque_push(slot, &j))
+        job_execute(j);
+}
+
+void job_submit(const JobDesc *desc)
+{
+    job_submit_to(-1, desc);
+}
+
+void job_submit_to(int worker, const JobDesc *desc)
+{
+    if (!desc->func || desc->end <= desc->begin)
+        return;
+
+    Job job = {
+        .func = desc->func,
+        .userdata = desc->userdata,
+        .begin = desc->begin,
+        .end = desc->end,
+        .grain = desc->grain > 0 ? desc->grain : 1,
+        .counter = desc->counter,
+        .worker = worker >= 0 && worker < g_pool.count ? worker : -1,
+    };
+    if (job.counter)
+        atomic_fetch_add(&job.counter->pending, 1);
+
+    JobCounter *dep = desc->dependency;
+    if (dep && atomic_load(&dep->pending) > 0 && g_pool.deques)
+    {
+        // Re-checked under the lock its last decrement takes (counter_done)
+        pthread_mutex_lock(&g_pool.defer_lock);
+        bool held = atomic_load(&dep->pending) > 0;
+        if (held && g_pool.deferred_count_locked == g_pool.deferred_capacity)
+        {
+            int cap = g_pool.deferred_capacity ? g_pool.deferred_capacity * 2 : 64;
+            DeferredJob *list = realloc(g_pool.deferred, (size_t)cap * sizeof(DeferredJob));
+            if (list)
+            {
+                g_pool.deferred = list;
+                g_pool.deferred_capacity = cap;
+            }
+            else
             {
-                pthread_mutex_lock(&g_pool.mutex);
-                pthread_cond_signal(&g_pool.done_cond);
-                pthread_mutex_unlock(&g_pool.mutex);
+                LOG_ERROR("Job system: failed to defer a job, running it early");
+                held = false;
             }
         }
+        if (held)
+            g_pool.deferred[g_pool.deferred_count_locked++] = (DeferredJob){job, dep};
+        pthread_mutex_unlock(&g_pool.defer_lock);
+        if (held)
+            return;
     }
 
-    return NULL;
+    job_enqueue(&job);
 }
 
-void threadpool_init(int num_threads)
+void job_wait(JobCounter *counter)
+{
+    int slot = pool_slot();
+    int idle = 0;
+    while (1)
+    {
+        int pending = atomic_load(&counter->pending);
+        if (pending <= 0)
+            return;
+
+        // Help out while there is anything queued, then spin, then sleep
+        // until the last job of the counter wakes us
+        Job job;
+        if (job_take(slot, &job))
+        {
+            job_execute(job);
+            idle = 0;
+            continue;
+        }
+        if (idle++ < g_pool.spin_rounds)
+        {
+            for (int i = 0; i < POOL_SPIN_PAUSES; i++)
+                cpu_relax();
+            continue;
+        }
+
+        // Anything still queued is pinned to a worker; give it the CPU
+        if (atomic_load(&g_pool.queued) == 0)
+            futex_wait(&counter->pending, pending);
+        else
+            sched_yield();
+        idle = 0;
+    }
+}
+
+void job_parallel_for(int count, int grain, JobFunc func, void *userdata)
+{
+    JobCounter counter = {0};
+    job_submit(&(JobDesc){
+        .func = func,
+        .userdata = userdata,
+        .begin = 0,
+        .end = count,
+        .grain = grain,
+        .counter = &counter,
+    });
+    job_wait(&counter);
+}
+
+// Group the CPUs we may run on by NUMA node, as sysfs lists them. Without
+// sysfs (or off Linux) every CPU lands in one node.
+static void topology_detect(void)
+{
+    free(g_pool.cpus);
+    g_pool.cpus = NULL;
+    g_pool.node_count = 0;
+
+#ifdef __linux__
+    if (sched_getaffinity(0, sizeof(g_pool.allowed), &g_pool.allowed) != 0)
+    {
+        CPU_ZERO(&g_pool.allowed);
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long c = 0; c < online && c < CPU_SETSIZE; c++)
+            CPU_SET(c, &g_pool.allowed);
+    }
+    int total = CPU_COUNT(&g_pool.allowed);
+    g_pool.cpus = malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+    if (!g_pool.cpus)
+        return;
+
+    cpu_set_t seen;
+    CPU_ZERO(&seen);
+    int n = 0;
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++)
+    {
+        char path[64];
+        char line[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            continue;
+        bool ok = fgets(line, sizeof(line), f) != NULL;
+        fclose(f);
+        if (!ok)
+            continue;
+
+        // "0-3,8-11" style ranges
+        int first = n;
+        char *p = line;
+        while (1)
+        {
+            char *end;
+            long lo = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            long hi = lo;
+            if (*end == '-')
+            {
+                p = end + 1;
+                hi = strtol(p, &end, 10);
+            }
+            for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            {
+                if (CPU_ISSET(c, &g_pool.allowed) && !CPU_ISSET(c, &seen) && n < total)
+                {
+                    CPU_SET(c, &seen);
+                    g_pool.cpus[n++] = (int)c;
+                }
+            }
+            if (*end != ',')
+                break;
+            p = end + 1;
+        }
+        if (n > first)
+            g_pool.node_first[g_pool.node_count++] = first;
+    }
+
+    if (g_pool.node_count == 0)
+    {
+        for (int c = 0; c < CPU_SETSIZE && n < total; c++)
+        {
+            if (CPU_ISSET(c, &g_pool.allowed))
+                g_pool.cpus[n++] = c;
+        }
+        g_pool.node_first[g_pool.node_count++] = 0;
+    }
+    g_pool.node_first[g_pool.node_count] = n;
+#else
+    g_pool.node_first[0] = 0;
+    g_pool.node_first[1] = 0;
+    g_pool.node_count = 1;
+#endif
+}
+
+// Nodes the pool spreads over; only pinned workers stay on one
+static int pool_nodes(void)
+{
+    return g_pool.pinned && g_pool.node_count > 1 ? g_pool.node_count : 1;
+}
+
+// Workers go round-robin over the nodes, then over each node's CPUs
+static int worker_node(int worker)
+{
+    return worker % pool_nodes();
+}
+
+static void worker_place(int worker)
+{
+#ifdef __linux__
+    if (g_pool.node_count == 0)
+        return;
+    cpu_set_t set = g_pool.allowed;
+    int node = worker % g_pool.node_count;
+    int first = g_pool.node_first[node];
+    int cpus = g_pool.node_first[node + 1] - first;
+    if (g_pool.pinned && cpus > 0)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(g_pool.cpus[first + (worker / g_pool.node_count) % cpus], &set);
+    }
+    if (pthread_setaffinity_np(g_pool.threads[worker], sizeof(set), &set) != 0)
+        LOG_WARN("Thread pool: failed to set the affinity of worker %d", worker);
+#else
+    (void)worker;
+#endif
+}
+
+static void slot_nodes_update(void)
+{
+    for (int i = 0; i < g_pool.count; i++)
+        g_pool.slot_node[i] = worker_node(i);
+    g_pool.slot_node[g_pool.count] = -1;
+}
+
+// Stop at the top of the loop until the resizing thread lets go
+static void worker_park(void)
+{
+    atomic_fetch_add(&g_pool.parked, 1);
+    futex_wake(&g_pool.parked, 1);
+    while (atomic_load(&g_pool.parking))
+        futex_wait(&g_pool.parking, 1);
+    atomic_fetch_sub(&g_pool.parked, 1);
+    futex_wake(&g_pool.parked, 1);
+}
+
+static void *worker_func(void *arg)
+{
+    t_worker_id = (int)(long)arg;
+    int idle = 0;
+
+    while (1)
+    {
+        if (atomic_load(&g_pool.parking))
+        {
+            worker_park();
+            if (t_worker_id >= g_pool.count)
+                return NULL;
+            idle = 0;
+            continue;
+        }
+
+        Job job;
+        if (job_take(t_worker_id, &job))
+        {
+            job_execute(job);
+            idle = 0;
+            continue;
+        }
+        if (atomic_load(&g_pool.shutdown))
+            return NULL;
+        if (idle++ < g_pool.spin_rounds)
+        {
+            for (int i = 0; i < POOL_SPIN_PAUSES; i++)
+                cpu_relax();
+            continue;
+        }
+
+        // Read the sequence before re-checking for work: a push after the
+        // check bumps it, and the wait returns at once
+        int seq = atomic_load(&g_pool.wake_seq);
+        atomic_fetch_add(&g_pool.sleepers, 1);
+        if (atomic_load(&g_pool.queued) == 0 && !atomic_load(&g_pool.shutdown) &&
+            !atomic_load(&g_pool.parking))
+            futex_wait(&g_pool.wake_seq, seq);
+        atomic_fetch_sub(&g_pool.sleepers, 1);
+        idle = 0;
+    }
+}
+
+// Returns once every worker is parked
+static void pool_park(void)
+{
+    atomic_store(&g_pool.parking, 1);
+    pool_wake(INT32_MAX);
+    int parked;
+    while ((parked = atomic_load(&g_pool.parked)) < g_pool.count)
+        futex_wait(&g_pool.parked, parked);
+}
+
+// Returns once every worker has left worker_park, so the next park can
+// count from zero
+static void pool_unpark(void)
+{
+    atomic_store(&g_pool.parking, 0);
+    futex_wake(&g_pool.parking, INT32_MAX);
+    int parked;
+    while ((parked = atomic_load(&g_pool.parked)) > 0)
+        futex_wait(&g_pool.parked, parked);
+}
+
+// Room in the per-slot arrays for num_threads workers
+static bool pool_reserve(int num_threads)
+{
+    if (num_threads <= g_pool.capacity)
+        return true;
+
+    size_t slots = (size_t)num_threads + 1;
+    pthread_t *threads = realloc(g_pool.threads, (size_t)num_threads * sizeof(pthread_t));
+    if (threads)
+        g_pool.threads = threads;
+    JobDeque **deques = realloc(g_pool.deques, slots * sizeof(JobDeque *));
+    if (deques)
+    {
+        memset(deques + g_pool.capacity + 1, 0,
+               (slots - (size_t)g_pool.capacity - 1) * sizeof(JobDeque *));
+        g_pool.deques = deques;
+    }
+    TileQueue *queues = realloc(g_pool.tile_queues, slots * sizeof(TileQueue));
+    if (queues)
+        g_pool.tile_queues = queues;
+    uint64_t *load = realloc(g_pool.slot_load, slots * sizeof(uint64_t));
+    if (load)
+        g_pool.slot_load = load;
+    int *counts = realloc(g_pool.slot_counts, slots * sizeof(int));
+    if (counts)
+        g_pool.slot_counts = counts;
+    int *nodes = realloc(g_pool.slot_node, slots * sizeof(int));
+    if (nodes)
+        g_pool.slot_node = nodes;
+    if (!threads || !deques || !queues || !load || !counts || !nodes)
+    {
+        LOG_ERROR("Thread pool: failed to allocate slots for %d workers", num_threads);
+        return false;
+    }
+    g_pool.capacity = num_threads;
+    return true;
+}
+
+// Take every queued job out of deques[0 .. slots - 1]
+static Job *pool_drain(int slots, int *out_count)
+{
+    int queued = atomic_load(&g_pool.queued);
+    Job *jobs = queued > 0 ? malloc((size_t)queued * sizeof(Job)) : NULL;
+    int n = 0;
+    for (int s = 0; s < slots; s++)
+    {
+        JobDeque *dq = g_pool.deques[s];
+        int top = atomic_load(&dq->top);
+        int bottom = atomic_load(&dq->bottom);
+        for (int i = top; i < bottom && jobs && n < queued; i++)
+            jobs[n++] = dq->jobs[i & JOB_DEQUE_MASK];
+        atomic_store(&dq->top, 0);
+        atomic_store(&dq->bottom, 0);
+    }
+    if (queued > 0 && !jobs)
+        LOG_ERROR("Thread pool: lost %d queued jobs while resizing", queued);
+    atomic_store(&g_pool.queued, 0);
+    *out_count = n;
+    return jobs;
+}
+
+void threadpool_resize(int num_threads)
 {
     if (num_threads < 1)
         num_threads = 1;
-    if (num_threads > MAX_WORKER_THREADS)
-        num_threads = MAX_WORKER_THREADS;
+    if (!g_pool.deques)
+    {
+        threadpool_init(num_threads);
+        return;
+    }
+    int old_count = g_pool.count;
+    if (num_threads == old_count)
+        return;
+
+    // With every worker parked nothing touches the deques, so they can be
+    // emptied, added or freed and the slots renumbered
+    pool_park();
+    if (!pool_reserve(num_threads))
+    {
+        pool_unpark();
+        return;
+    }
+    int job_count;
+    Job *jobs = pool_drain(old_count + 1, &job_count);
+
+    for (int s = num_threads + 1; s <= old_count; s++)
+    {
+        pthread_mutex_destroy(&g_pool.deques[s]->lock);
+        free(g_pool.deques[s]);
+        g_pool.deques[s] = NULL;
+    }
+    for (int s = old_count + 1; s <= num_threads; s++)
+    {
+        JobDeque *dq = calloc(1, sizeof(JobDeque));
+        if (!dq)
+        {
+            LOG_ERROR("Thread pool: failed to allocate a job deque");
+            num_threads = s - 1;
+            break;
+        }
+        pthread_mutex_init(&dq->lock, NULL);
+        g_pool.deques[s] = dq;
+    }
 
-    memset(&g_pool, 0, sizeof(g_pool));
-    pthread_mutex_init(&g_pool.mutex, NULL);
-    pthread_cond_init(&g_pool.start_cond, NULL);
-    pthread_cond_init(&g_pool.done_cond, NULL);
-
-    atomic_store(&g_pool.frame_gen, 0);
-    atomic_store(&g_pool.next_tile, 0);
-    atomic_store(&g_pool.tiles_done, 0);
-    g_pool.shutdown = false;
     g_pool.count = num_threads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    g_pool.spin_rounds = cpus > num_threads ? POOL_SPIN_ROUNDS : 0;
+    slot_nodes_update();
+    if (g_pool.pinned && g_pool.node_count > 1)
+        g_pool.placement++;
 
-    for (int i = 0; i < num_threads; i++)
-        pthread_create(&g_pool.threads[i], NULL, worker_func, (void *)(long)i);
+    // Workers past the new count exit on release
+    pool_unpark();
+    for (int i = num_threads; i < old_count; i++)
+        pthread_join(g_pool.threads[i], NULL);
+    for (int i = old_count; i < num_threads; i++)
+    {
+        if (pthread_create(&g_pool.threads[i], NULL, worker_func, (void *)(long)i) != 0)
+        {
+            LOG_ERROR("Thread pool: failed to start worker %d", i);
+            g_pool.count = num_threads = i;
+            slot_nodes_update();
+            break;
+        }
+        if (g_pool.pinned)
+            worker_place(i);
+    }
+
+    for (int i = 0; i < job_count; i++)
+        job_enqueue(&jobs[i]);
+    free(jobs);
 
-    LOG_INFO("Thread pool initialized: %d workers", num_threads);
+    if (old_count > 0)
+        LOG_INFO("Thread pool resized: %d -> %d workers", old_count, num_threads);
+    else
+        LOG_INFO("Thread pool initialized: %d workers", num_threads);
+}
+
+void threadpool_init(int num_threads)
+{
+    memset(&g_pool, 0, sizeof(g_pool));
+    pthread_mutex_init(&g_pool.defer_lock, NULL);
+    atomic_store(&g_pool.queued, 0);
+    atomic_store(&g_pool.sleepers, 0);
+    atomic_store(&g_pool.wake_seq, 0);
+    atomic_store(&g_pool.shutdown, false);
+    atomic_store(&g_pool.parking, 0);
+    atomic_store(&g_pool.parked, 0);
+    topology_detect();
+
+    // A pool of no workers: just the shared deque
+    if (!pool_reserve(1))
+        return;
+    g_pool.deques[0] = calloc(1, sizeof(JobDeque));
+    if (!g_pool.deques[0])
+    {
+        LOG_ERROR("Thread pool: failed to allocate job deques");
+        free(g_pool.deques);
+        g_pool.deques = NULL;
+        return;
+    }
+    pthread_mutex_init(&g_pool.deques[0]->lock, NULL);
+    g_pool.slot_node[0] = -1;
+
+    threadpool_resize(num_threads);
 }
 
 void threadpool_shutdown(void)
 {
-    if (g_pool.count == 0)
+    if (!g_pool.deques)
         return;
 
-    pthread_mutex_lock(&g_pool.mutex);
-    g_pool.shutdown = true;
-    pthread_cond_broadcast(&g_pool.start_cond);
-    pthread_mutex_unlock(&g_pool.mutex);
+    // Workers drain their queues before they look at the flag
+    atomic_store(&g_pool.shutdown, true);
+    pool_wake(INT32_MAX);
 
     for (int i = 0; i < g_pool.count; i++)
         pthread_join(g_pool.threads[i], NULL);
 
-    pthread_mutex_destroy(&g_pool.mutex);
-    pthread_cond_destroy(&g_pool.start_cond);
-    pthread_cond_destroy(&g_pool.done_cond);
+    if (g_pool.deferred_count_locked > 0)
+        LOG_WARN("Thread pool: dropping %d jobs with unfinished dependencies",
+                 g_pool.deferred_count_locked);
+
+    for (int i = 0; i <= g_pool.count; i++)
+    {
+        pthread_mutex_destroy(&g_pool.deques[i]->lock);
+        free(g_pool.deques[i]);
+    }
+    free(g_pool.deques);
+    free(g_pool.threads);
+    free(g_pool.cpus);
+    free(g_pool.slot_node);
+    free(g_pool.slot_load);
+    free(g_pool.slot_counts);
+    free(g_pool.tile_queues);
+    free(g_pool.deferred);
+    free(g_pool.tile_order);
+    free(g_pool.tile_lists);
+    free(g_pool.tile_slots);
+    free(g_pool.tile_owners);
+    pthread_mutex_destroy(&g_pool.defer_lock);
 
     int old_count = g_pool.count;
     memset(&g_pool, 0, sizeof(g_pool));
     LOG_INFO("Thread pool shut down (%d workers)", old_count);
 }
 
-void threadpool_dispatch(int tiles_x, int tiles_y, int tile_size,
-                         int screen_w, int screen_h,
-                         TileFunc func, void *userdata)
+bool threadpool_set_pinning(bool enabled)
+{
+#ifdef __linux__
+    if (!g_pool.deques || g_pool.pinned == enabled)
+        return g_pool.deques != NULL;
+
+    g_pool.pinned = enabled;
+    for (int i = 0; i < g_pool.count; i++)
+        worker_place(i);
+    slot_nodes_update();
+    if (g_pool.node_count > 1)
+        g_pool.placement++;
+    LOG_INFO("Thread pool: workers %s (%d NUMA node%s)", enabled ? "pinned" : "unpinned",
+             g_pool.node_count, g_pool.node_count == 1 ? "" : "s");
+    return true;
+#else
+    if (enabled)
+        LOG_WARN("Thread pool: CPU pinning is not supported on this platform");
+    return !enabled;
+#endif
+}
+
+bool threadpool_is_pinned(void)
+{
+    return g_pool.pinned;
+}
+
+int threadpool_get_node_count(void)
+{
+    return g_pool.deques ? pool_nodes() : 1;
+}
+
+int threadpool_get_placement(void)
+{
+    return g_pool.placement;
+}
+
+typedef struct
+{
+    uint8_t *buffer;
+    size_t row_bytes;
+    int rows;
+    int nodes;
+} FirstTouch;
+
+// Rows r with r * nodes / rows == node, the band tile dispatch gives it
+static void first_touch_job(int node, void *userdata)
+{
+    const FirstTouch *ft = userdata;
+    int64_t r0 = ((int64_t)node * ft->rows + ft->nodes - 1) / ft->nodes;
+    int64_t r1 = ((int64_t)(node + 1) * ft->rows + ft->nodes - 1) / ft->nodes;
+    memset(ft->buffer + (size_t)r0 * ft->row_bytes, 0, (size_t)(r1 - r0) * ft->row_bytes);
+}
+
+void threadpool_first_touch(void *buffer, size_t row_bytes, int rows)
+{
+    int nodes = threadpool_get_node_count();
+    if (!buffer || nodes < 2 || rows < nodes)
+        return;
+
+    FirstTouch ft = {buffer, row_bytes, rows, nodes};
+    JobCounter counter = {0};
+    for (int node = 0; node < nodes; node++)
+    {
+        // Worker n sits on node n % nodes; a node without one is touched
+        // by whoever gets there
+        job_submit_to(node < g_pool.count ? node : -1, &(JobDesc){
+            .func = first_touch_job,
+            .userdata = &ft,
+            .begin = node,
+            .end = node + 1,
+            .counter = &counter,
+        });
+    }
+    job_wait(&counter);
+}
+
+static void tile_job(int tile, void *userdata)
+{
+    const TileJobs *jobs = userdata;
+    g_pool.tile_owners[tile] = pool_slot();
+
+    int tx = tile % g_pool.tiles_x;
+    int ty = tile / g_pool.tiles_x;
+    int px = tx * g_pool.tile_size;
+    int py = ty * g_pool.tile_size;
+    int pw = g_pool.tile_size;
+    int ph = g_pool.tile_size;
+
+    if (px + pw > g_pool.screen_w)
+        pw = g_pool.screen_w - px;
+    if (py + ph > g_pool.screen_h)
+        ph = g_pool.screen_h - py;
+
+    jobs->func(px, py, pw, ph, jobs->userdata);
+}
+
+static bool tile_queue_take(TileQueue *q, bool from_tail, int *out)
 {
+    uint64_t range = atomic_load(&q->range);
+    while (1)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+        if (head >= tail)
+            return false;
+        uint64_t next = from_tail ? ((uint64_t)(tail - 1) << 32) | head
+                                  : ((uint64_t)tail << 32) | (head + 1);
+        if (atomic_compare_exchange_weak(&q->range, &range, next))
+        {
+            *out = g_pool.tile_lists[q->base + (int)(from_tail ? tail - 1 : head)];
+            return true;
+        }
+    }
+}
+
+// One per participating thread: drain the caller's own list, expensive
+// tiles first, then help with the cheapest tiles left on the others,
+// those of threads on the same node first
+static void tile_schedule_job(int index, void *userdata)
+{
+    (void)index;
+    int slots = g_pool.count + 1;
+    int self = pool_slot();
+    int node = g_pool.slot_node[self];
+    int tile;
+
+    while (tile_queue_take(&g_pool.tile_queues[self], false, &tile))
+        tile_job(tile, userdata);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 1; i < slots; i++)
+        {
+            int victim = (self + i) % slots;
+            if ((g_pool.slot_node[victim] == node) != (pass == 0))
+                continue;
+            while (tile_queue_take(&g_pool.tile_queues[victim], true, &tile))
+                tile_job(tile, userdata);
+        }
+    }
+}
+
+static bool tile_schedule_reserve(int tiles)
+{
+    if (tiles <= g_pool.tile_capacity)
+        return true;
+
+    int *order = realloc(g_pool.tile_order, (size_t)tiles * sizeof(int));
+    if (order)
+        g_pool.tile_order = order;
+    int *lists = realloc(g_pool.tile_lists, (size_t)tiles * sizeof(int));
+    if (lists)
+        g_pool.tile_lists = lists;
+    int *slots = realloc(g_pool.tile_slots, (size_t)tiles * sizeof(int));
+    if (slots)
+        g_pool.tile_slots = slots;
+    int *owners = realloc(g_pool.tile_owners, (size_t)tiles * sizeof(int));
+    if (owners)
+    {
+        for (int t = g_pool.tile_capacity; t < tiles; t++)
+            owners[t] = -1;
+        g_pool.tile_owners = owners;
+    }
+    if (!order || !lists || !slots || !owners)
+    {
+        LOG_ERROR("Thread pool: failed to allocate a schedule for %d tiles", tiles);
+        return false;
+    }
+    g_pool.tile_capacity = tiles;
+    return true;
+}
+
+// Power-of-two cost class: 0 for free tiles, 32 for the most expensive
+static inline int cost_bucket(uint32_t cost)
+{
+    return cost ? 32 - __builtin_clz(cost) : 0;
+}
+
+// Least loaded slot on a node (any node for -1), -1 if it has none
+static int least_loaded(int slots, int node)
+{
+    int best = -1;
+    for (int s = 0; s < slots; s++)
+    {
+        if (node >= 0 && g_pool.slot_node[s] != node)
+            continue;
+        if (best < 0 || g_pool.slot_load[s] < g_pool.slot_load[best])
+            best = s;
+    }
+    return best;
+}
+
+// Order tiles by cost and deal them out: each tile goes back to the slot
+// that drew it last time (its pixels are likely still in that core's
+// cache) unless that slot already holds its share of the total cost, in
+// which case the least loaded slot takes it, preferring the node whose
+// memory holds the tile's rows. The order only needs to be rough, so
+// tiles are counting-sorted into power-of-two cost classes, most
+// expensive class first and tile order within a class. Tiles are dealt
+// to the first `slots` slots; the others get empty lists.
+static void tile_schedule_build(int tiles, const uint32_t *tile_cost, int slots)
+{
+    int start[34] = {0};
+    uint64_t total = 0;
+    for (int t = 0; t < tiles; t++)
+    {
+        uint32_t cost = tile_cost ? tile_cost[t] : 0;
+        start[32 - cost_bucket(cost) + 1]++;
+        total += (uint64_t)cost + 1;
+    }
+    for (int b = 1; b < 34; b++)
+        start[b] += start[b - 1];
+    for (int t = 0; t < tiles; t++)
+    {
+        uint32_t cost = tile_cost ? tile_cost[t] : 0;
+        g_pool.tile_order[start[32 - cost_bucket(cost)]++] = t;
+    }
+
+    uint64_t share = total / (uint64_t)slots + 1;
+    uint64_t *load = g_pool.slot_load;
+    int *counts = g_pool.slot_counts;
+    memset(load, 0, (size_t)(g_pool.count + 1) * sizeof(uint64_t));
+    memset(counts, 0, (size_t)(g_pool.count + 1) * sizeof(int));
+    int nodes = pool_nodes();
+    for (int i = 0; i < tiles; i++)
+    {
+        int t = g_pool.tile_order[i];
+        uint64_t cost = (uint64_t)(tile_cost ? tile_cost[t] : 0) + 1;
+
+        int slot = g_pool.tile_owners[t];
+        if (slot < 0 || slot >= slots || load[slot] + cost > share)
+        {
+            slot = -1;
+            if (nodes > 1)
+            {
+                // Node of the tile's middle row, as threadpool_first_touch
+                // placed it
+                int y = (t / g_pool.tiles_x) * g_pool.tile_size + g_pool.tile_size / 2;
+                if (y >= g_pool.screen_h)
+                    y = g_pool.screen_h - 1;
+                slot = least_loaded(slots, (int)((int64_t)y * nodes / g_pool.screen_h));
+                if (slot >= 0 && load[slot] + cost > share)
+                    slot = -1;
+            }
+            if (slot < 0)
+                slot = least_loaded(slots, -1);
+        }
+        load[slot] += cost;
+        counts[slot]++;
+        g_pool.tile_slots[i] = slot;
+    }
+
+    int base = 0;
+    for (int s = 0; s <= g_pool.count; s++)
+    {
+        g_pool.tile_queues[s].base = base;
+        atomic_store(&g_pool.tile_queues[s].range, (uint64_t)counts[s] << 32);
+        counts[s] = base;
+        base += (int)(atomic_load(&g_pool.tile_queues[s].range) >> 32);
+    }
+    for (int i = 0; i < tiles; i++)
+        g_pool.tile_lists[counts[g_pool.tile_slots[i]]++] = g_pool.tile_order[i];
+}
+
+// Make room for the tile grid of a dispatch. Owners recorded for another
+// grid (another resolution or tile size) name other pixels and are dropped.
+static bool tile_grid_set(int tiles_x, int tiles_y, int tile_size, int screen_w, int screen_h)
+{
+    if (!tile_schedule_reserve(tiles_x * tiles_y))
+        return false;
+    if (tiles_x != g_pool.tiles_x || tiles_y != g_pool.tiles_y || tile_size != g_pool.tile_size)
+    {
+        for (int t = 0; t < tiles_x * tiles_y; t++)
+            g_pool.tile_owners[t] = -1;
+    }
+
     g_pool.tiles_x = tiles_x;
     g_pool.tiles_y = tiles_y;
     g_pool.tile_size = tile_size;
     g_pool.screen_w = screen_w;
     g_pool.screen_h = screen_h;
-    g_pool.func = func;
-    g_pool.userdata = userdata;
-    g_pool.total_tiles = tiles_x * tiles_y;
+    return true;
+}
+
+// caller_helps: the dispatching thread drains its own list, so it is dealt
+// a share. Otherwise its list would only be stolen from the tail, cheapest
+// first, leaving its most expensive tiles for last.
+static void tile_dispatch(int tiles_x, int tiles_y, int tile_size,
+                          int screen_w, int screen_h, const uint32_t *tile_cost,
+                          TileFunc func, void *userdata, JobCounter *counter, bool caller_helps)
+{
+    if (!tile_grid_set(tiles_x, tiles_y, tile_size, screen_w, screen_h))
+        return;
 
-    atomic_store(&g_pool.next_tile, 0);
-    atomic_store(&g_pool.tiles_done, 0);
+    // Owners of the last dispatch steer affinity, so rebuild before any
+    // tile records its new owner
+    int slots = caller_helps || g_pool.count == 0 ? g_pool.count + 1 : g_pool.count;
+    tile_schedule_build(tiles_x * tiles_y, tile_cost, slots);
+    g_pool.tile_jobs = (TileJobs){func, userdata};
+    job_submit(&(JobDesc){
+        .func = tile_schedule_job,
+        .userdata = &g_pool.tile_jobs,
+        .begin = 0,
+        .end = g_pool.count + 1,
+        .grain = 1,
+        .counter = counter,
+    });
+}
+
+void threadpool_dispatch_async(int tiles_x, int tiles_y, int tile_size,
+                               int screen_w, int screen_h, const uint32_t *tile_cost,
+                               TileFunc func, void *userdata, JobCounter *counter,
+                               bool caller_helps)
+{
+    tile_dispatch(tiles_x, tiles_y, tile_size, screen_w, screen_h, tile_cost,
+                  func, userdata, counter, caller_helps);
+}
+
+void threadpool_dispatch(int tiles_x, int tiles_y, int tile_size,
+                         int screen_w, int screen_h, const uint32_t *tile_cost,
+                         TileFunc func, void *userdata)
+{
+    JobCounter counter = {0};
+    tile_dispatch(tiles_x, tiles_y, tile_size, screen_w, screen_h, tile_cost,
+                  func, userdata, &counter, true);
+    job_wait(&counter);
+}
+
+void threadpool_dispatch_local(int tiles_x, int tiles_y, int tile_size,
+                               int screen_w, int screen_h,
+                               TileFunc func, void *userdata)
+{
+    if (!tile_grid_set(tiles_x, tiles_y, tile_size, screen_w, screen_h))
+        return;
 
-    pthread_mutex_lock(&g_pool.mutex);
-    atomic_fetch_add(&g_pool.frame_gen, 1);
-    pthread_cond_broadcast(&g_pool.start_cond);
-    pthread_mutex_unlock(&g_pool.mutex);
+    TileJobs jobs = {func, userdata};
+    for (int i = 0; i < tiles_x * tiles_y; i++)
+        tile_job(i, &jobs);
+}
 
-    pthread_mutex_lock(&g_pool.mutex);
-    while (atomic_load(&g_pool.tiles_done) < g_pool.total_tiles)
-        pthread_cond_wait(&g_pool.done_cond, &g_pool.mutex);
-    pthread_mutex_unlock(&g_pool.mutex);
+void threadpool_run(int count, JobFunc func, void *userdata)
+{
+    job_parallel_for(count, 1, func, userdata);
 }
 
 int threadpool_get_count(void)
@@ -174,11 +1238,21 @@ bool threadpool_is_active(void)
     return g_pool.count > 0;
 }
 
+int threadpool_get_worker_id(void)
+{
+    return t_worker_id;
+}
+
 const int *threadpool_get_tile_owners(void)
 {
     return g_pool.tile_owners;
 }
 
+const int *threadpool_get_tile_order(void)
+{
+    return g_pool.tile_order;
+}
+
 int threadpool_get_tiles_x(void)
 {
     return g_pool.tiles_x;
@@ -188,3 +1262,65 @@ int threadpool_get_tiles_y(void)
 {
     return g_pool.tiles_y;
 }
+
+int threadpool_get_tile_size(void)
+{
+    return g_pool.tile_size;
+}
+
+// Size of a data or unified cache in "32K" form from sysfs, 0 if absent
+static int cache_size_sysfs(int level)
+{
+    for (int index = 0; index < 8; index++)
+    {
+        char path[96];
+        char text[32];
+        int found_level = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            break;
+        if (fscanf(f, "%d", &found_level) != 1)
+            found_level = 0;
+        fclose(f);
+        if (found_level != level)
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        f = fopen(path, "r");
+        bool data = f && fgets(text, sizeof(text), f) && strncmp(text, "Instruction", 11) != 0;
+        if (f)
+            fclose(f);
+        if (!data)
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        f = fopen(path, "r");
+        int size = 0;
+        char unit = 0;
+        if (f && fscanf(f, "%d%c", &size, &unit) >= 1)
+            size *= unit == 'K' ? 1024 : unit == 'M' ? 1024 * 1024 : 1;
+        if (f)
+            fclose(f);
+        return size;
+    }
+    return 0;
+}
+
+int threadpool_get_cache_size(int level)
+{
+    static int sizes[3] = {-1, -1, -1};
+    if (level < 1 || level > 2)
+        return 0;
+    if (sizes[level] >= 0)
+        return sizes[level];
+
+    long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    size = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (size <= 0)
+        size = cache_size_sysfs(level);
+    sizes[level] = size > 0 && size < INT32_MAX ? (int)size : 0;
+    return sizes[level];
+}
@@ -1,22 +1,99 @@
 #ifndef THREADS_H
 #define THREADS_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
-
-#define MAX_WORKER_THREADS 16
-#define TILE_SIZE 32
+#include <stddef.h>
+#include <stdint.h>
 
 typedef void (*TileFunc)(int tile_x, int tile_y, int tile_w, int tile_h, void *userdata);
+typedef void (*JobFunc)(int index, void *userdata);
+
+// Outstanding-work count for a group of jobs. Zero-initialize before use;
+// it reaches zero again once every job counted on it has finished.
+typedef struct
+{
+    atomic_int pending;
+} JobCounter;
+
+// A job runs func(index, userdata) for every index in [begin, end). Ranges
+// larger than grain are split in halves, and idle workers steal the halves.
+typedef struct
+{
+    JobFunc func;
+    void *userdata;
+    int begin, end;
+    int grain;              // Largest range run without splitting (<= 0 means 1)
+    JobCounter *counter;    // Optional: counts this job until it finishes
+    JobCounter *dependency; // Optional: the job is held until this reaches zero
+} JobDesc;
 
 void threadpool_init(int num_threads);
 void threadpool_shutdown(void);
+// Grow or shrink the running pool in place; queued jobs are kept. Call it
+// from the thread that owns the pool, with no dispatch in flight.
+void threadpool_resize(int num_threads);
+
+// Pin each worker to one CPU, dealing workers round-robin over the NUMA
+// nodes. Off by default; returns false where affinity is unsupported.
+bool threadpool_set_pinning(bool enabled);
+bool threadpool_is_pinned(void);
+// Nodes tile dispatch splits the screen rows over: 1 unless the workers
+// are pinned on a NUMA machine
+int threadpool_get_node_count(void);
+// Changes whenever workers move between nodes; buffers first-touched
+// before that may now sit on the wrong node
+int threadpool_get_placement(void);
+// Zero a row-major buffer from the workers, each node writing the band of
+// rows its tiles will draw, so the OS backs every band with that node's
+// memory. Does nothing (the buffer is left as is) with a single node.
+void threadpool_first_touch(void *buffer, size_t row_bytes, int rows);
+
+// Job system. Jobs go to the submitting worker's deque (or a shared one
+// for other threads); job_wait runs queued jobs on the calling thread
+// until the counter drains, then spins briefly and sleeps on a futex.
+// Without a pool, jobs run inline on submit.
+void job_submit(const JobDesc *desc);
+// Same, but only the given worker runs the job (and its split halves)
+void job_submit_to(int worker, const JobDesc *desc);
+void job_wait(JobCounter *counter);
+void job_parallel_for(int count, int grain, JobFunc func, void *userdata);
+
+// Run func on every tile. tile_cost (optional, one entry per tile, any
+// unit) is the expected cost, usually the tile's time last frame: tiles
+// are started most expensive first, and each thread prefers the tiles it
+// drew in the previous dispatch.
 void threadpool_dispatch(int tiles_x, int tiles_y, int tile_size,
-                         int screen_w, int screen_h,
+                         int screen_w, int screen_h, const uint32_t *tile_cost,
                          TileFunc func, void *userdata);
+// Same, but returns once the tiles are queued; counter (zero-initialized)
+// drains when the last one is done. caller_helps deals the caller a share
+// of the tiles, which it only draws once it waits on counter; pass false
+// when it goes on with other work, and it then helps by stealing. Only one
+// tile dispatch may be in flight, and the pool must not be resized until
+// it completes.
+void threadpool_dispatch_async(int tiles_x, int tiles_y, int tile_size,
+                               int screen_w, int screen_h, const uint32_t *tile_cost,
+                               TileFunc func, void *userdata, JobCounter *counter,
+                               bool caller_helps);
+// Same tile walk on the calling thread only, for loads too small to be
+// worth waking the workers
+void threadpool_dispatch_local(int tiles_x, int tiles_y, int tile_size,
+                               int screen_w, int screen_h,
+                               TileFunc func, void *userdata);
+// Run func(0 .. count-1) across the workers; blocks until all are done
+void threadpool_run(int count, JobFunc func, void *userdata);
 int threadpool_get_count(void);
 bool threadpool_is_active(void);
+// Index of the calling pool worker, -1 on any other thread
+int threadpool_get_worker_id(void);
 const int *threadpool_get_tile_owners(void);
+// Tiles of the last threadpool_dispatch, most expensive first
+const int *threadpool_get_tile_order(void);
 int threadpool_get_tiles_x(void);
 int threadpool_get_tiles_y(void);
+int threadpool_get_tile_size(void);
+// Per-core data cache size at level 1 or 2 in bytes, 0 if unknown
+int threadpool_get_cache_size(int level);
 
 #endif
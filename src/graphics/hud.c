@@ -2,6 +2,8 @@
 #include "graphics/render.h"
 #include "core/entity.h"
 #include "core/log.h"
+#include "core/profile.h"
+#include "core/threads.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -225,6 +227,30 @@ void hud_draw_crosshair(uint32_t color)
     render_set_pixel(center_x, center_y, color);
 }
 
+// Dispatch rank of every tile (0 = started first, the most expensive);
+// drawn over render_draw_tile_debug. Ranks below the worker count plus
+// one for the rendering thread, the first tile each thread takes, are
+// highlighted.
+void hud_draw_tile_ranks(const Font *font)
+{
+    int tiles_x = threadpool_get_tiles_x();
+    int tiles_y = threadpool_get_tiles_y();
+    int tile_size = threadpool_get_tile_size();
+    const int *order = threadpool_get_tile_order();
+    if (!order || tiles_x <= 0 || tiles_y <= 0)
+        return;
+
+    int first_wave = threadpool_get_count() + 1;
+    for (int rank = 0; rank < tiles_x * tiles_y; rank++)
+    {
+        int tile = order[rank];
+        char text[12];
+        snprintf(text, sizeof(text), "%d", rank);
+        hud_draw_text(font, (tile % tiles_x) * tile_size + 2, (tile / tiles_x) * tile_size + 2,
+                      text, rank < first_wave ? 0xFFFFFF00 : 0xFFC0C0C0);
+    }
+}
+
 void hud_draw_fps(const Font *font, float dt)
 {
     static float smoothed_fps = -1.0f;
@@ -656,40 +682,79 @@ int hud_draw_pause_menu(const Font *font, int mx, int my, bool clicked, bool mou
 
 void hud_draw_cull_stats(const Font *font, const RenderStats *stats, int total_entities)
 {
+    char lines[9][32];
+    uint32_t colors[9];
+    int num_lines = 0;
+
     // Line 1: visible entities
-    char buf1[32];
     int visible = total_entities - stats->entities_culled;
-    snprintf(buf1, sizeof(buf1), "ENT:%d/%d", visible, total_entities);
+    snprintf(lines[num_lines], sizeof(lines[0]), "ENT:%d/%d", visible, total_entities);
+    colors[num_lines++] = 0xFF00CCFF;
 
     // Line 2: triangles drawn / backface-culled
-    char buf2[32];
-    snprintf(buf2, sizeof(buf2), "TRI:%d BF:%d", stats->triangles_drawn, stats->backface_culled);
+    snprintf(lines[num_lines], sizeof(lines[0]), "TRI:%d BF:%d", stats->triangles_drawn, stats->backface_culled);
+    colors[num_lines++] = 0xFF00CCFF;
 
     // Line 3: clip-skipped triangles (trivially accepted)
-    char buf3[32];
-    snprintf(buf3, sizeof(buf3), "CL:%d skip", stats->clip_trivial);
+    snprintf(lines[num_lines], sizeof(lines[0]), "CL:%d skip", stats->clip_trivial);
+    colors[num_lines++] = 0xFF00CCFF;
 
     // Line 4: chunk stats (only shown when chunks are active)
-    char buf4[32];
-    int num_lines = 3;
     if (stats->chunks_total > 0)
     {
         int ch_visible = stats->chunks_total - stats->chunks_culled;
-        snprintf(buf4, sizeof(buf4), "CHK:%d/%d", ch_visible, stats->chunks_total);
-        num_lines = 4;
+        snprintf(lines[num_lines], sizeof(lines[0]), "CHK:%d/%d", ch_visible, stats->chunks_total);
+        colors[num_lines++] = 0xFF88FF88;
+    }
+
+    // Line 5: tile bin sizes (only shown in threaded mode)
+    if (stats->bin_active > 0)
+    {
+        snprintf(lines[num_lines], sizeof(lines[0]), "BIN:%d AVG:%d MX:%d",
+                 stats->bin_entries, stats->bin_entries / stats->bin_active, stats->bin_max);
+        colors[num_lines++] = 0xFFFFAA44;
+    }
+
+    // Line 6: render commands and vertices this frame / high-water mark (threaded mode)
+    if (stats->cmd_count > 0)
+    {
+        snprintf(lines[num_lines], sizeof(lines[0]), "CMD:%d VTX:%d HWM:%d",
+                 stats->cmd_count, stats->cmd_vertices, stats->cmd_high_water);
+        colors[num_lines++] = 0xFFFFAA44;
+    }
+
+    // Line 7: Hi-Z rejections (tiles / 8x8 blocks)
+    if (stats->hiz_tiles_rejected > 0 || stats->hiz_blocks_rejected > 0)
+    {
+        snprintf(lines[num_lines], sizeof(lines[0]), "HIZ:%d BLK:%d",
+                 stats->hiz_tiles_rejected, stats->hiz_blocks_rejected);
+        colors[num_lines++] = 0xFFAA88FF;
     }
 
-    int len1 = (int)strlen(buf1) * FONT_GLYPH_W;
-    int len2 = (int)strlen(buf2) * FONT_GLYPH_W;
-    int len3 = (int)strlen(buf3) * FONT_GLYPH_W;
-    int text_w = len1 > len2 ? len1 : len2;
-    if (len3 > text_w)
-        text_w = len3;
-    if (num_lines == 4)
+    // Line 8: pixels depth-tested (K) and the share that passed and was shaded
+    if (stats->pixels_tested > 0)
     {
-        int len4 = (int)strlen(buf4) * FONT_GLYPH_W;
-        if (len4 > text_w)
-            text_w = len4;
+        snprintf(lines[num_lines], sizeof(lines[0]), "PIX:%dK PASS:%d%% SHD:%d%%",
+                 stats->pixels_tested / 1000,
+                 (int)((int64_t)stats->pixels_passed * 100 / stats->pixels_tested),
+                 (int)((int64_t)stats->pixels_shaded * 100 / stats->pixels_tested));
+        colors[num_lines++] = 0xFFFF88CC;
+    }
+
+    // Line 9: overdraw, written pixels per visible pixel (overdraw view only)
+    if (stats->pixels_visible > 0)
+    {
+        snprintf(lines[num_lines], sizeof(lines[0]), "OVR:%.2f VIS:%dK",
+                 (double)stats->pixels_passed / stats->pixels_visible, stats->pixels_visible / 1000);
+        colors[num_lines++] = 0xFFFF88CC;
+    }
+
+    int text_w = 0;
+    for (int i = 0; i < num_lines; i++)
+    {
+        int len = (int)strlen(lines[i]) * FONT_GLYPH_W;
+        if (len > text_w)
+            text_w = len;
     }
     int x = RENDER_WIDTH - text_w - 6;
     int y = 2;
@@ -697,18 +762,45 @@ void hud_draw_cull_stats(const Font *font, const RenderStats *stats, int total_e
 
     hud_blit_rect(x - 2, y, text_w + 4, line_h * num_lines + 4, 0xFF0A0A0A);
 
-    hud_draw_text(font, x + 1, y + 3, buf1, 0xFF000000);
-    hud_draw_text(font, x, y + 2, buf1, 0xFF00CCFF);
+    for (int i = 0; i < num_lines; i++)
+    {
+        hud_draw_text(font, x + 1, y + 3 + line_h * i, lines[i], 0xFF000000);
+        hud_draw_text(font, x, y + 2 + line_h * i, lines[i], colors[i]);
+    }
+}
+
+void hud_draw_profile(const Font *font)
+{
+    char lines[PROFILE_STAGE_COUNT][32];
+    float ms[PROFILE_STAGE_COUNT];
+    float max_ms = 0.0f;
+
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++)
+    {
+        ms[i] = profile_get_stage_ms((ProfileStage)i);
+        if (ms[i] > max_ms)
+            max_ms = ms[i];
+        snprintf(lines[i], sizeof(lines[0]), "%-9s%6.2f", profile_get_stage_name((ProfileStage)i), ms[i]);
+    }
 
-    hud_draw_text(font, x + 1, y + 3 + line_h, buf2, 0xFF000000);
-    hud_draw_text(font, x, y + 2 + line_h, buf2, 0xFF00CCFF);
+    // Below the FPS counter; stages summed over threads, so raster and
+    // geometry can exceed the frame time
+    int bar_w = 48;
+    int text_w = (int)strlen(lines[0]) * FONT_GLYPH_W;
+    int x = 4;
+    int y = FONT_GLYPH_H + 8;
+    int line_h = FONT_GLYPH_H + 2;
 
-    hud_draw_text(font, x + 1, y + 3 + line_h * 2, buf3, 0xFF000000);
-    hud_draw_text(font, x, y + 2 + line_h * 2, buf3, 0xFF00CCFF);
+    hud_blit_rect(x - 2, y, text_w + bar_w + 10, line_h * PROFILE_STAGE_COUNT + 4, 0xFF0A0A0A);
 
-    if (num_lines == 4)
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++)
     {
-        hud_draw_text(font, x + 1, y + 3 + line_h * 3, buf4, 0xFF000000);
-        hud_draw_text(font, x, y + 2 + line_h * 3, buf4, 0xFF88FF88);
+        int ly = y + 2 + line_h * i;
+        hud_draw_text(font, x + 1, ly + 1, lines[i], 0xFF000000);
+        hud_draw_text(font, x, ly, lines[i], 0xFFFFCC44);
+
+        int w = max_ms > 0.0f ? (int)(ms[i] / max_ms * (float)bar_w) : 0;
+        if (w > 0)
+            hud_blit_rect(x + text_w + 4, ly + 1, w, FONT_GLYPH_H - 2, 0xFF44AAFF);
     }
 }
@@ -24,6 +24,7 @@ void hud_draw_char(const Font *font, int x, int y, char c, uint32_t color);
 void hud_draw_text(const Font *font, int x, int y, const char *text, uint32_t color);
 void hud_draw_crosshair(uint32_t color);
 void hud_draw_fps(const Font *font, float dt);
+void hud_draw_tile_ranks(const Font *font);
 
 typedef enum
 {
@@ -48,5 +49,7 @@ typedef struct
 
 int hud_draw_pause_menu(const Font *font, int mx, int my, bool clicked, bool mouse_down, int scroll_delta, MenuState *state, MenuData *data);
 void hud_draw_cull_stats(const Font *font, const struct RenderStats *stats, int total_entities);
+// Smoothed per-stage milliseconds from the profiler, top left
+void hud_draw_profile(const Font *font);
 
 #endif
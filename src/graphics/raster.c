@@ -0,0 +1,238 @@
+#include "graphics/raster.h"
+#include <stddef.h>
+
+typedef struct
+{
+    const RasterTarget *rt;
+    const TriSetup *ts;
+    uint32_t color;
+    const Texture *tex;
+    int light_fixed;
+} ScalarBlockCtx;
+
+// Clip a block's pixel range to the triangle bounds and find the edge values
+// at its first pixel; false if the block misses the bounds
+static bool scalar_block_setup(const TriSetup *ts, int *x0, int *y0, int *x1, int *y1,
+                               int32_t e_row[3])
+{
+    if (!raster_clip_rect(ts, *x0, *y0, *x1, *y1, x0, y0, x1, y1))
+        return false;
+
+    int ox = *x0 - ts->min_x;
+    int oy = *y0 - ts->min_y;
+    for (int i = 0; i < 3; i++)
+        e_row[i] = ts->e_c[i] + ts->e_dx[i] * ox + ts->e_dy[i] * oy;
+    return true;
+}
+
+// Depth test and shade one covered pixel at column fx of the bounds
+static inline bool flat_pixel(const ScalarBlockCtx *ctx, int idx, float fx,
+                              float z_row, float iw_row)
+{
+    const RasterTarget *rt = ctx->rt;
+    const TriSetup *ts = ctx->ts;
+    float z = z_row + ts->z.dx * fx;
+    if (!(z < rt->depth[idx]))
+        return false;
+
+    rt->depth[idx] = z;
+    rt->color[idx] = rt->fog_enabled
+                         ? raster_fog(rt, ctx->color, 1.0f / (iw_row + ts->inv_w.dx * fx))
+                         : ctx->color;
+    raster_count_overdraw(rt, idx);
+    return true;
+}
+
+static inline bool textured_pixel(const ScalarBlockCtx *ctx, int idx, float fx,
+                                  float z_row, float iw_row, float uw_row, float vw_row)
+{
+    const RasterTarget *rt = ctx->rt;
+    const TriSetup *ts = ctx->ts;
+    float z = z_row + ts->z.dx * fx;
+    if (!(z < rt->depth[idx]))
+        return false;
+
+    float w = 1.0f / (iw_row + ts->inv_w.dx * fx);
+    float u = (uw_row + ts->u_w.dx * fx) * w;
+    float v = (vw_row + ts->v_w.dx * fx) * w;
+    uint32_t lit = raster_shade_texel(texture_sample(ctx->tex, u, v), ctx->light_fixed);
+
+    rt->depth[idx] = z;
+    rt->color[idx] = raster_fog(rt, lit, w);
+    raster_count_overdraw(rt, idx);
+    return true;
+}
+
+static bool raster_flat_block(void *p, int bx, int by, int x0, int y0, int x1, int y1,
+                              bool inside)
+{
+    (void)bx;
+    (void)by;
+    const ScalarBlockCtx *ctx = p;
+    const TriSetup *ts = ctx->ts;
+    int32_t e_row[3];
+    if (!scalar_block_setup(ts, &x0, &y0, &x1, &y1, e_row))
+        return false;
+
+    int tested = 0, passed = 0;
+    for (int y = y0; y <= y1; y++)
+    {
+        float z_row = raster_interp_row(&ts->z, y - ts->min_y);
+        float iw_row = raster_interp_row(&ts->inv_w, y - ts->min_y);
+        int idx = y * ctx->rt->width + x0;
+
+        if (inside)
+        {
+            for (int x = x0; x <= x1; x++, idx++)
+                passed += flat_pixel(ctx, idx, (float)(x - ts->min_x), z_row, iw_row);
+            tested += x1 - x0 + 1;
+            continue;
+        }
+
+        int32_t e0 = e_row[0], e1 = e_row[1], e2 = e_row[2];
+        for (int x = x0; x <= x1; x++, idx++)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                passed += flat_pixel(ctx, idx, (float)(x - ts->min_x), z_row, iw_row);
+                tested++;
+            }
+            e0 += ts->e_dx[0];
+            e1 += ts->e_dx[1];
+            e2 += ts->e_dx[2];
+        }
+
+        e_row[0] += ts->e_dy[0];
+        e_row[1] += ts->e_dy[1];
+        e_row[2] += ts->e_dy[2];
+    }
+    raster_count_pixels(ctx->rt, tested, passed, passed);
+    return passed > 0;
+}
+
+static bool raster_textured_block(void *p, int bx, int by, int x0, int y0, int x1, int y1,
+                                  bool inside)
+{
+    (void)bx;
+    (void)by;
+    const ScalarBlockCtx *ctx = p;
+    const TriSetup *ts = ctx->ts;
+    int32_t e_row[3];
+    if (!scalar_block_setup(ts, &x0, &y0, &x1, &y1, e_row))
+        return false;
+
+    int tested = 0, passed = 0;
+    for (int y = y0; y <= y1; y++)
+    {
+        int iy = y - ts->min_y;
+        float z_row = raster_interp_row(&ts->z, iy);
+        float iw_row = raster_interp_row(&ts->inv_w, iy);
+        float uw_row = raster_interp_row(&ts->u_w, iy);
+        float vw_row = raster_interp_row(&ts->v_w, iy);
+        int idx = y * ctx->rt->width + x0;
+
+        if (inside)
+        {
+            for (int x = x0; x <= x1; x++, idx++)
+                passed += textured_pixel(ctx, idx, (float)(x - ts->min_x), z_row, iw_row, uw_row, vw_row);
+            tested += x1 - x0 + 1;
+            continue;
+        }
+
+        int32_t e0 = e_row[0], e1 = e_row[1], e2 = e_row[2];
+        for (int x = x0; x <= x1; x++, idx++)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                passed += textured_pixel(ctx, idx, (float)(x - ts->min_x), z_row, iw_row, uw_row, vw_row);
+                tested++;
+            }
+            e0 += ts->e_dx[0];
+            e1 += ts->e_dx[1];
+            e2 += ts->e_dx[2];
+        }
+
+        e_row[0] += ts->e_dy[0];
+        e_row[1] += ts->e_dy[1];
+        e_row[2] += ts->e_dy[2];
+    }
+    raster_count_pixels(ctx->rt, tested, passed, passed);
+    return passed > 0;
+}
+
+// Flat-shaded kernel over the inclusive rect (rx0, ry0) - (rx1, ry1)
+static void raster_flat(const RasterTarget *rt, const TriSetup *ts, uint32_t color,
+                        int rx0, int ry0, int rx1, int ry1)
+{
+    ScalarBlockCtx ctx = {.rt = rt, .ts = ts, .color = color};
+    raster_walk_blocks(rt, ts, rx0, ry0, rx1, ry1, raster_flat_block, &ctx);
+}
+
+// Perspective-correct textured kernel over the inclusive rect
+static void raster_textured(const RasterTarget *rt, const TriSetup *ts,
+                            const Texture *tex, float light,
+                            int rx0, int ry0, int rx1, int ry1)
+{
+    ScalarBlockCtx ctx = {.rt = rt, .ts = ts, .tex = tex, .light_fixed = raster_light_fixed(light)};
+    raster_walk_blocks(rt, ts, rx0, ry0, rx1, ry1, raster_textured_block, &ctx);
+}
+
+static void raster_composite(uint32_t *color, float *depth,
+                             const uint32_t *src_color, const float *src_depth, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (src_depth[i] < depth[i])
+        {
+            depth[i] = src_depth[i];
+            color[i] = src_color[i];
+        }
+    }
+}
+
+const RasterKernels raster_kernels_scalar = {
+    .name = "scalar",
+    .lanes = 1,
+    .flat = raster_flat,
+    .textured = raster_textured,
+    .composite = raster_composite,
+};
+
+RenderSimdIsa raster_detect_isa(void)
+{
+#ifdef USE_SIMD
+    // cpuid-backed; also checks that the OS saves the wider register state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return RENDER_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return RENDER_SIMD_AVX2;
+#endif
+    return RENDER_SIMD_SSE2;
+}
+
+const RasterKernels *raster_get_kernels(RenderSimdIsa isa)
+{
+#ifdef USE_SIMD
+    RenderSimdIsa best = raster_detect_isa();
+    if (isa == RENDER_SIMD_AUTO)
+        isa = best;
+    if (isa > best)
+        return NULL;
+
+    switch (isa)
+    {
+    case RENDER_SIMD_SSE2:
+        return &raster_kernels_sse2;
+    case RENDER_SIMD_AVX2:
+        return &raster_kernels_avx2;
+    case RENDER_SIMD_AVX512:
+        return &raster_kernels_avx512;
+    default:
+        return NULL;
+    }
+#else
+    (void)isa;
+    return NULL;
+#endif
+}
@@ -0,0 +1,351 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+// Raster kernels shared by render.c and the per-ISA kernel builds.
+// Not part of the public render API.
+
+#include "graphics/render.h"
+#include "graphics/texture.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <float.h>
+
+// Sub-pixel precision of snapped vertex positions (28.4 fixed point)
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE / 2)
+
+// Screen-space linear interpolant, evaluated at pixel centers:
+// value(px, py) = c + dx * (px - min_x) + dy * (py - min_y)
+typedef struct
+{
+    float c;
+    float dx, dy;
+} Interp;
+
+// Per-triangle setup shared by every raster kernel. Edge functions are
+// integers in 1/256 pixel^2 units; the top-left fill rule is folded into e_c,
+// so a pixel is covered when all three edge values are >= 0.
+typedef struct
+{
+    int min_x, min_y, max_x, max_y; // Covered pixel bounds, clipped to screen (inclusive)
+    int32_t e_dx[3], e_dy[3];       // Edge step per pixel in x and y
+    int32_t e_c[3];                 // Edge values at pixel (min_x, min_y)
+    Interp z;
+    float z_min; // Nearest vertex depth, for Hi-Z rejection
+    Interp inv_w;
+    Interp u_w, v_w; // u/w and v/w, textured triangles only
+} TriSetup;
+
+// Hierarchical Z: the farthest depth stored in every 8x8 block and every
+// 32x32 tile of the depth buffer. Kernels walk the screen block by block and
+// skip any tile or block whose stored max is not behind the triangle's
+// nearest depth. Callers must hand kernels rects aligned to HIZ_TILE_SIZE,
+// so no two threads share a Hi-Z tile.
+#define HIZ_BLOCK_SHIFT 3
+#define HIZ_BLOCK_SIZE (1 << HIZ_BLOCK_SHIFT)
+#define HIZ_TILE_SHIFT 5
+#define HIZ_TILE_SIZE (1 << HIZ_TILE_SHIFT)
+#define HIZ_TILE_BLOCKS (HIZ_TILE_SIZE / HIZ_BLOCK_SIZE)
+
+// Work counters a kernel adds to; one set per thread, summed by render.c
+typedef struct
+{
+    int hiz_tiles_rejected;  // Triangle/tile pairs rejected by the tile max
+    int hiz_blocks_rejected; // 8x8 blocks rejected by the block max
+    int pixels_tested;       // Covered pixels depth-tested
+    int pixels_passed;       // Pixels that passed the depth test and were written
+    int pixels_shaded;       // Pixels shading was computed for; SIMD kernels
+                             // shade every lane of a chunk with any pass
+} RasterCounters;
+
+// Buffers and fog state a kernel draws with
+typedef struct
+{
+    uint32_t *color;
+    float *depth;
+    int width, height;
+    float *hiz_block; // Max depth per 8x8 block, NULL when Hi-Z is off
+    float *hiz_tile;  // Max depth per 32x32 tile
+    int hiz_blocks_x, hiz_tiles_x;
+    RasterCounters *counters;
+    uint16_t *overdraw; // Depth-passing writes per pixel, NULL unless the overdraw view is on
+    bool fog_enabled;
+    float fog_start;
+    float fog_scale; // 256 / (fog_end - fog_start)
+    uint32_t fog_color;
+} RasterTarget;
+
+typedef void (*RasterFlatFunc)(const RasterTarget *rt, const TriSetup *ts, uint32_t color,
+                               int rx0, int ry0, int rx1, int ry1);
+typedef void (*RasterTexturedFunc)(const RasterTarget *rt, const TriSetup *ts,
+                                   const Texture *tex, float light,
+                                   int rx0, int ry0, int rx1, int ry1);
+// Depth-merge count pixels of a private buffer into the target: a source
+// pixel replaces the target's where its depth is strictly nearer, so of
+// two equal depths the one already in the target stays
+typedef void (*RasterCompositeFunc)(uint32_t *color, float *depth,
+                                    const uint32_t *src_color, const float *src_depth, int count);
+
+// One kernel set per instruction set; rects are inclusive pixel bounds
+typedef struct
+{
+    const char *name;
+    int lanes;
+    RasterFlatFunc flat;
+    RasterTexturedFunc textured;
+    RasterCompositeFunc composite;
+} RasterKernels;
+
+extern const RasterKernels raster_kernels_scalar;
+#ifdef USE_SIMD
+extern const RasterKernels raster_kernels_sse2;
+extern const RasterKernels raster_kernels_avx2;
+extern const RasterKernels raster_kernels_avx512;
+#endif
+
+// Best instruction set the running CPU supports
+RenderSimdIsa raster_detect_isa(void);
+
+// Kernel set for an instruction set; NULL if not built in or not supported
+// by this CPU. RENDER_SIMD_AUTO resolves to raster_detect_isa().
+const RasterKernels *raster_get_kernels(RenderSimdIsa isa);
+
+// Shading runs in 8.8 fixed point so the scalar and SIMD kernels agree
+// bit for bit: each channel becomes (c * f) >> 8 with f in [0, 256].
+static inline uint32_t raster_scale_rgb(uint32_t c, int f)
+{
+    uint32_t rb = (((c & 0x00FF00FF) * (uint32_t)f) >> 8) & 0x00FF00FF;
+    uint32_t g = ((((c >> 8) & 0xFF) * (uint32_t)f) >> 8) & 0xFF;
+    return rb | (g << 8);
+}
+
+static inline int raster_light_fixed(float light)
+{
+    float l = light * 256.0f;
+    l = l > 0.0f ? l : 0.0f;
+    l = l < 256.0f ? l : 256.0f;
+    return (int)l;
+}
+
+static inline uint32_t raster_shade_texel(uint32_t tex_color, int light)
+{
+    return 0xFF000000 | raster_scale_rgb(tex_color, light);
+}
+
+// Pixel work of one block, added once per block rather than per pixel
+static inline void raster_count_pixels(const RasterTarget *rt, int tested, int passed, int shaded)
+{
+    rt->counters->pixels_tested += tested;
+    rt->counters->pixels_passed += passed;
+    rt->counters->pixels_shaded += shaded;
+}
+
+// One depth-passing write to pixel idx for the overdraw view. Sort-last
+// shares draw the same screen pixels at once, hence the atomic.
+static inline void raster_count_overdraw(const RasterTarget *rt, int idx)
+{
+    if (rt->overdraw)
+        __atomic_fetch_add(&rt->overdraw[idx], 1, __ATOMIC_RELAXED);
+}
+
+// Fog weight in [0, 256] for view depth w
+static inline int raster_fog_factor(const RasterTarget *rt, float w)
+{
+    float t = (w - rt->fog_start) * rt->fog_scale;
+    t = t > 0.0f ? t : 0.0f;
+    t = t < 256.0f ? t : 256.0f;
+    return (int)t;
+}
+
+static inline uint32_t raster_fog(const RasterTarget *rt, uint32_t color, float w)
+{
+    if (!rt->fog_enabled)
+        return color;
+
+    int f = raster_fog_factor(rt, w);
+    return 0xFF000000 | (raster_scale_rgb(color, 256 - f) + raster_scale_rgb(rt->fog_color, f));
+}
+
+// Interpolants are evaluated directly rather than accumulated, as
+// (c + dy * iy) + dx * ix, so every kernel and lane width produces the
+// same value for a given pixel
+static inline float raster_interp_row(const Interp *in, int iy)
+{
+    return in->c + in->dy * (float)iy;
+}
+
+// Clip the triangle's bounds to a raster rect; false if nothing is left
+static inline bool raster_clip_rect(const TriSetup *ts, int rx0, int ry0, int rx1, int ry1,
+                                    int *x0, int *y0, int *x1, int *y1)
+{
+    *x0 = ts->min_x > rx0 ? ts->min_x : rx0;
+    *y0 = ts->min_y > ry0 ? ts->min_y : ry0;
+    *x1 = ts->max_x < rx1 ? ts->max_x : rx1;
+    *y1 = ts->max_y < ry1 ? ts->max_y : ry1;
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+// Recompute the max depth of block (bx, by) after a kernel wrote to it
+static inline void raster_hiz_update_block(const RasterTarget *rt, int bx, int by)
+{
+    int x0 = bx << HIZ_BLOCK_SHIFT;
+    int y0 = by << HIZ_BLOCK_SHIFT;
+    int x1 = x0 + HIZ_BLOCK_SIZE < rt->width ? x0 + HIZ_BLOCK_SIZE : rt->width;
+    int y1 = y0 + HIZ_BLOCK_SIZE < rt->height ? y0 + HIZ_BLOCK_SIZE : rt->height;
+
+    float z_max = -FLT_MAX;
+    for (int y = y0; y < y1; y++)
+    {
+        const float *row = &rt->depth[y * rt->width];
+        for (int x = x0; x < x1; x++)
+        {
+            if (row[x] > z_max)
+                z_max = row[x];
+        }
+    }
+    rt->hiz_block[by * rt->hiz_blocks_x + bx] = z_max;
+}
+
+// Recompute the max depth of tile (tx, ty) from its blocks
+static inline void raster_hiz_update_tile(const RasterTarget *rt, int tx, int ty)
+{
+    int bx0 = tx * HIZ_TILE_BLOCKS;
+    int by0 = ty * HIZ_TILE_BLOCKS;
+    int blocks_y = (rt->height + HIZ_BLOCK_SIZE - 1) >> HIZ_BLOCK_SHIFT;
+    int bx1 = bx0 + HIZ_TILE_BLOCKS < rt->hiz_blocks_x ? bx0 + HIZ_TILE_BLOCKS : rt->hiz_blocks_x;
+    int by1 = by0 + HIZ_TILE_BLOCKS < blocks_y ? by0 + HIZ_TILE_BLOCKS : blocks_y;
+
+    float z_max = -FLT_MAX;
+    for (int by = by0; by < by1; by++)
+    {
+        for (int bx = bx0; bx < bx1; bx++)
+        {
+            float z = rt->hiz_block[by * rt->hiz_blocks_x + bx];
+            if (z > z_max)
+                z_max = z;
+        }
+    }
+    rt->hiz_tile[ty * rt->hiz_tiles_x + tx] = z_max;
+}
+
+// Nearest depth the triangle's plane reaches over pixels (x0, y0) - (x1, y1);
+// the plane is linear, so the minimum sits on a corner
+static inline float raster_plane_z_min(const TriSetup *ts, int x0, int y0, int x1, int y1)
+{
+    int ix = (ts->z.dx >= 0.0f ? x0 : x1) - ts->min_x;
+    int iy = (ts->z.dy >= 0.0f ? y0 : y1) - ts->min_y;
+    float z = raster_interp_row(&ts->z, iy) + ts->z.dx * (float)ix;
+    return z > ts->z_min ? z : ts->z_min;
+}
+
+// Coverage of an 8x8 block by a triangle
+typedef enum
+{
+    RASTER_BLOCK_OUTSIDE,
+    RASTER_BLOCK_PARTIAL,
+    RASTER_BLOCK_INSIDE,
+} RasterBlockCover;
+
+// Classify the block at pixel (px0, py0) against the three edges. Edge
+// functions are linear, so their extremes over the block sit on its corners.
+static inline RasterBlockCover raster_classify_block(const TriSetup *ts, int px0, int py0)
+{
+    int64_t ix = px0 - ts->min_x;
+    int64_t iy = py0 - ts->min_y;
+    bool inside = true;
+    for (int i = 0; i < 3; i++)
+    {
+        int64_t e = ts->e_c[i] + ts->e_dx[i] * ix + ts->e_dy[i] * iy;
+        int64_t sx = (int64_t)ts->e_dx[i] * (HIZ_BLOCK_SIZE - 1);
+        int64_t sy = (int64_t)ts->e_dy[i] * (HIZ_BLOCK_SIZE - 1);
+        int64_t hi = e + (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+        int64_t lo = e + (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+        if (hi < 0)
+            return RASTER_BLOCK_OUTSIDE;
+        if (lo < 0)
+            inside = false;
+    }
+    return inside ? RASTER_BLOCK_INSIDE : RASTER_BLOCK_PARTIAL;
+}
+
+// Block kernel: draws the pixels of the 8x8 block at (bx, by) (pixel
+// origin) that lie inside (x0, y0) - (x1, y1); returns true if it wrote depth.
+// With inside set the triangle covers the whole block and edge tests can
+// be skipped.
+typedef bool (*RasterBlockFunc)(void *ctx, int bx, int by, int x0, int y0, int x1, int y1,
+                                bool inside);
+
+// Visit the blocks the triangle's bounds cover inside a raster rect, tile by
+// tile. Blocks outside an edge and blocks Hi-Z proves hidden are skipped;
+// Hi-Z is refreshed after writes.
+static inline void raster_walk_blocks(const RasterTarget *rt, const TriSetup *ts,
+                                      int rx0, int ry0, int rx1, int ry1,
+                                      RasterBlockFunc block, void *ctx)
+{
+    int x0, y0, x1, y1;
+    if (!raster_clip_rect(ts, rx0, ry0, rx1, ry1, &x0, &y0, &x1, &y1))
+        return;
+
+    for (int ty = y0 >> HIZ_TILE_SHIFT; ty <= y1 >> HIZ_TILE_SHIFT; ty++)
+    {
+        for (int tx = x0 >> HIZ_TILE_SHIFT; tx <= x1 >> HIZ_TILE_SHIFT; tx++)
+        {
+            if (rt->hiz_tile && ts->z_min >= rt->hiz_tile[ty * rt->hiz_tiles_x + tx])
+            {
+                rt->counters->hiz_tiles_rejected++;
+                continue;
+            }
+
+            int tx0 = tx << HIZ_TILE_SHIFT;
+            int ty0 = ty << HIZ_TILE_SHIFT;
+            int bx0 = (x0 > tx0 ? x0 : tx0) >> HIZ_BLOCK_SHIFT;
+            int by0 = (y0 > ty0 ? y0 : ty0) >> HIZ_BLOCK_SHIFT;
+            int bx1 = (x1 < tx0 + HIZ_TILE_SIZE - 1 ? x1 : tx0 + HIZ_TILE_SIZE - 1) >> HIZ_BLOCK_SHIFT;
+            int by1 = (y1 < ty0 + HIZ_TILE_SIZE - 1 ? y1 : ty0 + HIZ_TILE_SIZE - 1) >> HIZ_BLOCK_SHIFT;
+            bool dirty = false;
+
+            for (int by = by0; by <= by1; by++)
+            {
+                int py0 = by << HIZ_BLOCK_SHIFT;
+                int py1 = py0 + HIZ_BLOCK_SIZE - 1;
+                for (int bx = bx0; bx <= bx1; bx++)
+                {
+                    int px0 = bx << HIZ_BLOCK_SHIFT;
+                    int px1 = px0 + HIZ_BLOCK_SIZE - 1;
+
+                    RasterBlockCover cover = raster_classify_block(ts, px0, py0);
+                    if (cover == RASTER_BLOCK_OUTSIDE)
+                        continue;
+
+                    if (rt->hiz_block)
+                    {
+                        float z_near = raster_plane_z_min(ts,
+                                                          px0 > x0 ? px0 : x0, py0 > y0 ? py0 : y0,
+                                                          px1 < x1 ? px1 : x1, py1 < y1 ? py1 : y1);
+                        if (z_near >= rt->hiz_block[by * rt->hiz_blocks_x + bx])
+                        {
+                            rt->counters->hiz_blocks_rejected++;
+                            continue;
+                        }
+                    }
+
+                    if (block(ctx, px0, py0,
+                              px0 > rx0 ? px0 : rx0, py0 > ry0 ? py0 : ry0,
+                              px1 < rx1 ? px1 : rx1, py1 < ry1 ? py1 : ry1,
+                              cover == RASTER_BLOCK_INSIDE) &&
+                        rt->hiz_block)
+                    {
+                        raster_hiz_update_block(rt, bx, by);
+                        dirty = true;
+                    }
+                }
+            }
+
+            if (dirty)
+                raster_hiz_update_tile(rt, tx, ty);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+// AVX2 raster kernels (8 lanes). Built with -mavx2 and only called after
+// raster_detect_isa() has seen AVX2 support.
+#include "graphics/raster.h"
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+
+#define SIMD_LANES 8
+#define RASTER_KERNELS raster_kernels_avx2
+#define RASTER_ISA_NAME "avx2"
+
+typedef __m256 vfloat;
+typedef __m256i vint;
+typedef __m256i vmask;
+
+static inline vfloat vf_set1(float a) { return _mm256_set1_ps(a); }
+static inline vfloat vf_add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vf_sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat vf_mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vf_rcp(vfloat a) { return _mm256_div_ps(_mm256_set1_ps(1.0f), a); }
+static inline vfloat vf_load(const float *p) { return _mm256_loadu_ps(p); }
+static inline vfloat vf_max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat vf_min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+static inline vfloat vf_from_vi(vint a) { return _mm256_cvtepi32_ps(a); }
+static inline vint vf_to_vi(vfloat a) { return _mm256_cvttps_epi32(a); }
+
+static inline vint vi_set1(int32_t a) { return _mm256_set1_epi32(a); }
+static inline vint vi_add(vint a, vint b) { return _mm256_add_epi32(a, b); }
+static inline vint vi_sub(vint a, vint b) { return _mm256_sub_epi32(a, b); }
+static inline vint vi_or(vint a, vint b) { return _mm256_or_si256(a, b); }
+static inline vint vi_and(vint a, vint b) { return _mm256_and_si256(a, b); }
+static inline vint vi_shl(vint a, int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_shr(vint a, int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_load(const uint32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+
+static inline vmask vi_nonneg(vint a) { return _mm256_cmpgt_epi32(a, _mm256_set1_epi32(-1)); }
+static inline vmask vi_gt(vint a, vint b) { return _mm256_cmpgt_epi32(a, b); }
+static inline vmask vf_lt(vfloat a, vfloat b)
+{
+    return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+static inline vmask vm_and(vmask a, vmask b) { return _mm256_and_si256(a, b); }
+static inline int vm_bits(vmask m) { return _mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+
+static inline vfloat vf_select(vmask m, vfloat a, vfloat b)
+{
+    return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(m));
+}
+
+static inline vint vi_select(vmask m, vint a, vint b) { return _mm256_blendv_epi8(b, a, m); }
+
+static inline void vf_store_mask(float *p, vmask m, vfloat a) { _mm256_maskstore_ps(p, m, a); }
+static inline void vi_store_mask(uint32_t *p, vmask m, vint a)
+{
+    _mm256_maskstore_epi32((int *)p, m, a);
+}
+
+// One chunk is one row
+static inline vfloat vf_load_rows(const float *p, int stride)
+{
+    (void)stride;
+    return vf_load(p);
+}
+static inline void vf_store_mask_rows(float *p, int stride, vmask m, vfloat a)
+{
+    (void)stride;
+    vf_store_mask(p, m, a);
+}
+static inline void vi_store_mask_rows(uint32_t *p, int stride, vmask m, vint a)
+{
+    (void)stride;
+    vi_store_mask(p, m, a);
+}
+
+// Two 8-bit values at bits 0 and 16 of each lane, each scaled by (v * f) >> 8
+static inline vint vi_scale_halves(vint x, vint f)
+{
+    vint f2 = _mm256_or_si256(f, _mm256_slli_epi32(f, 16));
+    return _mm256_srli_epi16(_mm256_mullo_epi16(x, f2), 8);
+}
+
+static inline vint vi_gather(const uint32_t *base, vint idx, vmask m)
+{
+    return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)base, idx, m, 4);
+}
+
+#include "graphics/raster_simd.inc"
+
+#endif // USE_SIMD
@@ -0,0 +1,82 @@
+// AVX-512 raster kernels (16 lanes, mask registers). Built with -mavx512f
+// and only called after raster_detect_isa() has seen AVX-512F support.
+#include "graphics/raster.h"
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+
+#define SIMD_LANES 16
+#define RASTER_KERNELS raster_kernels_avx512
+#define RASTER_ISA_NAME "avx512"
+
+typedef __m512 vfloat;
+typedef __m512i vint;
+typedef __mmask16 vmask;
+
+static inline vfloat vf_set1(float a) { return _mm512_set1_ps(a); }
+static inline vfloat vf_add(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+static inline vfloat vf_sub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+static inline vfloat vf_mul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+static inline vfloat vf_rcp(vfloat a) { return _mm512_div_ps(_mm512_set1_ps(1.0f), a); }
+static inline vfloat vf_load(const float *p) { return _mm512_loadu_ps(p); }
+static inline vfloat vf_max(vfloat a, vfloat b) { return _mm512_max_ps(a, b); }
+static inline vfloat vf_min(vfloat a, vfloat b) { return _mm512_min_ps(a, b); }
+static inline vfloat vf_from_vi(vint a) { return _mm512_cvtepi32_ps(a); }
+static inline vint vf_to_vi(vfloat a) { return _mm512_cvttps_epi32(a); }
+
+static inline vint vi_set1(int32_t a) { return _mm512_set1_epi32(a); }
+static inline vint vi_add(vint a, vint b) { return _mm512_add_epi32(a, b); }
+static inline vint vi_sub(vint a, vint b) { return _mm512_sub_epi32(a, b); }
+static inline vint vi_or(vint a, vint b) { return _mm512_or_si512(a, b); }
+static inline vint vi_and(vint a, vint b) { return _mm512_and_si512(a, b); }
+static inline vint vi_shl(vint a, int n) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_shr(vint a, int n) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_load(const uint32_t *p) { return _mm512_loadu_si512(p); }
+
+static inline vmask vi_nonneg(vint a) { return _mm512_cmpgt_epi32_mask(a, _mm512_set1_epi32(-1)); }
+static inline vmask vi_gt(vint a, vint b) { return _mm512_cmpgt_epi32_mask(a, b); }
+static inline vmask vf_lt(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+static inline vmask vm_and(vmask a, vmask b) { return a & b; }
+static inline int vm_bits(vmask m) { return (int)m; }
+
+static inline vfloat vf_select(vmask m, vfloat a, vfloat b) { return _mm512_mask_blend_ps(m, b, a); }
+static inline vint vi_select(vmask m, vint a, vint b) { return _mm512_mask_blend_epi32(m, b, a); }
+
+static inline void vf_store_mask(float *p, vmask m, vfloat a) { _mm512_mask_storeu_ps(p, m, a); }
+static inline void vi_store_mask(uint32_t *p, vmask m, vint a) { _mm512_mask_storeu_epi32(p, m, a); }
+
+// A chunk is two 8-pixel rows, stride pixels apart. The upper half is
+// addressed 8 lanes early so its lanes land on the second row; masked-off
+// lanes are never touched.
+static inline vfloat vf_load_rows(const float *p, int stride)
+{
+    vfloat lo = _mm512_maskz_loadu_ps(0x00FF, p);
+    return _mm512_mask_loadu_ps(lo, 0xFF00, p + stride - 8);
+}
+static inline void vf_store_mask_rows(float *p, int stride, vmask m, vfloat a)
+{
+    _mm512_mask_storeu_ps(p, m & 0x00FF, a);
+    _mm512_mask_storeu_ps(p + stride - 8, m & 0xFF00, a);
+}
+static inline void vi_store_mask_rows(uint32_t *p, int stride, vmask m, vint a)
+{
+    _mm512_mask_storeu_epi32(p, m & 0x00FF, a);
+    _mm512_mask_storeu_epi32(p + stride - 8, m & 0xFF00, a);
+}
+
+// Two 8-bit values at bits 0 and 16 of each lane, each scaled by (v * f) >> 8.
+// AVX-512F has no 16-bit multiply; the 32-bit product keeps both halves apart.
+static inline vint vi_scale_halves(vint x, vint f)
+{
+    return _mm512_and_si512(_mm512_srli_epi32(_mm512_mullo_epi32(x, f), 8),
+                            _mm512_set1_epi32(0x00FF00FF));
+}
+
+static inline vint vi_gather(const uint32_t *base, vint idx, vmask m)
+{
+    return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base, 4);
+}
+
+#include "graphics/raster_simd.inc"
+
+#endif // USE_SIMD
@@ -0,0 +1,105 @@
+// SSE2 raster kernels (4 lanes); part of the x86-64 baseline, so this file
+// needs no extra compiler flags.
+#include "graphics/raster.h"
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+
+#define SIMD_LANES 4
+#define RASTER_KERNELS raster_kernels_sse2
+#define RASTER_ISA_NAME "sse2"
+
+typedef __m128 vfloat;
+typedef __m128i vint;
+typedef __m128i vmask;
+
+static inline vfloat vf_set1(float a) { return _mm_set1_ps(a); }
+static inline vfloat vf_add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vf_sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat vf_mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vf_rcp(vfloat a) { return _mm_div_ps(_mm_set1_ps(1.0f), a); }
+static inline vfloat vf_load(const float *p) { return _mm_loadu_ps(p); }
+static inline vfloat vf_max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat vf_min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+static inline vfloat vf_from_vi(vint a) { return _mm_cvtepi32_ps(a); }
+static inline vint vf_to_vi(vfloat a) { return _mm_cvttps_epi32(a); }
+
+static inline vint vi_set1(int32_t a) { return _mm_set1_epi32(a); }
+static inline vint vi_add(vint a, vint b) { return _mm_add_epi32(a, b); }
+static inline vint vi_sub(vint a, vint b) { return _mm_sub_epi32(a, b); }
+static inline vint vi_or(vint a, vint b) { return _mm_or_si128(a, b); }
+static inline vint vi_and(vint a, vint b) { return _mm_and_si128(a, b); }
+static inline vint vi_shl(vint a, int n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_shr(vint a, int n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint vi_load(const uint32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+
+static inline vmask vi_nonneg(vint a) { return _mm_cmpgt_epi32(a, _mm_set1_epi32(-1)); }
+static inline vmask vi_gt(vint a, vint b) { return _mm_cmpgt_epi32(a, b); }
+static inline vmask vf_lt(vfloat a, vfloat b) { return _mm_castps_si128(_mm_cmplt_ps(a, b)); }
+static inline vmask vm_and(vmask a, vmask b) { return _mm_and_si128(a, b); }
+static inline int vm_bits(vmask m) { return _mm_movemask_ps(_mm_castsi128_ps(m)); }
+
+// SSE2 has no blendv; select with and/andnot
+static inline vfloat vf_select(vmask m, vfloat a, vfloat b)
+{
+    __m128 mf = _mm_castsi128_ps(m);
+    return _mm_or_ps(_mm_and_ps(mf, a), _mm_andnot_ps(mf, b));
+}
+
+static inline vint vi_select(vmask m, vint a, vint b)
+{
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+static inline void vf_store_mask(float *p, vmask m, vfloat a)
+{
+    _mm_storeu_ps(p, vf_select(m, a, _mm_loadu_ps(p)));
+}
+
+static inline void vi_store_mask(uint32_t *p, vmask m, vint a)
+{
+    _mm_storeu_si128((__m128i *)p, vi_select(m, a, _mm_loadu_si128((const __m128i *)p)));
+}
+
+// One chunk is one row
+static inline vfloat vf_load_rows(const float *p, int stride)
+{
+    (void)stride;
+    return vf_load(p);
+}
+static inline void vf_store_mask_rows(float *p, int stride, vmask m, vfloat a)
+{
+    (void)stride;
+    vf_store_mask(p, m, a);
+}
+static inline void vi_store_mask_rows(uint32_t *p, int stride, vmask m, vint a)
+{
+    (void)stride;
+    vi_store_mask(p, m, a);
+}
+
+// Two 8-bit values at bits 0 and 16 of each lane, each scaled by (v * f) >> 8
+static inline vint vi_scale_halves(vint x, vint f)
+{
+    vint f2 = _mm_or_si128(f, _mm_slli_epi32(f, 16));
+    return _mm_srli_epi16(_mm_mullo_epi16(x, f2), 8);
+}
+
+// No gather before AVX2: fetch the active lanes one by one
+static inline vint vi_gather(const uint32_t *base, vint idx, vmask m)
+{
+    int32_t ids[4];
+    uint32_t out[4] = {0, 0, 0, 0};
+    int bits = vm_bits(m);
+    _mm_storeu_si128((__m128i *)ids, idx);
+    for (int i = 0; i < 4; i++)
+    {
+        if ((bits >> i) & 1)
+            out[i] = base[ids[i]];
+    }
+    return _mm_loadu_si128((const __m128i *)out);
+}
+
+#include "graphics/raster_simd.inc"
+
+#endif // USE_SIMD
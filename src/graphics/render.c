@@ -1,26 +1,43 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
 #include "graphics/render.h"
+#include "graphics/raster.h"
+#include "core/entity.h"
 #include "core/log.h"
+#include "core/profile.h"
 #include "core/threads.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <float.h>
-
-static uint32_t *g_framebuffer = NULL;
-static float *g_zbuffer = NULL;
+#include <math.h>
+#include <time.h>
 
 int g_render_width = DEFAULT_RENDER_WIDTH;
 int g_render_height = DEFAULT_RENDER_HEIGHT;
 
-void render_set_framebuffer(uint32_t *buffer)
-{
-    g_framebuffer = buffer;
-    LOG_INFO("Framebuffer initialized (%dx%d)", RENDER_WIDTH, RENDER_HEIGHT);
-}
-
-void render_set_zbuffer(float *buffer)
+// Guard band: snapped vertices are clamped to [-g_guard_x, W + g_guard_x] x
+// [-g_guard_y, H + g_guard_y]. An edge value is twice the area of a triangle
+// whose corners (two vertices and the pixel it is evaluated at) lie in the
+// band, so in 1/256 pixel^2 units it is at most 256 times the band's area.
+// Keeping that area under 2^23 pixels keeps the edge values, and the int32
+// stepping the kernels do, exact. Starts at one screen on every side and
+// shrinks at high resolutions.
+#define GUARD_BAND_MAX_AREA (1 << 23)
+#define GUARD_BAND_MARGIN 16 // Kernels evaluate edges up to a block past the bounds
+static int g_guard_x = DEFAULT_RENDER_WIDTH;
+static int g_guard_y = DEFAULT_RENDER_HEIGHT;
+
+static void guard_band_update(void)
 {
-    g_zbuffer = buffer;
-    LOG_INFO("Z-buffer initialized");
+    double w = RENDER_WIDTH + GUARD_BAND_MARGIN;
+    double h = RENDER_HEIGHT + GUARD_BAND_MARGIN;
+    double k = sqrt((double)GUARD_BAND_MAX_AREA / (w * h));
+    int gx = (int)((floor(w * k) - w) / 2.0);
+    int gy = (int)((floor(h * k) - h) / 2.0);
+    g_guard_x = gx < 0 ? 0 : gx > RENDER_WIDTH ? RENDER_WIDTH : gx;
+    g_guard_y = gy < 0 ? 0 : gy > RENDER_HEIGHT ? RENDER_HEIGHT : gy;
 }
 
 void render_set_resolution(int width, int height)
@@ -29,8 +46,14 @@ void render_set_resolution(int width, int height)
         width = 80;
     if (height < 60)
         height = 60;
+    // Leaves room for a guard band (see g_guard_x) at every resolution
+    if (width > RENDER_MAX_DIM)
+        width = RENDER_MAX_DIM;
+    if (height > RENDER_MAX_DIM)
+        height = RENDER_MAX_DIM;
     g_render_width = width;
     g_render_height = height;
+    guard_band_update();
     LOG_INFO("Render resolution set to %dx%d", width, height);
 }
 
@@ -42,23 +65,227 @@ static uint32_t g_fog_color = 0xFF818181; // Grey
 static uint32_t g_skybox_top = 0xFF0000AA;    // Deep blue
 static uint32_t g_skybox_bottom = 0xFF808080; // Grey
 
-#define MAX_RENDER_CMDS 65536
-
+// Post-transform vertex, ready for triangle setup: screen position snapped
+// to 28.4 and the perspective-divided attributes
+typedef struct
+{
+    int32_t fx, fy;
+    float z;
+    float inv_w;
+    float u_w, v_w;
+} RenderVertex;
+
+// Indexed triangle, 32 bytes. Winding is normalized and the pixel bounds
+// clipped to the screen at submission; edge and interpolant planes are
+// rebuilt from the vertices by the tile that draws it.
 typedef struct
 {
-    int x0, y0, x1, y1, x2, y2;
-    float z0, z1, z2;
-    float w0, w1, w2;
-    float u0, v0, u1, v1, u2, v2;
-    const Texture *tex;
-    float light;
-    uint32_t color;
-    bool textured;
+    uint32_t v[3];
+    int16_t min_x, min_y, max_x, max_y;
+    union
+    {
+        uint32_t color; // Flat
+        float light;    // Textured
+    };
+    const Texture *tex; // NULL for flat-shaded triangles
 } RenderCmd;
 
-static RenderCmd g_cmd_buffer[MAX_RENDER_CMDS];
-static int g_cmd_count = 0;
-static bool g_threaded = false;
+// Frame arena for vertices or commands: fixed-size blocks, allocated as the
+// count grows and kept for later frames. Elements never move, so an index
+// stays valid until the next render_begin_commands.
+#define CMD_BLOCK_SHIFT 12
+#define CMD_BLOCK_SIZE (1 << CMD_BLOCK_SHIFT)
+#define CMD_BLOCK_MASK (CMD_BLOCK_SIZE - 1)
+
+typedef struct
+{
+    void **blocks;
+    int block_count;
+    int block_capacity;
+    size_t elem_size;
+} BlockArena;
+
+// What one frame draws into and rasterizes from. With pipelining on, a
+// frame rasterizes on the pool while the next one is recorded (and its
+// overlays drawn) in the other slot; g_frame is the slot the calling
+// thread draws into.
+typedef struct
+{
+    uint32_t *framebuffer;
+    float *zbuffer;
+
+    // Hierarchical Z (see raster.h), sized for hiz_width x hiz_height and
+    // reset along with the depth buffer
+    float *hiz_block;
+    float *hiz_tile;
+    int hiz_width;
+    int hiz_height;
+
+    // Overdraw view only: depth-passing writes per pixel, cleared with the
+    // depth buffer while the view is on
+    uint16_t *overdraw;
+    int overdraw_width;
+    int overdraw_height;
+
+    BlockArena cmd_arena;
+    BlockArena vtx_arena;
+    int cmd_count;
+    int vtx_count;
+
+    // Set when the frame is handed to the pool: the kernels and target
+    // (resolution, fog, Hi-Z) its tiles use, and its outstanding tiles
+    const RasterKernels *kernels;
+    RasterTarget target;
+    JobCounter raster;
+    bool in_flight;
+
+    // Sort-last only: outstanding share rasterization, the composite waits on it
+    JobCounter shares;
+    // Strategy the frame was drawn with, and the time from the start of its
+    // flush to its last job (ns), compared by RENDER_THREAD_AUTO
+    RenderThreadMode strategy;
+    bool timed;
+    int64_t start_ns;
+    _Atomic int64_t done_ns;
+} RenderFrame;
+
+static RenderFrame g_frames[2] = {
+    {.cmd_arena = {.elem_size = sizeof(RenderCmd)}, .vtx_arena = {.elem_size = sizeof(RenderVertex)}},
+    {.cmd_arena = {.elem_size = sizeof(RenderCmd)}, .vtx_arena = {.elem_size = sizeof(RenderVertex)}},
+};
+static RenderFrame *g_frame = &g_frames[0];
+static bool g_pipelined = false;
+static int g_frame_lag = 0; // 1 while g_frame holds the previous frame
+static bool g_other_previous = false; // The other slot holds the last frame flushed
+static bool g_swap_on_begin = false;  // Record the next frame into the other slot
+static int g_cmd_high_water = 0; // Most commands recorded in one frame
+
+// Frames with fewer commands are rasterized on the calling thread: waking
+// the pool costs more than the few triangles are worth
+#define RENDER_INLINE_CMDS 64
+static RenderThreadMode g_thread_mode = RENDER_THREAD_OFF;
+
+// Sort-last: one private buffer per share of the command stream. Each share
+// draws into the rect its triangles cover (grown to whole Hi-Z tiles, so
+// its Hi-Z never sees stale depth), and only that rect is cleared and
+// composited.
+#define RENDER_SHARE_MIN_CMDS 256 // Fewer per share is not worth a buffer
+#define RENDER_COMPOSITE_ROWS HIZ_TILE_SIZE
+typedef struct
+{
+    uint32_t *color;
+    float *depth;
+    float *hiz_block;
+    float *hiz_tile;
+    int width, height; // Allocated for
+    int begin, end;    // Commands
+    int x0, y0, x1, y1; // Inclusive rect drawn, x1 < x0 when empty
+} RenderShare;
+
+static RenderShare *g_shares = NULL;
+static int g_share_count = 0;
+static int g_share_capacity = 0;
+
+// RENDER_THREAD_AUTO: each strategy is timed on RENDER_AUTO_PROBE frames
+// (the best one counts), then the faster runs for RENDER_AUTO_HOLD frames
+// or until the command count halves or doubles, and the probe starts over
+#define RENDER_AUTO_PROBE 4
+#define RENDER_AUTO_HOLD 600
+static RenderThreadMode g_auto_choice = RENDER_THREAD_TILES;
+static int g_auto_hold = 0;
+static int g_auto_cmds = 0;
+static int g_auto_samples[2] = {0};
+static int64_t g_auto_best[2] = {0};
+
+// Parallel command recording. A front end splits its work into batches;
+// the thread running a batch appends to its own list (slot 0 for non-pool
+// threads, worker + 1 otherwise), and render_merge_batches copies the
+// batches into the arena in batch order, as if recorded serially.
+typedef struct
+{
+    RenderCmd *cmds;
+    int count;
+    int capacity;
+    RenderVertex *verts;
+    int vtx_count;
+    int vtx_capacity;
+} CmdList;
+
+typedef struct
+{
+    int list;
+    int start, end;
+    int vtx_start, vtx_end;
+} CmdBatch;
+
+// One per pool worker plus one (index 0) for every other thread
+static CmdList *g_thread_cmds = NULL;
+static int g_thread_cmd_count = 0;
+static CmdBatch *g_batches = NULL;
+static int g_batch_count = 0;
+static int g_batch_capacity = 0;
+
+static __thread CmdList *t_cmd_list = NULL; // Set between begin/end_batch
+static __thread int t_batch = -1;
+
+// Active kernel set: scalar, or g_simd_kernels while SIMD is enabled.
+// g_simd_kernels starts as the best ISA the CPU supports.
+static const RasterKernels *g_kernels = &raster_kernels_scalar;
+static const RasterKernels *g_simd_kernels = NULL;
+static bool g_simd_enabled = false;
+
+// Per-tile triangle bins, rebuilt by render_flush_commands.
+// Bin t holds g_bin_cmds[g_bin_offsets[t] .. g_bin_offsets[t + 1]) in submission order.
+static int *g_bin_offsets = NULL;
+static int *g_bin_cursor = NULL;
+static int *g_bin_cmds = NULL;
+static int g_bin_tile_capacity = 0;
+static int g_bin_cmd_capacity = 0;
+static int g_bin_tiles_x = 0;
+static int g_bin_tile_size = 0;
+
+// Time each tile took in its last flush (ns), the scheduler's cost estimate
+static uint32_t *g_tile_cost = NULL;
+
+// Edge of the square tiles commands are binned into. Always a multiple of
+// HIZ_TILE_SIZE, so every Hi-Z tile belongs to exactly one raster tile.
+// Picked per resolution and pool size unless forced.
+#define RENDER_TILE_MAX (8 * HIZ_TILE_SIZE)
+// Tiles wanted per pool thread, so the scheduler has room to balance
+#define RENDER_TILES_PER_THREAD 8
+// Cache budget for a tile's color and depth when the CPU reports none
+#define RENDER_TILE_CACHE_DEFAULT (128 * 1024)
+static int g_tile_size = HIZ_TILE_SIZE;
+static int g_tile_size_forced = 0;
+static int g_tile_size_key[3] = {0}; // Width, height and threads it was picked for
+
+// Bin statistics for the last flush
+static int g_flush_cmds = 0;
+static int g_flush_vertices = 0;
+static int g_bin_entries = 0;
+static int g_bin_max = 0;
+static int g_bin_active = 0;
+
+static bool g_hiz_enabled = true;
+static bool g_overdraw_enabled = false;
+
+// Kernel counters since the last render_collect_stats. Immediate-mode draws
+// count into g_raster_counters; tiles add their totals atomically.
+static RasterCounters g_raster_counters;
+static atomic_int g_tile_hiz_tiles_rejected;
+static atomic_int g_tile_hiz_blocks_rejected;
+static atomic_int g_tile_pixels_tested;
+static atomic_int g_tile_pixels_passed;
+static atomic_int g_tile_pixels_shaded;
+
+static void tile_counters_add(const RasterCounters *c)
+{
+    atomic_fetch_add(&g_tile_hiz_tiles_rejected, c->hiz_tiles_rejected);
+    atomic_fetch_add(&g_tile_hiz_blocks_rejected, c->hiz_blocks_rejected);
+    atomic_fetch_add(&g_tile_pixels_tested, c->pixels_tested);
+    atomic_fetch_add(&g_tile_pixels_passed, c->pixels_passed);
+    atomic_fetch_add(&g_tile_pixels_shaded, c->pixels_shaded);
+}
 
 void render_set_fog(bool enabled, float start, float end, uint32_t color)
 {
@@ -116,27 +343,102 @@ static uint32_t blend_colors(uint32_t c1, uint32_t c2, float t)
     return 0xFF000000 | (r << 16) | (g << 8) | b;
 }
 
+// Called by everything that starts writing a frame. After a frame that
+// finished on the spot, the next one goes to the other slot anyway so that
+// the slots keep alternating and the next overlapped flush can hand back
+// the frame just before it.
+static void frame_begin(void)
+{
+    if (!g_swap_on_begin)
+        return;
+    g_swap_on_begin = false;
+    g_frame = &g_frames[g_frame == &g_frames[0]];
+    g_other_previous = true;
+}
+
 void render_clear_gradient(void)
 {
+    frame_begin();
     for (int y = 0; y < RENDER_HEIGHT; y++)
     {
         float t = (float)y / (float)RENDER_HEIGHT;
         uint32_t color = blend_colors(g_skybox_top, g_skybox_bottom, t);
         for (int x = 0; x < RENDER_WIDTH; x++)
         {
-            g_framebuffer[y * RENDER_WIDTH + x] = color;
+            g_frame->framebuffer[y * RENDER_WIDTH + x] = color;
+        }
+    }
+}
+
+static int hiz_blocks_x(void) { return (g_frame->hiz_width + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE; }
+static int hiz_tiles_x(void) { return (g_frame->hiz_width + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE; }
+
+// Resize Hi-Z to the current resolution and mark everything as empty
+static void hiz_reset(void)
+{
+    int blocks = ((RENDER_WIDTH + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE) *
+                 ((RENDER_HEIGHT + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE);
+    int tiles = ((RENDER_WIDTH + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE) *
+                ((RENDER_HEIGHT + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE);
+
+    if (g_frame->hiz_width != RENDER_WIDTH || g_frame->hiz_height != RENDER_HEIGHT)
+    {
+        float *block = realloc(g_frame->hiz_block, (size_t)blocks * sizeof(float));
+        if (block)
+            g_frame->hiz_block = block;
+        float *tile = realloc(g_frame->hiz_tile, (size_t)tiles * sizeof(float));
+        if (tile)
+            g_frame->hiz_tile = tile;
+        if (!block || !tile)
+        {
+            LOG_ERROR("Failed to allocate Hi-Z buffers");
+            g_frame->hiz_width = 0;
+            g_frame->hiz_height = 0;
+            return;
+        }
+        g_frame->hiz_width = RENDER_WIDTH;
+        g_frame->hiz_height = RENDER_HEIGHT;
+    }
+
+    for (int i = 0; i < blocks; i++)
+        g_frame->hiz_block[i] = FLT_MAX;
+    for (int i = 0; i < tiles; i++)
+        g_frame->hiz_tile[i] = FLT_MAX;
+}
+
+// Resize the overdraw counts to the current resolution and zero them
+static void overdraw_reset(void)
+{
+    size_t pixels = (size_t)RENDER_WIDTH * RENDER_HEIGHT;
+    if (g_frame->overdraw_width != RENDER_WIDTH || g_frame->overdraw_height != RENDER_HEIGHT)
+    {
+        free(g_frame->overdraw);
+        g_frame->overdraw = malloc(pixels * sizeof(uint16_t));
+        if (!g_frame->overdraw)
+        {
+            LOG_ERROR("Failed to allocate overdraw buffer");
+            g_frame->overdraw_width = 0;
+            g_frame->overdraw_height = 0;
+            return;
         }
+        g_frame->overdraw_width = RENDER_WIDTH;
+        g_frame->overdraw_height = RENDER_HEIGHT;
     }
+    memset(g_frame->overdraw, 0, pixels * sizeof(uint16_t));
 }
 
 void render_clear_zbuffer(void)
 {
-    if (g_zbuffer)
+    frame_begin();
+    if (g_frame->zbuffer)
     {
         for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++)
         {
-            g_zbuffer[i] = FLT_MAX;
+            g_frame->zbuffer[i] = FLT_MAX;
         }
+        hiz_reset();
+        if (g_overdraw_enabled)
+            overdraw_reset();
     }
 }
 
@@ -144,7 +446,7 @@ void render_set_pixel(int x, int y, uint32_t color)
 {
     if (x >= 0 && x < RENDER_WIDTH && y >= 0 && y < RENDER_HEIGHT)
     {
-        g_framebuffer[y * RENDER_WIDTH + x] = color;
+        g_frame->framebuffer[y * RENDER_WIDTH + x] = color;
     }
 }
 
@@ -276,76 +578,74 @@ void render_fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32
     }
 }
 
-static int min3(int a, int b, int c)
+// The engine clips to the frustum first, so only direct callers of the
+// render_fill_triangle_* functions reach the clamp, which bends triangles
+// that stick out of the guard band
+static int32_t snap_subpixel(float v, int limit, int guard)
 {
-    int m = a;
-    if (b < m)
-        m = b;
-    if (c < m)
-        m = c;
-    return m;
+    float lo = (float)-guard;
+    float hi = (float)(limit + guard);
+    if (!(v > lo))
+        v = lo;
+    if (v > hi)
+        v = hi;
+    return (int32_t)floorf(v * SUBPIXEL_ONE + 0.5f);
 }
 
-static int max3(int a, int b, int c)
+static Interp interp_setup(float a0, float a1, float a2,
+                           float x10, float y10, float x20, float y20,
+                           float inv_det, float ox, float oy)
 {
-    int m = a;
-    if (b > m)
-        m = b;
-    if (c > m)
-        m = c;
-    return m;
+    Interp in;
+    float d1 = a1 - a0;
+    float d2 = a2 - a0;
+    in.dx = (d1 * y20 - d2 * y10) * inv_det;
+    in.dy = (d2 * x10 - d1 * x20) * inv_det;
+    in.c = a0 + in.dx * ox + in.dy * oy;
+    return in;
 }
 
-static float edge_func(int ax, int ay, int bx, int by, int px, int py)
+// Snap to 28.4 and divide the attributes by w once per vertex
+static RenderVertex vertex_prepare(float x, float y, float z, float w, float u, float v)
 {
-    return (float)((px - ax) * (by - ay) - (py - ay) * (bx - ax));
+    float inv_w = 1.0f / w;
+    return (RenderVertex){
+        .fx = snap_subpixel(x, RENDER_WIDTH, g_guard_x),
+        .fy = snap_subpixel(y, RENDER_HEIGHT, g_guard_y),
+        .z = z,
+        .inv_w = inv_w,
+        .u_w = u * inv_w,
+        .v_w = v * inv_w,
+    };
 }
 
-static uint32_t apply_fog(uint32_t color, float w)
+// Fill in the command's indices (wound so that inside means all edge values
+// are positive) and its pixel bounds. Returns false for degenerate or fully
+// off-screen triangles.
+static bool tri_prepare(RenderCmd *cmd, const RenderVertex *v[3], const uint32_t idx[3])
 {
-    if (!g_fog_enabled)
-        return color;
+    const int32_t fx[3] = {v[0]->fx, v[1]->fx, v[2]->fx};
+    const int32_t fy[3] = {v[0]->fy, v[1]->fy, v[2]->fy};
 
-    float factor = (w - g_fog_start) / (g_fog_end - g_fog_start);
-    return blend_colors(color, g_fog_color, factor);
-}
+    int64_t area = (int64_t)(fx[2] - fx[0]) * (fy[1] - fy[0]) -
+                   (int64_t)(fy[2] - fy[0]) * (fx[1] - fx[0]);
+    if (area == 0)
+        return false;
+    cmd->v[0] = idx[0];
+    cmd->v[1] = area < 0 ? idx[2] : idx[1];
+    cmd->v[2] = area < 0 ? idx[1] : idx[2];
 
-void render_fill_triangle_z(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
-    uint32_t color)
-{
-    if (g_threaded && threadpool_is_active())
-    {
-        if (g_cmd_count < MAX_RENDER_CMDS)
-        {
-            RenderCmd *cmd = &g_cmd_buffer[g_cmd_count++];
-            cmd->x0 = x0;
-            cmd->y0 = y0;
-            cmd->x1 = x1;
-            cmd->y1 = y1;
-            cmd->x2 = x2;
-            cmd->y2 = y2;
-            cmd->z0 = z0;
-            cmd->z1 = z1;
-            cmd->z2 = z2;
-            cmd->w0 = w0;
-            cmd->w1 = w1;
-            cmd->w2 = w2;
-            cmd->color = color;
-            cmd->textured = false;
-        }
-        return;
-    }
+    // Pixel (px, py) samples its center at (px * 16 + 8, py * 16 + 8)
+    int32_t lo_x = fx[0] < fx[1] ? (fx[0] < fx[2] ? fx[0] : fx[2]) : (fx[1] < fx[2] ? fx[1] : fx[2]);
+    int32_t hi_x = fx[0] > fx[1] ? (fx[0] > fx[2] ? fx[0] : fx[2]) : (fx[1] > fx[2] ? fx[1] : fx[2]);
+    int32_t lo_y = fy[0] < fy[1] ? (fy[0] < fy[2] ? fy[0] : fy[2]) : (fy[1] < fy[2] ? fy[1] : fy[2]);
+    int32_t hi_y = fy[0] > fy[1] ? (fy[0] > fy[2] ? fy[0] : fy[2]) : (fy[1] > fy[2] ? fy[1] : fy[2]);
 
-    // Bounding box
-    int min_x = min3(x0, x1, x2);
-    int max_x = max3(x0, x1, x2);
-    int min_y = min3(y0, y1, y2);
-    int max_y = max3(y0, y1, y2);
+    int min_x = (lo_x + SUBPIXEL_HALF - 1) >> SUBPIXEL_BITS;
+    int min_y = (lo_y + SUBPIXEL_HALF - 1) >> SUBPIXEL_BITS;
+    int max_x = (hi_x - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    int max_y = (hi_y - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
 
-    // Clip to screen
     if (min_x < 0)
         min_x = 0;
     if (min_y < 0)
@@ -354,374 +654,320 @@ void render_fill_triangle_z(
         max_x = RENDER_WIDTH - 1;
     if (max_y >= RENDER_HEIGHT)
         max_y = RENDER_HEIGHT - 1;
+    if (min_x > max_x || min_y > max_y)
+        return false;
 
-    float area = edge_func(x0, y0, x1, y1, x2, y2);
-    if (area == 0)
-        return;
+    cmd->min_x = (int16_t)min_x;
+    cmd->min_y = (int16_t)min_y;
+    cmd->max_x = (int16_t)max_x;
+    cmd->max_y = (int16_t)max_y;
+    return true;
+}
+
+// Edge and interpolant planes for a prepared command; v holds its vertices
+// in command order
+static void tri_setup(TriSetup *ts, const RenderCmd *cmd, const RenderVertex *v[3])
+{
+    const int32_t fx[3] = {v[0]->fx, v[1]->fx, v[2]->fx};
+    const int32_t fy[3] = {v[0]->fy, v[1]->fy, v[2]->fy};
 
-    float inv_w0 = 1.0f / w0;
-    float inv_w1 = 1.0f / w1;
-    float inv_w2 = 1.0f / w2;
+    ts->min_x = cmd->min_x;
+    ts->min_y = cmd->min_y;
+    ts->max_x = cmd->max_x;
+    ts->max_y = cmd->max_y;
 
-    for (int y = min_y; y <= max_y; y++)
+    int64_t px = (int64_t)ts->min_x * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    int64_t py = (int64_t)ts->min_y * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    for (int i = 0; i < 3; i++)
     {
-        for (int x = min_x; x <= max_x; x++)
-        {
-            float bary0 = edge_func(x1, y1, x2, y2, x, y);
-            float bary1 = edge_func(x2, y2, x0, y0, x, y);
-            float bary2 = edge_func(x0, y0, x1, y1, x, y);
+        // Edge i runs opposite vertex i: a -> b
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        int32_t dx = fx[b] - fx[a];
+        int32_t dy = fy[b] - fy[a];
+
+        ts->e_dx[i] = dy * SUBPIXEL_ONE;
+        ts->e_dy[i] = -dx * SUBPIXEL_ONE;
+
+        int64_t e = (px - fx[a]) * dy - (py - fy[a]) * dx;
+
+        // Top-left rule: pixels exactly on a right or bottom edge belong
+        // to the neighbouring triangle
+        bool top_left = dy > 0 || (dy == 0 && dx < 0);
+        if (!top_left)
+            e -= 1;
+        ts->e_c[i] = (int32_t)e; // Exact inside the guard band
+    }
 
-            if ((bary0 >= 0 && bary1 >= 0 && bary2 >= 0) ||
-                (bary0 <= 0 && bary1 <= 0 && bary2 <= 0))
-            {
-                bary0 /= area;
-                bary1 /= area;
-                bary2 /= area;
-
-                // Early Z-rejection
-                float z = bary0 * z0 + bary1 * z1 + bary2 * z2;
-                int idx = y * RENDER_WIDTH + x;
-                if (z >= g_zbuffer[idx])
-                    continue;
-
-                // Fog calculation
-                float interp_inv_w = bary0 * inv_w0 + bary1 * inv_w1 + bary2 * inv_w2;
-                float w = 1.0f / interp_inv_w;
-                uint32_t final_color = apply_fog(color, w);
-
-                g_zbuffer[idx] = z;
-                g_framebuffer[idx] = final_color;
-            }
-        }
+    // Interpolants are planes over the snapped positions
+    float x0 = fx[0] * (1.0f / SUBPIXEL_ONE);
+    float y0 = fy[0] * (1.0f / SUBPIXEL_ONE);
+    float x10 = (fx[1] - fx[0]) * (1.0f / SUBPIXEL_ONE);
+    float y10 = (fy[1] - fy[0]) * (1.0f / SUBPIXEL_ONE);
+    float x20 = (fx[2] - fx[0]) * (1.0f / SUBPIXEL_ONE);
+    float y20 = (fy[2] - fy[0]) * (1.0f / SUBPIXEL_ONE);
+    float inv_det = 1.0f / (x10 * y20 - x20 * y10);
+    float ox = (float)ts->min_x + 0.5f - x0;
+    float oy = (float)ts->min_y + 0.5f - y0;
+
+    ts->z = interp_setup(v[0]->z, v[1]->z, v[2]->z, x10, y10, x20, y20, inv_det, ox, oy);
+    ts->z_min = fminf(v[0]->z, fminf(v[1]->z, v[2]->z));
+    ts->inv_w = interp_setup(v[0]->inv_w, v[1]->inv_w, v[2]->inv_w, x10, y10, x20, y20, inv_det, ox, oy);
+    if (cmd->tex)
+    {
+        ts->u_w = interp_setup(v[0]->u_w, v[1]->u_w, v[2]->u_w, x10, y10, x20, y20, inv_det, ox, oy);
+        ts->v_w = interp_setup(v[0]->v_w, v[1]->v_w, v[2]->v_w, x10, y10, x20, y20, inv_det, ox, oy);
     }
 }
 
-// --- SIMD Implementation ---
-#ifdef USE_SIMD
-#include <immintrin.h>
-
-static void render_fill_triangle_simd(
-    int x0, int y0, float z0, float u0, float v0, float w0_clip,
-    int x1, int y1, float z1, float u1, float v1, float w1_clip,
-    int x2, int y2, float z2, float u2, float v2, float w2_clip,
-    const Texture *tex, float light_intensity)
+// Hi-Z and overdraw counts are only handed out when they match the depth
+// buffer's resolution, i.e. after a clear at the current resolution
+static RasterTarget render_target(RasterCounters *counters)
 {
-    int min_x = min3(x0, x1, x2);
-    int max_x = max3(x0, x1, x2);
-    int min_y = min3(y0, y1, y2);
-    int max_y = max3(y0, y1, y2);
-
-    if (min_x < 0)
-        min_x = 0;
-    if (min_y < 0)
-        min_y = 0;
-    if (max_x >= RENDER_WIDTH)
-        max_x = RENDER_WIDTH - 1;
-    if (max_y >= RENDER_HEIGHT)
-        max_y = RENDER_HEIGHT - 1;
-
-    float area = edge_func(x0, y0, x1, y1, x2, y2);
-    if (area == 0)
-        return;
-    float inv_area = 1.0f / area;
-
-    float inv_w0 = 1.0f / w0_clip;
-    float inv_w1 = 1.0f / w1_clip;
-    float inv_w2 = 1.0f / w2_clip;
-
-    float u0_over_w = u0 * inv_w0;
-    float v0_over_w = v0 * inv_w0;
-    float u1_over_w = u1 * inv_w1;
-    float v1_over_w = v1 * inv_w1;
-    float u2_over_w = u2 * inv_w2;
-    float v2_over_w = v2 * inv_w2;
-
-    __m128 v_inv_area = _mm_set1_ps(inv_area);
-
-    __m128 v_z0 = _mm_set1_ps(z0);
-    __m128 v_z1 = _mm_set1_ps(z1);
-    __m128 v_z2 = _mm_set1_ps(z2);
+    bool hiz = g_hiz_enabled && g_frame->hiz_width == RENDER_WIDTH && g_frame->hiz_height == RENDER_HEIGHT;
+    bool overdraw = g_overdraw_enabled && g_frame->overdraw_width == RENDER_WIDTH &&
+                    g_frame->overdraw_height == RENDER_HEIGHT;
+    return (RasterTarget){
+        .color = g_frame->framebuffer,
+        .depth = g_frame->zbuffer,
+        .width = RENDER_WIDTH,
+        .height = RENDER_HEIGHT,
+        .hiz_block = hiz ? g_frame->hiz_block : NULL,
+        .hiz_tile = hiz ? g_frame->hiz_tile : NULL,
+        .hiz_blocks_x = hiz_blocks_x(),
+        .hiz_tiles_x = hiz_tiles_x(),
+        .counters = counters,
+        .overdraw = overdraw ? g_frame->overdraw : NULL,
+        .fog_enabled = g_fog_enabled,
+        .fog_start = g_fog_start,
+        .fog_scale = g_fog_end > g_fog_start ? 256.0f / (g_fog_end - g_fog_start) : 0.0f,
+        .fog_color = g_fog_color,
+    };
+}
 
-    __m128 v_u0w = _mm_set1_ps(u0_over_w);
-    __m128 v_u1w = _mm_set1_ps(u1_over_w);
-    __m128 v_u2w = _mm_set1_ps(u2_over_w);
+static inline void *arena_at(const BlockArena *a, int i)
+{
+    return (char *)a->blocks[i >> CMD_BLOCK_SHIFT] + (size_t)(i & CMD_BLOCK_MASK) * a->elem_size;
+}
 
-    __m128 v_v0w = _mm_set1_ps(v0_over_w);
-    __m128 v_v1w = _mm_set1_ps(v1_over_w);
-    __m128 v_v2w = _mm_set1_ps(v2_over_w);
+static inline RenderCmd *cmd_at(int i)
+{
+    return arena_at(&g_frame->cmd_arena, i);
+}
 
-    __m128 v_inv_w0 = _mm_set1_ps(inv_w0);
-    __m128 v_inv_w1 = _mm_set1_ps(inv_w1);
-    __m128 v_inv_w2 = _mm_set1_ps(inv_w2);
+static inline RenderVertex *vtx_at(int i)
+{
+    return arena_at(&g_frame->vtx_arena, i);
+}
 
-    __m128 v_zeros = _mm_setzero_ps();
-    __m128 v_inc_x = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+// Make sure the arena has room for count elements
+static bool arena_reserve(BlockArena *a, int count)
+{
+    int blocks = (count + CMD_BLOCK_SIZE - 1) >> CMD_BLOCK_SHIFT;
+    if (blocks <= a->block_count)
+        return true;
 
-    for (int y = min_y; y <= max_y; y++)
+    if (blocks > a->block_capacity)
     {
-        float row_bary0 = edge_func(x1, y1, x2, y2, min_x, y);
-        float row_bary1 = edge_func(x2, y2, x0, y0, min_x, y);
-        float row_bary2 = edge_func(x0, y0, x1, y1, min_x, y);
-
-        int x = min_x;
-        for (; x <= max_x - 3; x += 4)
-        {
-            __m128 v_bary0 = _mm_add_ps(_mm_set1_ps(row_bary0), _mm_mul_ps(v_inc_x, _mm_set1_ps(y2 - y1)));
-            __m128 v_bary1 = _mm_add_ps(_mm_set1_ps(row_bary1), _mm_mul_ps(v_inc_x, _mm_set1_ps(y0 - y2)));
-            __m128 v_bary2 = _mm_add_ps(_mm_set1_ps(row_bary2), _mm_mul_ps(v_inc_x, _mm_set1_ps(y1 - y0)));
-
-            row_bary0 += 4.0f * (y2 - y1);
-            row_bary1 += 4.0f * (y0 - y2);
-            row_bary2 += 4.0f * (y1 - y0);
-
-            __m128 mask0 = _mm_cmpge_ps(v_bary0, v_zeros);
-            __m128 mask1 = _mm_cmpge_ps(v_bary1, v_zeros);
-            __m128 mask2 = _mm_cmpge_ps(v_bary2, v_zeros);
-
-            __m128 mask_pos = _mm_and_ps(_mm_and_ps(mask0, mask1), mask2);
-
-            __m128 mask0_neg = _mm_cmple_ps(v_bary0, v_zeros);
-            __m128 mask1_neg = _mm_cmple_ps(v_bary1, v_zeros);
-            __m128 mask2_neg = _mm_cmple_ps(v_bary2, v_zeros);
-            __m128 mask_neg = _mm_and_ps(_mm_and_ps(mask0_neg, mask1_neg), mask2_neg);
-
-            __m128 mask = _mm_or_ps(mask_pos, mask_neg);
-
-            int mask_bits = _mm_movemask_ps(mask);
-            if (mask_bits == 0)
-                continue;
-
-            v_bary0 = _mm_mul_ps(v_bary0, v_inv_area);
-            v_bary1 = _mm_mul_ps(v_bary1, v_inv_area);
-            v_bary2 = _mm_mul_ps(v_bary2, v_inv_area);
-
-            // Z = b0*z0 + b1*z1 + b2*z2
-            __m128 v_z = _mm_add_ps(
-                _mm_add_ps(_mm_mul_ps(v_bary0, v_z0), _mm_mul_ps(v_bary1, v_z1)),
-                _mm_mul_ps(v_bary2, v_z2));
-
-            int idx = y * RENDER_WIDTH + x;
-            __m128 v_zbuf = _mm_loadu_ps(&g_zbuffer[idx]);
-            __m128 z_mask = _mm_cmplt_ps(v_z, v_zbuf);
-
-            mask = _mm_and_ps(mask, z_mask);
-            mask_bits = _mm_movemask_ps(mask);
-            if (mask_bits == 0)
-                continue;
-
-            __m128 v_interp_inv_w = _mm_add_ps(
-                _mm_add_ps(_mm_mul_ps(v_bary0, v_inv_w0), _mm_mul_ps(v_bary1, v_inv_w1)),
-                _mm_mul_ps(v_bary2, v_inv_w2));
-
-            __m128 v_interp_u = _mm_add_ps(
-                _mm_add_ps(_mm_mul_ps(v_bary0, v_u0w), _mm_mul_ps(v_bary1, v_u1w)),
-                _mm_mul_ps(v_bary2, v_u2w));
-
-            __m128 v_interp_v = _mm_add_ps(
-                _mm_add_ps(_mm_mul_ps(v_bary0, v_v0w), _mm_mul_ps(v_bary1, v_v1w)),
-                _mm_mul_ps(v_bary2, v_v2w));
-
-            __m128 v_u = _mm_div_ps(v_interp_u, v_interp_inv_w);
-            __m128 v_v = _mm_div_ps(v_interp_v, v_interp_inv_w);
-            __m128 v_w = _mm_rcp_ps(v_interp_inv_w);
-
-            float zs[4], us[4], vs[4], ws[4];
-            _mm_storeu_ps(zs, v_z);
-            _mm_storeu_ps(us, v_u);
-            _mm_storeu_ps(vs, v_v);
-            _mm_storeu_ps(ws, v_w);
-
-            for (int i = 0; i < 4; i++)
-            {
-                if ((mask_bits >> i) & 1)
-                {
-                    uint32_t tex_color = texture_sample(tex, us[i], vs[i]);
+        int cap = a->block_capacity ? a->block_capacity * 2 : 16;
+        while (cap < blocks)
+            cap *= 2;
+        void **list = realloc(a->blocks, (size_t)cap * sizeof(void *));
+        if (!list)
+            return false;
+        a->blocks = list;
+        a->block_capacity = cap;
+    }
 
-                    uint8_t r = (uint8_t)(((tex_color >> 16) & 0xFF) * light_intensity);
-                    uint8_t g = (uint8_t)(((tex_color >> 8) & 0xFF) * light_intensity);
-                    uint8_t b = (uint8_t)((tex_color & 0xFF) * light_intensity);
+    while (a->block_count < blocks)
+    {
+        void *block = malloc(CMD_BLOCK_SIZE * a->elem_size);
+        if (!block)
+            return false;
+        a->blocks[a->block_count++] = block;
+    }
+    return true;
+}
 
-                    uint32_t lit_color = 0xFF000000 | (r << 16) | (g << 8) | b;
-                    uint32_t final_color = apply_fog(lit_color, ws[i]);
+static size_t arena_bytes(const BlockArena *a)
+{
+    return (size_t)a->block_count * CMD_BLOCK_SIZE * a->elem_size;
+}
 
-                    g_zbuffer[idx + i] = zs[i];
-                    g_framebuffer[idx + i] = final_color;
-                }
-            }
-        }
+// Grow a thread list's array to hold one more element
+static bool list_grow(void **items, int *capacity, int count, size_t elem_size)
+{
+    if (count < *capacity)
+        return true;
+    int cap = *capacity ? *capacity * 2 : 1024;
+    void *grown = realloc(*items, (size_t)cap * elem_size);
+    if (!grown)
+        return false;
+    *items = grown;
+    *capacity = cap;
+    return true;
+}
 
-        for (; x <= max_x; x++)
+// Slot for the next command from the calling thread; NULL only when memory
+// runs out (the triangle is dropped)
+static RenderCmd *cmd_alloc(void)
+{
+    CmdList *list = t_cmd_list;
+    if (!list)
+    {
+        if (!arena_reserve(&g_frame->cmd_arena, g_frame->cmd_count + 1))
         {
-            float bary0 = edge_func(x1, y1, x2, y2, x, y);
-            float bary1 = edge_func(x2, y2, x0, y0, x, y);
-            float bary2 = edge_func(x0, y0, x1, y1, x, y);
-
-            if ((bary0 >= 0 && bary1 >= 0 && bary2 >= 0) ||
-                (bary0 <= 0 && bary1 <= 0 && bary2 <= 0))
-            {
-                bary0 /= area;
-                bary1 /= area;
-                bary2 /= area;
-
-                float z = bary0 * z0 + bary1 * z1 + bary2 * z2;
-                int idx = y * RENDER_WIDTH + x;
-                if (z >= g_zbuffer[idx])
-                    continue;
-
-                float interp_inv_w = bary0 * inv_w0 + bary1 * inv_w1 + bary2 * inv_w2;
-                float interp_u_over_w = bary0 * u0_over_w + bary1 * u1_over_w + bary2 * u2_over_w;
-                float interp_v_over_w = bary0 * v0_over_w + bary1 * v1_over_w + bary2 * v2_over_w;
-                float u = interp_u_over_w / interp_inv_w;
-                float v = interp_v_over_w / interp_inv_w;
-
-                uint32_t tex_color = texture_sample(tex, u, v);
-                uint8_t r = (uint8_t)(((tex_color >> 16) & 0xFF) * light_intensity);
-                uint8_t g = (uint8_t)(((tex_color >> 8) & 0xFF) * light_intensity);
-                uint8_t b = (uint8_t)((tex_color & 0xFF) * light_intensity);
-                uint32_t lit_color = 0xFF000000 | (r << 16) | (g << 8) | b;
-                float w = 1.0f / interp_inv_w;
-                uint32_t final_color = apply_fog(lit_color, w);
-
-                g_zbuffer[idx] = z;
-                g_framebuffer[idx] = final_color;
-            }
+            LOG_ERROR("Render command arena: out of memory at %d commands", g_frame->cmd_count);
+            return NULL;
         }
+        return cmd_at(g_frame->cmd_count);
     }
+
+    if (!list_grow((void **)&list->cmds, &list->capacity, list->count, sizeof(RenderCmd)))
+        return NULL;
+    return &list->cmds[list->count];
 }
-#endif // USE_SIMD
 
-// SIMD Flag (run-time toggle)
-static bool g_simd_enabled = false;
+static void cmd_commit(void)
+{
+    if (t_cmd_list)
+        t_cmd_list->count++;
+    else
+        g_frame->cmd_count++;
+}
 
-void render_set_simd(bool enabled)
+// Vertex by index in the calling thread's current list
+static const RenderVertex *vtx_get(uint32_t i)
 {
-    g_simd_enabled = enabled;
-    LOG_INFO("SIMD Rasterizer: %s", enabled ? "ON" : "OFF");
+    return t_cmd_list ? &t_cmd_list->verts[i] : vtx_at((int)i);
 }
 
-void render_fill_triangle_textured(
-    int x0, int y0, float z0, float u0, float v0, float w0_clip,
-    int x1, int y1, float z1, float u1, float v1, float w1_clip,
-    int x2, int y2, float z2, float u2, float v2, float w2_clip,
-    const Texture *tex, float light_intensity)
+int render_push_vertex(float x, float y, float z, float w, float u, float v)
 {
-    if (g_threaded && threadpool_is_active())
+    CmdList *list = t_cmd_list;
+    RenderVertex *slot;
+    int index;
+    if (!list)
     {
-        if (g_cmd_count < MAX_RENDER_CMDS)
+        if (!arena_reserve(&g_frame->vtx_arena, g_frame->vtx_count + 1))
         {
-            RenderCmd *cmd = &g_cmd_buffer[g_cmd_count++];
-            cmd->x0 = x0;
-            cmd->y0 = y0;
-            cmd->x1 = x1;
-            cmd->y1 = y1;
-            cmd->x2 = x2;
-            cmd->y2 = y2;
-            cmd->z0 = z0;
-            cmd->z1 = z1;
-            cmd->z2 = z2;
-            cmd->w0 = w0_clip;
-            cmd->w1 = w1_clip;
-            cmd->w2 = w2_clip;
-            cmd->u0 = u0;
-            cmd->v0 = v0;
-            cmd->u1 = u1;
-            cmd->v1 = v1;
-            cmd->u2 = u2;
-            cmd->v2 = v2;
-            cmd->tex = tex;
-            cmd->light = light_intensity;
-            cmd->textured = true;
+            LOG_ERROR("Render vertex arena: out of memory at %d vertices", g_frame->vtx_count);
+            return -1;
         }
-        return;
+        index = g_frame->vtx_count++;
+        slot = vtx_at(index);
     }
-
-#ifdef USE_SIMD
-    if (g_simd_enabled)
+    else
     {
-        render_fill_triangle_simd(x0, y0, z0, u0, v0, w0_clip,
-                                  x1, y1, z1, u1, v1, w1_clip,
-                                  x2, y2, z2, u2, v2, w2_clip,
-                                  tex, light_intensity);
-        return;
+        if (!list_grow((void **)&list->verts, &list->vtx_capacity, list->vtx_count, sizeof(RenderVertex)))
+            return -1;
+        index = list->vtx_count++;
+        slot = &list->verts[index];
     }
-#endif
 
-    int min_x = min3(x0, x1, x2);
-    int max_x = max3(x0, x1, x2);
+    *slot = vertex_prepare(x, y, z, w, u, v);
+    return index;
+}
 
-    int min_y = min3(y0, y1, y2);
-    int max_y = max3(y0, y1, y2);
+// Record a triangle over pushed vertices; returns the command to fill in,
+// or NULL if it was culled or memory ran out
+static RenderCmd *push_triangle(int a, int b, int c)
+{
+    if (a < 0 || b < 0 || c < 0)
+        return NULL;
+    RenderCmd *cmd = cmd_alloc();
+    if (!cmd)
+        return NULL;
+
+    const uint32_t idx[3] = {(uint32_t)a, (uint32_t)b, (uint32_t)c};
+    const RenderVertex *v[3] = {vtx_get(idx[0]), vtx_get(idx[1]), vtx_get(idx[2])};
+    return tri_prepare(cmd, v, idx) ? cmd : NULL;
+}
 
-    if (min_x < 0)
-        min_x = 0;
-    if (min_y < 0)
-        min_y = 0;
-    if (max_x >= RENDER_WIDTH)
-        max_x = RENDER_WIDTH - 1;
-    if (max_y >= RENDER_HEIGHT)
-        max_y = RENDER_HEIGHT - 1;
+void render_push_triangle(int a, int b, int c, uint32_t color)
+{
+    RenderCmd *cmd = push_triangle(a, b, c);
+    if (!cmd)
+        return;
+    cmd->color = color;
+    cmd->tex = NULL;
+    cmd_commit();
+}
 
-    float area = edge_func(x0, y0, x1, y1, x2, y2);
-    if (area == 0)
+void render_push_triangle_textured(int a, int b, int c, const Texture *tex, float light_intensity)
+{
+    RenderCmd *cmd = push_triangle(a, b, c);
+    if (!cmd)
         return;
+    cmd->light = light_intensity;
+    cmd->tex = tex;
+    cmd_commit();
+}
 
-    // Pre-compute 1/w for perspective correction
-    float inv_w0 = 1.0f / w0_clip;
-    float inv_w1 = 1.0f / w1_clip;
-    float inv_w2 = 1.0f / w2_clip;
+// Immediate-mode draw of a triangle over three local vertices
+static void draw_triangle(const RenderVertex lv[3], RenderCmd *cmd)
+{
+    static const uint32_t idx[3] = {0, 1, 2};
+    const RenderVertex *v[3] = {&lv[0], &lv[1], &lv[2]};
+    if (!tri_prepare(cmd, v, idx))
+        return;
 
-    // Pre-compute u/w and v/w for perspective-correct interpolation
-    float u0_over_w = u0 * inv_w0;
-    float v0_over_w = v0 * inv_w0;
-    float u1_over_w = u1 * inv_w1;
-    float v1_over_w = v1 * inv_w1;
-    float u2_over_w = u2 * inv_w2;
-    float v2_over_w = v2 * inv_w2;
+    const RenderVertex *ordered[3] = {&lv[cmd->v[0]], &lv[cmd->v[1]], &lv[cmd->v[2]]};
+    TriSetup ts;
+    tri_setup(&ts, cmd, ordered);
+    RasterTarget rt = render_target(&g_raster_counters);
+    if (cmd->tex)
+        g_kernels->textured(&rt, &ts, cmd->tex, cmd->light, 0, 0, RENDER_WIDTH - 1, RENDER_HEIGHT - 1);
+    else
+        g_kernels->flat(&rt, &ts, cmd->color, 0, 0, RENDER_WIDTH - 1, RENDER_HEIGHT - 1);
+}
 
-    for (int y = min_y; y <= max_y; y++)
+void render_fill_triangle_z(
+    float x0, float y0, float z0, float w0,
+    float x1, float y1, float z1, float w1,
+    float x2, float y2, float z2, float w2,
+    uint32_t color)
+{
+    if (render_is_recording())
     {
-        for (int x = min_x; x <= max_x; x++)
-        {
-            float bary0 = edge_func(x1, y1, x2, y2, x, y);
-            float bary1 = edge_func(x2, y2, x0, y0, x, y);
-            float bary2 = edge_func(x0, y0, x1, y1, x, y);
-
-            if ((bary0 >= 0 && bary1 >= 0 && bary2 >= 0) ||
-                (bary0 <= 0 && bary1 <= 0 && bary2 <= 0))
-            {
-                bary0 /= area;
-                bary1 /= area;
-                bary2 /= area;
-
-                // Early Z-rejection
-                float z = bary0 * z0 + bary1 * z1 + bary2 * z2;
-                int idx = y * RENDER_WIDTH + x;
-                if (z >= g_zbuffer[idx])
-                    continue;
-
-                float interp_inv_w = bary0 * inv_w0 + bary1 * inv_w1 + bary2 * inv_w2;
-                float interp_u_over_w = bary0 * u0_over_w + bary1 * u1_over_w + bary2 * u2_over_w;
-                float interp_v_over_w = bary0 * v0_over_w + bary1 * v1_over_w + bary2 * v2_over_w;
-                float u = interp_u_over_w / interp_inv_w;
-                float v = interp_v_over_w / interp_inv_w;
-
-                uint32_t tex_color = texture_sample(tex, u, v);
-
-                uint8_t r = (uint8_t)(((tex_color >> 16) & 0xFF) * light_intensity);
-                uint8_t g = (uint8_t)(((tex_color >> 8) & 0xFF) * light_intensity);
-                uint8_t b = (uint8_t)((tex_color & 0xFF) * light_intensity);
-
-                uint32_t lit_color = 0xFF000000 | (r << 16) | (g << 8) | b;
+        int a = render_push_vertex(x0, y0, z0, w0, 0, 0);
+        int b = render_push_vertex(x1, y1, z1, w1, 0, 0);
+        int c = render_push_vertex(x2, y2, z2, w2, 0, 0);
+        render_push_triangle(a, b, c, color);
+        return;
+    }
 
-                // Fog
-                float w = 1.0f / interp_inv_w;
-                uint32_t final_color = apply_fog(lit_color, w);
+    RenderVertex v[3] = {
+        vertex_prepare(x0, y0, z0, w0, 0, 0),
+        vertex_prepare(x1, y1, z1, w1, 0, 0),
+        vertex_prepare(x2, y2, z2, w2, 0, 0),
+    };
+    RenderCmd cmd = {.color = color};
+    draw_triangle(v, &cmd);
+}
 
-                g_zbuffer[idx] = z;
-                g_framebuffer[idx] = final_color;
-            }
-        }
+void render_fill_triangle_textured(
+    float x0, float y0, float z0, float u0, float v0, float w0_clip,
+    float x1, float y1, float z1, float u1, float v1, float w1_clip,
+    float x2, float y2, float z2, float u2, float v2, float w2_clip,
+    const Texture *tex, float light_intensity)
+{
+    if (render_is_recording())
+    {
+        int a = render_push_vertex(x0, y0, z0, w0_clip, u0, v0);
+        int b = render_push_vertex(x1, y1, z1, w1_clip, u1, v1);
+        int c = render_push_vertex(x2, y2, z2, w2_clip, u2, v2);
+        render_push_triangle_textured(a, b, c, tex, light_intensity);
+        return;
     }
+
+    RenderVertex v[3] = {
+        vertex_prepare(x0, y0, z0, w0_clip, u0, v0),
+        vertex_prepare(x1, y1, z1, w1_clip, u1, v1),
+        vertex_prepare(x2, y2, z2, w2_clip, u2, v2),
+    };
+    RenderCmd cmd = {.light = light_intensity, .tex = tex};
+    draw_triangle(v, &cmd);
 }
 
 ProjectedVertex render_project_vertex(Vec4 v)
@@ -848,188 +1094,1161 @@ void render_draw_3d_line(Vec3 start, Vec3 end, Mat4 vp, uint32_t color)
     render_draw_line(x0, y0, x1, y1, color);
 }
 
-static void tile_fill_z(const RenderCmd *cmd,
-                        int tx, int ty, int tw, int th)
+// Monotonic, so tile costs and frame times never come out negative
+static int64_t render_time_ns(void)
 {
-    int min_x = min3(cmd->x0, cmd->x1, cmd->x2);
-    int max_x = max3(cmd->x0, cmd->x1, cmd->x2);
-    int min_y = min3(cmd->y0, cmd->y1, cmd->y2);
-    int max_y = max3(cmd->y0, cmd->y1, cmd->y2);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    if (min_x < tx)
-        min_x = tx;
-    if (min_y < ty)
-        min_y = ty;
-    if (max_x > tx + tw - 1)
-        max_x = tx + tw - 1;
-    if (max_y > ty + th - 1)
-        max_y = ty + th - 1;
+// Latest job end of the frame, for RENDER_THREAD_AUTO
+static void frame_mark_done(RenderFrame *f, int64_t ns)
+{
+    int64_t prev = atomic_load_explicit(&f->done_ns, memory_order_relaxed);
+    while (prev < ns &&
+           !atomic_compare_exchange_weak_explicit(&f->done_ns, &prev, ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
 
-    if (min_x > max_x || min_y > max_y)
-        return;
+// Draws one tile of the frame passed as userdata. Bins, the tile grid and
+// tile costs are shared by both frames: a flush only rebuilds them once
+// the previous frame's tiles are done.
+static void tile_rasterize(int tile_x, int tile_y, int tile_w, int tile_h,
+                           void *userdata)
+{
+    PROFILE_SCOPE(PROFILE_RASTER);
+    RenderFrame *f = userdata;
+    int64_t t0 = render_time_ns();
+
+    int tile = (tile_y / g_bin_tile_size) * g_bin_tiles_x + tile_x / g_bin_tile_size;
+    int end = g_bin_offsets[tile + 1];
+    int x1 = tile_x + tile_w - 1;
+    int y1 = tile_y + tile_h - 1;
+    const RasterKernels *k = f->kernels;
+    RasterCounters counters = {0};
+    RasterTarget rt = f->target;
+    rt.counters = &counters;
+    for (int i = g_bin_offsets[tile]; i < end; i++)
+    {
+        const RenderCmd *cmd = arena_at(&f->cmd_arena, g_bin_cmds[i]);
+        const RenderVertex *v[3] = {arena_at(&f->vtx_arena, (int)cmd->v[0]),
+                                    arena_at(&f->vtx_arena, (int)cmd->v[1]),
+                                    arena_at(&f->vtx_arena, (int)cmd->v[2])};
+        TriSetup ts;
+        tri_setup(&ts, cmd, v);
+        if (cmd->tex)
+            k->textured(&rt, &ts, cmd->tex, cmd->light, tile_x, tile_y, x1, y1);
+        else
+            k->flat(&rt, &ts, cmd->color, tile_x, tile_y, x1, y1);
+    }
 
-    float area = edge_func(cmd->x0, cmd->y0, cmd->x1, cmd->y1, cmd->x2, cmd->y2);
-    if (area == 0)
-        return;
+    tile_counters_add(&counters);
 
-    float inv_w0 = 1.0f / cmd->w0;
-    float inv_w1 = 1.0f / cmd->w1;
-    float inv_w2 = 1.0f / cmd->w2;
+    int64_t t1 = render_time_ns();
+    int64_t ns = t1 - t0;
+    g_tile_cost[tile] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    if (f->timed)
+        frame_mark_done(f, t1);
+}
 
-    for (int y = min_y; y <= max_y; y++)
+// Buffers for count shares at the current resolution
+static bool shares_reserve(int count)
+{
+    if (count > g_share_capacity)
     {
-        for (int x = min_x; x <= max_x; x++)
-        {
-            float bary0 = edge_func(cmd->x1, cmd->y1, cmd->x2, cmd->y2, x, y);
-            float bary1 = edge_func(cmd->x2, cmd->y2, cmd->x0, cmd->y0, x, y);
-            float bary2 = edge_func(cmd->x0, cmd->y0, cmd->x1, cmd->y1, x, y);
-
-            if ((bary0 >= 0 && bary1 >= 0 && bary2 >= 0) ||
-                (bary0 <= 0 && bary1 <= 0 && bary2 <= 0))
-            {
-                bary0 /= area;
-                bary1 /= area;
-                bary2 /= area;
-
-                float z = bary0 * cmd->z0 + bary1 * cmd->z1 + bary2 * cmd->z2;
-                int idx = y * RENDER_WIDTH + x;
-                if (z >= g_zbuffer[idx])
-                    continue;
+        RenderShare *shares = realloc(g_shares, (size_t)count * sizeof(RenderShare));
+        if (!shares)
+            return false;
+        memset(shares + g_share_capacity, 0, (size_t)(count - g_share_capacity) * sizeof(RenderShare));
+        g_shares = shares;
+        g_share_capacity = count;
+    }
 
-                float interp_inv_w = bary0 * inv_w0 + bary1 * inv_w1 + bary2 * inv_w2;
-                float w = 1.0f / interp_inv_w;
-                uint32_t final_color = apply_fog(cmd->color, w);
+    int blocks = ((RENDER_WIDTH + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE) *
+                 ((RENDER_HEIGHT + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE);
+    int tiles = ((RENDER_WIDTH + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE) *
+                ((RENDER_HEIGHT + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE);
+    size_t pixels = (size_t)RENDER_WIDTH * RENDER_HEIGHT;
+    for (int i = 0; i < count; i++)
+    {
+        RenderShare *sh = &g_shares[i];
+        if (sh->width == RENDER_WIDTH && sh->height == RENDER_HEIGHT)
+            continue;
 
-                g_zbuffer[idx] = z;
-                g_framebuffer[idx] = final_color;
-            }
+        free(sh->color);
+        free(sh->depth);
+        free(sh->hiz_block);
+        free(sh->hiz_tile);
+        sh->color = malloc(pixels * sizeof(uint32_t));
+        sh->depth = malloc(pixels * sizeof(float));
+        sh->hiz_block = malloc((size_t)blocks * sizeof(float));
+        sh->hiz_tile = malloc((size_t)tiles * sizeof(float));
+        if (!sh->color || !sh->depth || !sh->hiz_block || !sh->hiz_tile)
+        {
+            sh->width = 0;
+            sh->height = 0;
+            return false;
         }
+        sh->width = RENDER_WIDTH;
+        sh->height = RENDER_HEIGHT;
     }
+    return true;
 }
 
-static void tile_fill_textured(const RenderCmd *cmd,
-                               int tx, int ty, int tw, int th)
+// Rasterize one share of the command stream into its private buffer
+static void share_rasterize(int index, void *userdata)
 {
-    int min_x = min3(cmd->x0, cmd->x1, cmd->x2);
-    int max_x = max3(cmd->x0, cmd->x1, cmd->x2);
-    int min_y = min3(cmd->y0, cmd->y1, cmd->y2);
-    int max_y = max3(cmd->y0, cmd->y1, cmd->y2);
-
-    if (min_x < tx)
-        min_x = tx;
-    if (min_y < ty)
-        min_y = ty;
-    if (max_x > tx + tw - 1)
-        max_x = tx + tw - 1;
-    if (max_y > ty + th - 1)
-        max_y = ty + th - 1;
-
-    if (min_x > max_x || min_y > max_y)
+    PROFILE_SCOPE(PROFILE_RASTER);
+    RenderFrame *f = userdata;
+    RenderShare *sh = &g_shares[index];
+    int width = f->target.width;
+    int height = f->target.height;
+
+    int x0 = width, y0 = height, x1 = -1, y1 = -1;
+    for (int i = sh->begin; i < sh->end; i++)
+    {
+        const RenderCmd *cmd = arena_at(&f->cmd_arena, i);
+        x0 = cmd->min_x < x0 ? cmd->min_x : x0;
+        y0 = cmd->min_y < y0 ? cmd->min_y : y0;
+        x1 = cmd->max_x > x1 ? cmd->max_x : x1;
+        y1 = cmd->max_y > y1 ? cmd->max_y : y1;
+    }
+    if (x1 < x0 || y1 < y0)
+    {
+        sh->x0 = 0;
+        sh->x1 = -1;
         return;
+    }
+    x0 &= ~(HIZ_TILE_SIZE - 1);
+    y0 &= ~(HIZ_TILE_SIZE - 1);
+    x1 = (x1 | (HIZ_TILE_SIZE - 1)) < width - 1 ? (x1 | (HIZ_TILE_SIZE - 1)) : width - 1;
+    y1 = (y1 | (HIZ_TILE_SIZE - 1)) < height - 1 ? (y1 | (HIZ_TILE_SIZE - 1)) : height - 1;
+    sh->x0 = x0;
+    sh->y0 = y0;
+    sh->x1 = x1;
+    sh->y1 = y1;
+
+    // Color needs no clear: the composite only takes pixels whose depth
+    // was written
+    for (int y = y0; y <= y1; y++)
+    {
+        float *row = &sh->depth[y * width];
+        for (int x = x0; x <= x1; x++)
+            row[x] = FLT_MAX;
+    }
 
-    float area = edge_func(cmd->x0, cmd->y0, cmd->x1, cmd->y1, cmd->x2, cmd->y2);
-    if (area == 0)
-        return;
+    RasterCounters counters = {0};
+    RasterTarget rt = f->target;
+    rt.color = sh->color;
+    rt.depth = sh->depth;
+    rt.counters = &counters;
+    if (rt.hiz_block)
+    {
+        rt.hiz_block = sh->hiz_block;
+        rt.hiz_tile = sh->hiz_tile;
+        for (int by = y0 / HIZ_BLOCK_SIZE; by <= y1 / HIZ_BLOCK_SIZE; by++)
+            for (int bx = x0 / HIZ_BLOCK_SIZE; bx <= x1 / HIZ_BLOCK_SIZE; bx++)
+                rt.hiz_block[by * rt.hiz_blocks_x + bx] = FLT_MAX;
+        for (int ty = y0 / HIZ_TILE_SIZE; ty <= y1 / HIZ_TILE_SIZE; ty++)
+            for (int tx = x0 / HIZ_TILE_SIZE; tx <= x1 / HIZ_TILE_SIZE; tx++)
+                rt.hiz_tile[ty * rt.hiz_tiles_x + tx] = FLT_MAX;
+    }
 
-    float inv_w0 = 1.0f / cmd->w0;
-    float inv_w1 = 1.0f / cmd->w1;
-    float inv_w2 = 1.0f / cmd->w2;
+    const RasterKernels *k = f->kernels;
+    for (int i = sh->begin; i < sh->end; i++)
+    {
+        const RenderCmd *cmd = arena_at(&f->cmd_arena, i);
+        const RenderVertex *v[3] = {arena_at(&f->vtx_arena, (int)cmd->v[0]),
+                                    arena_at(&f->vtx_arena, (int)cmd->v[1]),
+                                    arena_at(&f->vtx_arena, (int)cmd->v[2])};
+        TriSetup ts;
+        tri_setup(&ts, cmd, v);
+        if (cmd->tex)
+            k->textured(&rt, &ts, cmd->tex, cmd->light, x0, y0, x1, y1);
+        else
+            k->flat(&rt, &ts, cmd->color, x0, y0, x1, y1);
+    }
 
-    float u0_over_w = cmd->u0 * inv_w0;
-    float v0_over_w = cmd->v0 * inv_w0;
-    float u1_over_w = cmd->u1 * inv_w1;
-    float v1_over_w = cmd->v1 * inv_w1;
-    float u2_over_w = cmd->u2 * inv_w2;
-    float v2_over_w = cmd->v2 * inv_w2;
+    tile_counters_add(&counters);
+}
 
-    for (int y = min_y; y <= max_y; y++)
+// Merge every share into one band of rows of the frame. Shares go in
+// stream order and a pixel only moves on a strictly nearer depth, so ties
+// resolve to the earlier triangle, as when drawing serially.
+static void share_composite(int band, void *userdata)
+{
+    PROFILE_SCOPE(PROFILE_COMPOSITE);
+    RenderFrame *f = userdata;
+    int width = f->target.width;
+    int y0 = band * RENDER_COMPOSITE_ROWS;
+    int y1 = y0 + RENDER_COMPOSITE_ROWS - 1 < f->target.height - 1 ? y0 + RENDER_COMPOSITE_ROWS - 1
+                                                                 : f->target.height - 1;
+    RasterCompositeFunc composite = f->kernels->composite;
+    for (int i = 0; i < g_share_count; i++)
     {
-        for (int x = min_x; x <= max_x; x++)
+        const RenderShare *sh = &g_shares[i];
+        int r0 = sh->y0 > y0 ? sh->y0 : y0;
+        int r1 = sh->y1 < y1 ? sh->y1 : y1;
+        if (sh->x1 < sh->x0)
+            continue;
+        for (int y = r0; y <= r1; y++)
         {
-            float bary0 = edge_func(cmd->x1, cmd->y1, cmd->x2, cmd->y2, x, y);
-            float bary1 = edge_func(cmd->x2, cmd->y2, cmd->x0, cmd->y0, x, y);
-            float bary2 = edge_func(cmd->x0, cmd->y0, cmd->x1, cmd->y1, x, y);
-
-            if ((bary0 >= 0 && bary1 >= 0 && bary2 >= 0) ||
-                (bary0 <= 0 && bary1 <= 0 && bary2 <= 0))
-            {
-                bary0 /= area;
-                bary1 /= area;
-                bary2 /= area;
-
-                float z = bary0 * cmd->z0 + bary1 * cmd->z1 + bary2 * cmd->z2;
-                int idx = y * RENDER_WIDTH + x;
-                if (z >= g_zbuffer[idx])
-                    continue;
-
-                float interp_inv_w = bary0 * inv_w0 + bary1 * inv_w1 + bary2 * inv_w2;
-                float interp_u_over_w = bary0 * u0_over_w + bary1 * u1_over_w + bary2 * u2_over_w;
-                float interp_v_over_w = bary0 * v0_over_w + bary1 * v1_over_w + bary2 * v2_over_w;
-                float u = interp_u_over_w / interp_inv_w;
-                float v = interp_v_over_w / interp_inv_w;
-
-                uint32_t tex_color = texture_sample(cmd->tex, u, v);
-                uint8_t r = (uint8_t)(((tex_color >> 16) & 0xFF) * cmd->light);
-                uint8_t g = (uint8_t)(((tex_color >> 8) & 0xFF) * cmd->light);
-                uint8_t b = (uint8_t)((tex_color & 0xFF) * cmd->light);
-                uint32_t lit_color = 0xFF000000 | (r << 16) | (g << 8) | b;
-
-                float w = 1.0f / interp_inv_w;
-                uint32_t final_color = apply_fog(lit_color, w);
-
-                g_zbuffer[idx] = z;
-                g_framebuffer[idx] = final_color;
-            }
+            size_t at = (size_t)y * width + sh->x0;
+            composite(&f->framebuffer[at], &f->zbuffer[at], &sh->color[at], &sh->depth[at],
+                      sh->x1 - sh->x0 + 1);
         }
     }
+    if (f->timed)
+        frame_mark_done(f, render_time_ns());
 }
 
-static void tile_rasterize(int tile_x, int tile_y, int tile_w, int tile_h,
-                           void *userdata)
+// Split the frame's commands into equal shares, one per pool thread at
+// most, and queue their rasterization followed by the composite
+static bool sort_last_dispatch(RenderFrame *f)
 {
-    (void)userdata;
-    for (int i = 0; i < g_cmd_count; i++)
+    int shares = threadpool_get_count() + 1;
+    if (shares > f->cmd_count / RENDER_SHARE_MIN_CMDS)
+        shares = f->cmd_count / RENDER_SHARE_MIN_CMDS;
+    if (shares < 1)
+        shares = 1;
+    if (!shares_reserve(shares))
     {
-        const RenderCmd *cmd = &g_cmd_buffer[i];
-        if (cmd->textured)
-            tile_fill_textured(cmd, tile_x, tile_y, tile_w, tile_h);
-        else
-            tile_fill_z(cmd, tile_x, tile_y, tile_w, tile_h);
+        LOG_ERROR("Failed to allocate %d sort-last buffers, using tiles", shares);
+        return false;
     }
+
+    g_share_count = shares;
+    for (int i = 0; i < shares; i++)
+    {
+        g_shares[i].begin = (int)((int64_t)f->cmd_count * i / shares);
+        g_shares[i].end = (int)((int64_t)f->cmd_count * (i + 1) / shares);
+    }
+
+    int bands = (f->target.height + RENDER_COMPOSITE_ROWS - 1) / RENDER_COMPOSITE_ROWS;
+    f->in_flight = true;
+    job_submit(&(JobDesc){
+        .func = share_rasterize,
+        .userdata = f,
+        .begin = 0,
+        .end = shares,
+        .grain = 1,
+        .counter = &f->shares,
+    });
+    job_submit(&(JobDesc){
+        .func = share_composite,
+        .userdata = f,
+        .begin = 0,
+        .end = bands,
+        .grain = 1,
+        .counter = &f->raster,
+        .dependency = &f->shares,
+    });
+    return true;
+}
+
+// Largest tile whose color and depth fit in half the core's L2 (the rest
+// is left to bins, vertices and textures), then shrunk until every pool
+// thread gets a few tiles to balance with
+static int tile_size_pick(int width, int height, int threads)
+{
+    int budget = threadpool_get_cache_size(2) / 2;
+    if (budget <= 0)
+        budget = threadpool_get_cache_size(1) * 4;
+    if (budget <= 0)
+        budget = RENDER_TILE_CACHE_DEFAULT;
+
+    int pixel_bytes = (int)(sizeof(uint32_t) + sizeof(float));
+    int size = HIZ_TILE_SIZE;
+    while (size < RENDER_TILE_MAX &&
+           (size + HIZ_TILE_SIZE) * (size + HIZ_TILE_SIZE) * pixel_bytes <= budget)
+        size += HIZ_TILE_SIZE;
+    while (size > HIZ_TILE_SIZE &&
+           ((width + size - 1) / size) * ((height + size - 1) / size) < threads * RENDER_TILES_PER_THREAD)
+        size -= HIZ_TILE_SIZE;
+    return size;
+}
+
+static void tile_size_update(void)
+{
+    int threads = threadpool_get_count() + 1;
+    if (g_tile_size_forced > 0)
+    {
+        g_tile_size = g_tile_size_forced;
+        return;
+    }
+    if (g_tile_size_key[0] == RENDER_WIDTH && g_tile_size_key[1] == RENDER_HEIGHT &&
+        g_tile_size_key[2] == threads)
+        return;
+
+    g_tile_size_key[0] = RENDER_WIDTH;
+    g_tile_size_key[1] = RENDER_HEIGHT;
+    g_tile_size_key[2] = threads;
+    g_tile_size = tile_size_pick(RENDER_WIDTH, RENDER_HEIGHT, threads);
+    LOG_INFO("Tile size: %d px for %dx%d, %d threads (L1 %d KB, L2 %d KB)",
+             g_tile_size, RENDER_WIDTH, RENDER_HEIGHT, threads,
+             threadpool_get_cache_size(1) / 1024, threadpool_get_cache_size(2) / 1024);
+}
+
+void render_set_tile_size(int size)
+{
+    if (size > 0)
+    {
+        size = (size + HIZ_TILE_SIZE / 2) / HIZ_TILE_SIZE * HIZ_TILE_SIZE;
+        if (size < HIZ_TILE_SIZE)
+            size = HIZ_TILE_SIZE;
+        if (size > RENDER_TILE_MAX)
+            size = RENDER_TILE_MAX;
+    }
+    g_tile_size_forced = size > 0 ? size : 0;
+    g_tile_size_key[2] = 0;
+    tile_size_update();
+}
+
+int render_get_tile_size(void)
+{
+    return g_tile_size;
+}
+
+void render_set_threaded(RenderThreadMode mode)
+{
+    static const char *names[] = {"OFF", "tiles", "sort-last", "auto"};
+    if (mode < RENDER_THREAD_OFF || mode > RENDER_THREAD_AUTO)
+        mode = RENDER_THREAD_TILES;
+    if (mode == RENDER_THREAD_OFF)
+        render_finish_frames();
+    if (mode == RENDER_THREAD_AUTO && g_thread_mode != RENDER_THREAD_AUTO)
+    {
+        g_auto_hold = 0;
+        g_auto_samples[0] = 0;
+        g_auto_samples[1] = 0;
+    }
+    g_thread_mode = mode;
+    LOG_INFO("Threaded rasterizer: %s", names[mode]);
 }
 
-void render_set_threaded(bool enabled)
+RenderThreadMode render_get_thread_mode(void)
 {
-    g_threaded = enabled;
-    LOG_INFO("Threaded rasterizer: %s", enabled ? "ON" : "OFF");
+    return g_thread_mode;
+}
+
+void render_set_simd(bool enabled)
+{
+    if (!g_simd_kernels)
+        g_simd_kernels = raster_get_kernels(RENDER_SIMD_AUTO);
+    if (enabled && !g_simd_kernels)
+    {
+        LOG_WARN("SIMD Rasterizer: not available in this build");
+        enabled = false;
+    }
+
+    g_simd_enabled = enabled;
+    g_kernels = enabled ? g_simd_kernels : &raster_kernels_scalar;
+    LOG_INFO("SIMD Rasterizer: %s (%s)", enabled ? "ON" : "OFF", g_kernels->name);
+}
+
+bool render_set_simd_isa(RenderSimdIsa isa)
+{
+    const RasterKernels *k = raster_get_kernels(isa);
+    if (!k)
+    {
+        LOG_WARN("SIMD ISA not supported on this CPU");
+        return false;
+    }
+
+    g_simd_kernels = k;
+    if (g_simd_enabled)
+        g_kernels = k;
+    LOG_INFO("SIMD ISA: %s (%d lanes)", k->name, k->lanes);
+    return true;
+}
+
+const char *render_get_simd_isa_name(void)
+{
+    if (!g_simd_kernels)
+        g_simd_kernels = raster_get_kernels(RENDER_SIMD_AUTO);
+    return g_simd_kernels ? g_simd_kernels->name : raster_kernels_scalar.name;
+}
+
+void render_set_hiz(bool enabled)
+{
+    g_hiz_enabled = enabled;
+    LOG_INFO("Hi-Z culling: %s", enabled ? "ON" : "OFF");
+}
+
+// Counting starts with the next depth clear; turning it off frees the
+// counts of both frame slots
+void render_set_overdraw(bool enabled)
+{
+    g_overdraw_enabled = enabled;
+    if (!enabled)
+    {
+        render_finish_frames();
+        for (int i = 0; i < 2; i++)
+        {
+            free(g_frames[i].overdraw);
+            g_frames[i].overdraw = NULL;
+            g_frames[i].overdraw_width = 0;
+            g_frames[i].overdraw_height = 0;
+        }
+    }
+    LOG_INFO("Overdraw counting: %s", enabled ? "ON" : "OFF");
+}
+
+bool render_get_overdraw(void)
+{
+    return g_overdraw_enabled;
 }
 
 bool render_get_threaded(void)
 {
-    return g_threaded;
+    return g_thread_mode != RENDER_THREAD_OFF;
+}
+
+bool render_is_recording(void)
+{
+    return g_thread_mode != RENDER_THREAD_OFF && threadpool_is_active();
 }
 
 void render_begin_commands(void)
 {
-    g_cmd_count = 0;
+    frame_begin();
+    g_frame->cmd_count = 0;
+    g_frame->vtx_count = 0;
+}
+
+bool render_begin_batches(int count)
+{
+    if (count > g_batch_capacity)
+    {
+        int cap = g_batch_capacity ? g_batch_capacity : 256;
+        while (cap < count)
+            cap *= 2;
+        CmdBatch *batches = realloc(g_batches, (size_t)cap * sizeof(CmdBatch));
+        if (!batches)
+        {
+            LOG_ERROR("Failed to allocate %d command batches", count);
+            return false;
+        }
+        g_batches = batches;
+        g_batch_capacity = cap;
+    }
+
+    int lists = threadpool_get_count() + 1;
+    if (lists > g_thread_cmd_count)
+    {
+        CmdList *cmds = realloc(g_thread_cmds, (size_t)lists * sizeof(CmdList));
+        if (!cmds)
+        {
+            LOG_ERROR("Failed to allocate %d command lists", lists);
+            return false;
+        }
+        memset(cmds + g_thread_cmd_count, 0, (size_t)(lists - g_thread_cmd_count) * sizeof(CmdList));
+        g_thread_cmds = cmds;
+        g_thread_cmd_count = lists;
+    }
+
+    for (int i = 0; i < g_thread_cmd_count; i++)
+    {
+        g_thread_cmds[i].count = 0;
+        g_thread_cmds[i].vtx_count = 0;
+    }
+    for (int i = 0; i < count; i++)
+        g_batches[i] = (CmdBatch){0};
+    g_batch_count = count;
+    return true;
+}
+
+void render_begin_batch(int batch)
+{
+    int list = threadpool_get_worker_id() + 1;
+    t_cmd_list = &g_thread_cmds[list];
+    t_batch = batch;
+    g_batches[batch] = (CmdBatch){list, t_cmd_list->count, t_cmd_list->count,
+                                  t_cmd_list->vtx_count, t_cmd_list->vtx_count};
+}
+
+void render_end_batch(void)
+{
+    g_batches[t_batch].end = t_cmd_list->count;
+    g_batches[t_batch].vtx_end = t_cmd_list->vtx_count;
+    t_cmd_list = NULL;
+    t_batch = -1;
+}
+
+void render_merge_batches(void)
+{
+    for (int i = 0; i < g_batch_count; i++)
+    {
+        const CmdBatch *b = &g_batches[i];
+        const CmdList *list = &g_thread_cmds[b->list];
+        int n = b->end - b->start;
+        int nv = b->vtx_end - b->vtx_start;
+        if (!arena_reserve(&g_frame->cmd_arena, g_frame->cmd_count + n) ||
+            !arena_reserve(&g_frame->vtx_arena, g_frame->vtx_count + nv))
+        {
+            LOG_ERROR("Render command arena: out of memory at %d commands", g_frame->cmd_count);
+            break;
+        }
+
+        // Vertices copy block by block (a batch can straddle arena blocks);
+        // commands are rebased onto the batch's place in the vertex arena
+        const RenderVertex *src = &list->verts[b->vtx_start];
+        uint32_t rebase = (uint32_t)(g_frame->vtx_count - b->vtx_start);
+        while (nv > 0)
+        {
+            int room = CMD_BLOCK_SIZE - (g_frame->vtx_count & CMD_BLOCK_MASK);
+            int k = nv < room ? nv : room;
+            memcpy(vtx_at(g_frame->vtx_count), src, (size_t)k * sizeof(RenderVertex));
+            g_frame->vtx_count += k;
+            src += k;
+            nv -= k;
+        }
+
+        for (int c = b->start; c < b->end; c++)
+        {
+            RenderCmd *cmd = cmd_at(g_frame->cmd_count++);
+            *cmd = list->cmds[c];
+            cmd->v[0] += rebase;
+            cmd->v[1] += rebase;
+            cmd->v[2] += rebase;
+        }
+    }
+    g_batch_count = 0;
+}
+
+// Sort the command stream into per-tile bins. Two passes over the commands:
+// count the tiles each triangle's bounding box touches, then scatter the
+// command indices. Walking commands in order keeps every bin in submission order.
+// Commands were bounded (and off-screen ones dropped) at submission time.
+static bool bin_commands(int tiles_x, int tiles_y, int tile_size)
+{
+    PROFILE_SCOPE(PROFILE_BIN);
+    int tile_count = tiles_x * tiles_y;
+    if (tile_count + 1 > g_bin_tile_capacity)
+    {
+        int cap = tile_count + 1;
+        int *offsets = realloc(g_bin_offsets, (size_t)cap * sizeof(int));
+        int *cursor = realloc(g_bin_cursor, (size_t)cap * sizeof(int));
+        uint32_t *cost = realloc(g_tile_cost, (size_t)cap * sizeof(uint32_t));
+        if (offsets)
+            g_bin_offsets = offsets;
+        if (cursor)
+            g_bin_cursor = cursor;
+        if (cost)
+            g_tile_cost = cost;
+        if (!offsets || !cursor || !cost)
+        {
+            LOG_ERROR("Binning: failed to allocate %d tile bins", tile_count);
+            return false;
+        }
+        g_bin_tile_capacity = cap;
+        g_bin_tiles_x = 0;
+    }
+
+    // Costs from another tile grid say nothing about this one
+    if (tiles_x != g_bin_tiles_x || tile_size != g_bin_tile_size)
+        memset(g_tile_cost, 0, (size_t)tile_count * sizeof(uint32_t));
+    g_bin_tiles_x = tiles_x;
+    g_bin_tile_size = tile_size;
+
+    for (int t = 0; t <= tile_count; t++)
+        g_bin_offsets[t] = 0;
+
+    int total = 0;
+    for (int i = 0; i < g_frame->cmd_count; i++)
+    {
+        const RenderCmd *cmd = cmd_at(i);
+        int bx0 = cmd->min_x / tile_size, bx1 = cmd->max_x / tile_size;
+        int by0 = cmd->min_y / tile_size, by1 = cmd->max_y / tile_size;
+
+        for (int ty = by0; ty <= by1; ty++)
+            for (int tx = bx0; tx <= bx1; tx++)
+                g_bin_offsets[ty * tiles_x + tx + 1]++;
+        total += (bx1 - bx0 + 1) * (by1 - by0 + 1);
+    }
+
+    if (total > g_bin_cmd_capacity)
+    {
+        int cap = g_bin_cmd_capacity ? g_bin_cmd_capacity : 4096;
+        while (cap < total)
+            cap *= 2;
+        int *cmds = realloc(g_bin_cmds, (size_t)cap * sizeof(int));
+        if (!cmds)
+        {
+            LOG_ERROR("Binning: failed to allocate %d bin entries", total);
+            return false;
+        }
+        g_bin_cmds = cmds;
+        g_bin_cmd_capacity = cap;
+    }
+
+    g_bin_entries = total;
+    g_bin_max = 0;
+    g_bin_active = 0;
+    for (int t = 0; t < tile_count; t++)
+    {
+        int size = g_bin_offsets[t + 1];
+        if (size > g_bin_max)
+            g_bin_max = size;
+        if (size > 0)
+            g_bin_active++;
+        g_bin_offsets[t + 1] += g_bin_offsets[t];
+        g_bin_cursor[t] = g_bin_offsets[t];
+    }
+
+    for (int i = 0; i < g_frame->cmd_count; i++)
+    {
+        const RenderCmd *cmd = cmd_at(i);
+        int bx0 = cmd->min_x / tile_size, bx1 = cmd->max_x / tile_size;
+        int by0 = cmd->min_y / tile_size, by1 = cmd->max_y / tile_size;
+        for (int ty = by0; ty <= by1; ty++)
+            for (int tx = bx0; tx <= bx1; tx++)
+                g_bin_cmds[g_bin_cursor[ty * tiles_x + tx]++] = i;
+    }
+
+    return true;
+}
+
+static void frame_wait(RenderFrame *f)
+{
+    if (!f->in_flight)
+        return;
+    ProfileScope wait_scope = profile_begin(PROFILE_WAIT);
+    job_wait(&f->raster);
+    profile_end(&wait_scope);
+    f->in_flight = false;
+
+    if (f->timed)
+    {
+        int s = f->strategy == RENDER_THREAD_SORT_LAST;
+        int64_t ns = atomic_load_explicit(&f->done_ns, memory_order_relaxed) - f->start_ns;
+        if (g_auto_samples[s] == 0 || ns < g_auto_best[s])
+            g_auto_best[s] = ns;
+        g_auto_samples[s]++;
+        f->timed = false;
+    }
+}
+
+// Strategy for a frame in RENDER_THREAD_AUTO
+static RenderThreadMode auto_strategy(int cmd_count)
+{
+    if (g_auto_hold > 0)
+    {
+        if (cmd_count * 2 >= g_auto_cmds && cmd_count <= g_auto_cmds * 2)
+        {
+            g_auto_hold--;
+            return g_auto_choice;
+        }
+        g_auto_hold = 0;
+    }
+
+    if (g_auto_samples[0] < RENDER_AUTO_PROBE)
+        return RENDER_THREAD_TILES;
+    if (g_auto_samples[1] < RENDER_AUTO_PROBE)
+        return RENDER_THREAD_SORT_LAST;
+
+    g_auto_choice = g_auto_best[1] < g_auto_best[0] ? RENDER_THREAD_SORT_LAST : RENDER_THREAD_TILES;
+    g_auto_hold = RENDER_AUTO_HOLD;
+    g_auto_cmds = cmd_count;
+    LOG_INFO("Threaded rasterizer: %s (tiles %.2f ms, sort-last %.2f ms, %d triangles)",
+             g_auto_choice == RENDER_THREAD_SORT_LAST ? "sort-last" : "tiles",
+             (double)g_auto_best[0] / 1e6, (double)g_auto_best[1] / 1e6, cmd_count);
+    g_auto_samples[0] = 0;
+    g_auto_samples[1] = 0;
+    return g_auto_choice;
+}
+
+void render_finish_frames(void)
+{
+    frame_wait(&g_frames[0]);
+    frame_wait(&g_frames[1]);
+}
+
+// Both buffers are first touched from the pool, so on NUMA machines each
+// band of rows lives on the node whose workers draw it. These are the
+// first slot's; drawing goes back to it.
+void render_set_framebuffer(uint32_t *buffer)
+{
+    render_finish_frames();
+    threadpool_first_touch(buffer, (size_t)RENDER_WIDTH * sizeof(uint32_t), RENDER_HEIGHT);
+    g_frames[0].framebuffer = buffer;
+    g_frame = &g_frames[0];
+    g_frame_lag = 0;
+    g_other_previous = false;
+    g_swap_on_begin = false;
+    LOG_INFO("Framebuffer initialized (%dx%d)", RENDER_WIDTH, RENDER_HEIGHT);
+}
+
+void render_set_zbuffer(float *buffer)
+{
+    render_finish_frames();
+    threadpool_first_touch(buffer, (size_t)RENDER_WIDTH * sizeof(float), RENDER_HEIGHT);
+    g_frames[0].zbuffer = buffer;
+    g_frame = &g_frames[0];
+    g_frame_lag = 0;
+    g_other_previous = false;
+    g_swap_on_begin = false;
+    LOG_INFO("Z-buffer initialized");
+}
+
+void render_set_pipeline_buffers(uint32_t *framebuffer, float *zbuffer)
+{
+    render_finish_frames();
+    if (framebuffer)
+    {
+        threadpool_first_touch(framebuffer, (size_t)RENDER_WIDTH * sizeof(uint32_t), RENDER_HEIGHT);
+        memset(framebuffer, 0, (size_t)RENDER_WIDTH * RENDER_HEIGHT * sizeof(uint32_t));
+    }
+    threadpool_first_touch(zbuffer, (size_t)RENDER_WIDTH * sizeof(float), RENDER_HEIGHT);
+    g_frames[1].framebuffer = framebuffer;
+    g_frames[1].zbuffer = zbuffer;
+    g_frame = &g_frames[0];
+    g_frame_lag = 0;
+    g_other_previous = false;
+    g_swap_on_begin = false;
+}
+
+void render_set_pipelined(bool enabled)
+{
+    if (!enabled)
+        render_finish_frames();
+    g_pipelined = enabled;
+    g_swap_on_begin = false;
+    LOG_INFO("Frame pipelining: %s", enabled ? "ON" : "OFF");
+}
+
+bool render_get_pipelined(void)
+{
+    return g_pipelined;
+}
+
+int render_get_frame_lag(void)
+{
+    return g_frame_lag;
+}
+
+uint32_t *render_get_framebuffer(void)
+{
+    return g_frame->framebuffer;
+}
+
+// Frame capture. A capture file holds everything render_flush_commands
+// reads: resolution, fog and skybox, every texture the commands reference
+// (pixels copied), the vertex arena and the commands, with texture pointers
+// turned into indices. Native byte order.
+#define CAPTURE_MAGIC 0x50414352u // "RCAP"
+#define CAPTURE_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t width, height;
+    uint32_t fog_enabled;
+    float fog_start, fog_end;
+    uint32_t fog_color;
+    uint32_t skybox_top, skybox_bottom;
+    int32_t texture_count;
+    int32_t vertex_count;
+    int32_t cmd_count;
+} CaptureHeader;
+
+typedef struct
+{
+    uint32_t v[3];
+    int16_t min_x, min_y, max_x, max_y;
+    uint32_t color; // Or the light intensity's bits
+    int32_t tex;    // Index into the capture's textures, -1 for flat
+} CaptureCmd;
+
+struct RenderCapture
+{
+    CaptureHeader header;
+    Texture *textures;
+    RenderVertex *vertices;
+    RenderCmd *cmds;
+};
+
+static char g_capture_path[256] = ""; // Written by the next flush
+
+bool render_capture_next(const char *path)
+{
+    if (!path || !path[0] || strlen(path) >= sizeof(g_capture_path))
+        return false;
+    strcpy(g_capture_path, path);
+    return true;
+}
+
+static bool capture_write(const RenderFrame *f, const char *path)
+{
+    const Texture **textures = NULL;
+    int tex_count = 0, tex_capacity = 0;
+    CaptureCmd *cmds = malloc((size_t)(f->cmd_count ? f->cmd_count : 1) * sizeof(CaptureCmd));
+    bool ok = cmds != NULL;
+
+    // Textures in order of first use; consecutive commands mostly share one
+    int last = -1;
+    for (int i = 0; ok && i < f->cmd_count; i++)
+    {
+        const RenderCmd *cmd = arena_at(&f->cmd_arena, i);
+        int tex = -1;
+        if (cmd->tex)
+        {
+            if (last >= 0 && textures[last] == cmd->tex)
+                tex = last;
+            for (int t = 0; tex < 0 && t < tex_count; t++)
+            {
+                if (textures[t] == cmd->tex)
+                    tex = t;
+            }
+            if (tex < 0)
+            {
+                ok = list_grow((void **)&textures, &tex_capacity, tex_count, sizeof(Texture *));
+                if (!ok)
+                    break;
+                textures[tex_count] = cmd->tex;
+                tex = tex_count++;
+            }
+            last = tex;
+        }
+        cmds[i] = (CaptureCmd){{cmd->v[0], cmd->v[1], cmd->v[2]},
+                               cmd->min_x, cmd->min_y, cmd->max_x, cmd->max_y, cmd->color, tex};
+    }
+
+    FILE *fp = ok ? fopen(path, "wb") : NULL;
+    if (fp)
+    {
+        CaptureHeader header = {
+            .magic = CAPTURE_MAGIC,
+            .version = CAPTURE_VERSION,
+            .width = RENDER_WIDTH,
+            .height = RENDER_HEIGHT,
+            .fog_enabled = g_fog_enabled,
+            .fog_start = g_fog_start,
+            .fog_end = g_fog_end,
+            .fog_color = g_fog_color,
+            .skybox_top = g_skybox_top,
+            .skybox_bottom = g_skybox_bottom,
+            .texture_count = tex_count,
+            .vertex_count = f->vtx_count,
+            .cmd_count = f->cmd_count,
+        };
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        for (int t = 0; ok && t < tex_count; t++)
+        {
+            int32_t size[2] = {textures[t]->width, textures[t]->height};
+            size_t pixels = (size_t)size[0] * (size_t)size[1];
+            ok = fwrite(size, sizeof(size), 1, fp) == 1 &&
+                 fwrite(textures[t]->pixels, sizeof(uint32_t), pixels, fp) == pixels;
+        }
+        for (int i = 0; ok && i < f->vtx_count; i += CMD_BLOCK_SIZE)
+        {
+            size_t n = f->vtx_count - i < CMD_BLOCK_SIZE ? (size_t)(f->vtx_count - i) : CMD_BLOCK_SIZE;
+            ok = fwrite(arena_at(&f->vtx_arena, i), sizeof(RenderVertex), n, fp) == n;
+        }
+        ok = ok && fwrite(cmds, sizeof(CaptureCmd), f->cmd_count, fp) == (size_t)f->cmd_count;
+        if (fclose(fp) != 0)
+            ok = false;
+    }
+    else
+    {
+        ok = false;
+    }
+
+    if (ok)
+        LOG_INFO("Frame captured to %s: %d triangles, %d vertices, %d textures",
+                 path, f->cmd_count, f->vtx_count, tex_count);
+    else
+        LOG_ERROR("Frame capture to %s failed", path);
+    free(textures);
+    free(cmds);
+    return ok;
+}
+
+RenderCapture *render_capture_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        LOG_ERROR("Cannot open capture: %s", path);
+        return NULL;
+    }
+
+    RenderCapture *cap = calloc(1, sizeof(RenderCapture));
+    CaptureHeader *h = cap ? &cap->header : NULL;
+    bool ok = cap && fread(h, sizeof(*h), 1, fp) == 1 &&
+              h->magic == CAPTURE_MAGIC && h->version == CAPTURE_VERSION &&
+              h->width > 0 && h->width <= RENDER_MAX_DIM &&
+              h->height > 0 && h->height <= RENDER_MAX_DIM &&
+              h->texture_count >= 0 && h->vertex_count >= 0 && h->cmd_count >= 0;
+    if (ok)
+    {
+        cap->textures = calloc((size_t)h->texture_count + 1, sizeof(Texture));
+        cap->vertices = malloc(((size_t)h->vertex_count + 1) * sizeof(RenderVertex));
+        cap->cmds = malloc(((size_t)h->cmd_count + 1) * sizeof(RenderCmd));
+        ok = cap->textures && cap->vertices && cap->cmds;
+    }
+
+    for (int t = 0; ok && t < h->texture_count; t++)
+    {
+        int32_t size[2];
+        ok = fread(size, sizeof(size), 1, fp) == 1 && size[0] > 0 && size[1] > 0;
+        if (!ok)
+            break;
+        size_t pixels = (size_t)size[0] * (size_t)size[1];
+        Texture *tex = &cap->textures[t];
+        tex->pixels = malloc(pixels * sizeof(uint32_t));
+        tex->width = size[0];
+        tex->height = size[1];
+        ok = tex->pixels && fread(tex->pixels, sizeof(uint32_t), pixels, fp) == pixels;
+    }
+
+    ok = ok && fread(cap->vertices, sizeof(RenderVertex), h->vertex_count, fp) == (size_t)h->vertex_count;
+    for (int i = 0; ok && i < h->cmd_count; i++)
+    {
+        CaptureCmd c;
+        ok = fread(&c, sizeof(c), 1, fp) == 1 &&
+             c.v[0] < (uint32_t)h->vertex_count && c.v[1] < (uint32_t)h->vertex_count &&
+             c.v[2] < (uint32_t)h->vertex_count && c.tex >= -1 && c.tex < h->texture_count &&
+             c.min_x >= 0 && c.min_y >= 0 && c.max_x < h->width && c.max_y < h->height;
+        RenderCmd *cmd = &cap->cmds[i];
+        *cmd = (RenderCmd){.v = {c.v[0], c.v[1], c.v[2]},
+                           .min_x = c.min_x, .min_y = c.min_y, .max_x = c.max_x, .max_y = c.max_y,
+                           .color = c.color,
+                           .tex = c.tex >= 0 ? &cap->textures[c.tex] : NULL};
+    }
+    fclose(fp);
+
+    if (!ok)
+    {
+        LOG_ERROR("Not a valid frame capture: %s", path);
+        render_capture_free(cap);
+        return NULL;
+    }
+    LOG_INFO("Capture %s: %dx%d, %d triangles, %d vertices, %d textures", path,
+             h->width, h->height, h->cmd_count, h->vertex_count, h->texture_count);
+    return cap;
+}
+
+void render_capture_free(RenderCapture *cap)
+{
+    if (!cap)
+        return;
+    for (int t = 0; cap->textures && t < cap->header.texture_count; t++)
+        texture_free(&cap->textures[t]);
+    free(cap->textures);
+    free(cap->vertices);
+    free(cap->cmds);
+    free(cap);
+}
+
+void render_capture_get_info(const RenderCapture *cap, int *width, int *height,
+                             int *cmd_count, int *vertex_count)
+{
+    if (width)
+        *width = cap->header.width;
+    if (height)
+        *height = cap->header.height;
+    if (cmd_count)
+        *cmd_count = cap->header.cmd_count;
+    if (vertex_count)
+        *vertex_count = cap->header.vertex_count;
+}
+
+bool render_capture_replay(const RenderCapture *cap)
+{
+    const CaptureHeader *h = &cap->header;
+    if (h->width != RENDER_WIDTH || h->height != RENDER_HEIGHT)
+        return false;
+
+    render_set_fog(h->fog_enabled, h->fog_start, h->fog_end, h->fog_color);
+    render_set_skybox(h->skybox_top, h->skybox_bottom);
+    render_clear_gradient();
+    render_clear_zbuffer();
+
+    if (!render_is_recording())
+    {
+        // The immediate path: each triangle straight through the kernels
+        RasterTarget rt = render_target(&g_raster_counters);
+        for (int i = 0; i < h->cmd_count; i++)
+        {
+            const RenderCmd *cmd = &cap->cmds[i];
+            const RenderVertex *v[3] = {&cap->vertices[cmd->v[0]], &cap->vertices[cmd->v[1]],
+                                        &cap->vertices[cmd->v[2]]};
+            TriSetup ts;
+            tri_setup(&ts, cmd, v);
+            if (cmd->tex)
+                g_kernels->textured(&rt, &ts, cmd->tex, cmd->light, 0, 0, RENDER_WIDTH - 1, RENDER_HEIGHT - 1);
+            else
+                g_kernels->flat(&rt, &ts, cmd->color, 0, 0, RENDER_WIDTH - 1, RENDER_HEIGHT - 1);
+        }
+        g_flush_cmds = h->cmd_count;
+        g_flush_vertices = h->vertex_count;
+        return true;
+    }
+
+    render_begin_commands();
+    if (!arena_reserve(&g_frame->cmd_arena, h->cmd_count) ||
+        !arena_reserve(&g_frame->vtx_arena, h->vertex_count))
+    {
+        LOG_ERROR("Render command arena: out of memory replaying %d commands", h->cmd_count);
+        return false;
+    }
+    for (int i = 0; i < h->vertex_count; i += CMD_BLOCK_SIZE)
+    {
+        int n = h->vertex_count - i < CMD_BLOCK_SIZE ? h->vertex_count - i : CMD_BLOCK_SIZE;
+        memcpy(vtx_at(i), &cap->vertices[i], (size_t)n * sizeof(RenderVertex));
+    }
+    for (int i = 0; i < h->cmd_count; i += CMD_BLOCK_SIZE)
+    {
+        int n = h->cmd_count - i < CMD_BLOCK_SIZE ? h->cmd_count - i : CMD_BLOCK_SIZE;
+        memcpy(cmd_at(i), &cap->cmds[i], (size_t)n * sizeof(RenderCmd));
+    }
+    g_frame->vtx_count = h->vertex_count;
+    g_frame->cmd_count = h->cmd_count;
+    render_flush_commands();
+    return true;
 }
 
 void render_flush_commands(void)
 {
-    if (g_cmd_count == 0)
+    // At most one frame in flight: the other slot's raster finishes before
+    // this frame touches the shared bins
+    RenderFrame *other = &g_frames[g_frame == &g_frames[0]];
+    frame_wait(other);
+    bool overlap = g_pipelined && other->framebuffer && other->zbuffer;
+    bool other_previous = g_other_previous;
+    g_frame_lag = 0;
+    g_other_previous = false;
+    g_swap_on_begin = overlap;
+
+    g_bin_entries = 0;
+    g_bin_max = 0;
+    g_bin_active = 0;
+    g_flush_cmds = g_frame->cmd_count;
+    g_flush_vertices = g_frame->vtx_count;
+    if (g_frame->cmd_count > g_cmd_high_water)
+    {
+        g_cmd_high_water = g_frame->cmd_count;
+        LOG_INFO("Render commands: new high-water mark %d, %d vertices (%d KB arena)",
+                 g_frame->cmd_count, g_frame->vtx_count,
+                 (int)((arena_bytes(&g_frame->cmd_arena) + arena_bytes(&g_frame->vtx_arena)) / 1024));
+    }
+
+    if (g_capture_path[0])
+    {
+        capture_write(g_frame, g_capture_path);
+        g_capture_path[0] = '\0';
+    }
+
+    if (g_frame->cmd_count == 0)
         return;
 
-    int tiles_x = (RENDER_WIDTH + TILE_SIZE - 1) / TILE_SIZE;
-    int tiles_y = (RENDER_HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+    RenderThreadMode strategy = g_thread_mode;
+    if (strategy == RENDER_THREAD_AUTO)
+        strategy = auto_strategy(g_frame->cmd_count);
+    g_frame->kernels = g_kernels;
+    g_frame->target = render_target(NULL);
+    g_frame->strategy = strategy;
+    g_frame->timed = g_thread_mode == RENDER_THREAD_AUTO && g_auto_hold == 0;
+    g_frame->start_ns = g_frame->timed ? render_time_ns() : 0;
+    atomic_store_explicit(&g_frame->done_ns, g_frame->start_ns, memory_order_relaxed);
+
+    // Small frames always go through the tiles, drawn inline
+    if (strategy != RENDER_THREAD_SORT_LAST || g_frame->cmd_count < RENDER_INLINE_CMDS ||
+        !sort_last_dispatch(g_frame))
+    {
+        g_frame->strategy = RENDER_THREAD_TILES;
+        tile_size_update();
+        int tile_size = g_tile_size;
+        int tiles_x = (RENDER_WIDTH + tile_size - 1) / tile_size;
+        int tiles_y = (RENDER_HEIGHT + tile_size - 1) / tile_size;
+
+        if (!bin_commands(tiles_x, tiles_y, tile_size))
+        {
+            g_frame->timed = false;
+            return;
+        }
+        if (g_frame->cmd_count < RENDER_INLINE_CMDS)
+        {
+            g_frame->timed = false;
+            threadpool_dispatch_local(tiles_x, tiles_y, tile_size,
+                                      RENDER_WIDTH, RENDER_HEIGHT,
+                                      tile_rasterize, g_frame);
+            return;
+        }
+
+        // Unless the previous frame is handed back below, this thread
+        // waits on the tiles right away, so it is dealt its share
+        g_frame->in_flight = true;
+        threadpool_dispatch_async(tiles_x, tiles_y, tile_size,
+                                  RENDER_WIDTH, RENDER_HEIGHT, g_tile_cost,
+                                  tile_rasterize, g_frame, &g_frame->raster,
+                                  !(overlap && other_previous));
+    }
 
-    threadpool_dispatch(tiles_x, tiles_y, TILE_SIZE,
-                        RENDER_WIDTH, RENDER_HEIGHT,
-                        tile_rasterize, NULL);
+    // Pipelined: leave the tiles running and hand the caller the previous
+    // frame, complete, for its overlays and for presenting. The next frame
+    // is then recorded into that slot.
+    if (overlap && other_previous)
+    {
+        g_frame = other;
+        g_frame_lag = 1;
+        g_other_previous = true;
+        g_swap_on_begin = false;
+        return;
+    }
+    frame_wait(g_frame);
 }
 
 int render_get_cmd_count(void)
 {
-    return g_cmd_count;
+    return g_frame->cmd_count;
+}
+
+void render_collect_stats(RenderStats *stats_out)
+{
+    if (!stats_out)
+        return;
+    stats_out->cmd_count += g_flush_cmds;
+    stats_out->cmd_vertices += g_flush_vertices;
+    if (g_cmd_high_water > stats_out->cmd_high_water)
+        stats_out->cmd_high_water = g_cmd_high_water;
+    stats_out->bin_entries += g_bin_entries;
+    stats_out->bin_active += g_bin_active;
+    if (g_bin_max > stats_out->bin_max)
+        stats_out->bin_max = g_bin_max;
+    stats_out->hiz_tiles_rejected += g_raster_counters.hiz_tiles_rejected +
+                                     atomic_exchange(&g_tile_hiz_tiles_rejected, 0);
+    stats_out->hiz_blocks_rejected += g_raster_counters.hiz_blocks_rejected +
+                                      atomic_exchange(&g_tile_hiz_blocks_rejected, 0);
+    stats_out->pixels_tested += g_raster_counters.pixels_tested +
+                                atomic_exchange(&g_tile_pixels_tested, 0);
+    stats_out->pixels_passed += g_raster_counters.pixels_passed +
+                                atomic_exchange(&g_tile_pixels_passed, 0);
+    stats_out->pixels_shaded += g_raster_counters.pixels_shaded +
+                                atomic_exchange(&g_tile_pixels_shaded, 0);
+
+    // The frame handed back by the last flush is complete, so its counts
+    // are final
+    if (g_overdraw_enabled && g_frame->overdraw && g_frame->overdraw_width == RENDER_WIDTH &&
+        g_frame->overdraw_height == RENDER_HEIGHT)
+    {
+        int visible = 0;
+        for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++)
+            visible += g_frame->overdraw[i] != 0;
+        stats_out->pixels_visible += visible;
+    }
+
+    // Counters restart for the next frame
+    g_flush_cmds = 0;
+    g_flush_vertices = 0;
+    g_bin_entries = 0;
+    g_bin_active = 0;
+    g_bin_max = 0;
+    g_raster_counters = (RasterCounters){0};
 }
 
 static const uint32_t s_tile_colors[] = {
@@ -1072,28 +2291,41 @@ static uint32_t blend_tile_color(uint32_t base, uint32_t overlay)
     return 0xFF000000 | (fr << 16) | (fg << 8) | fb;
 }
 
+// Shows the last dispatch, so any frame still rasterizing is finished first
 void render_draw_tile_debug(void)
 {
+    render_finish_frames();
+
     int tiles_x = threadpool_get_tiles_x();
     int tiles_y = threadpool_get_tiles_y();
+    int tile_size = threadpool_get_tile_size();
     const int *owners = threadpool_get_tile_owners();
     int num_colors = (int)(sizeof(s_tile_colors) / sizeof(s_tile_colors[0]));
 
-    if (tiles_x <= 0 || tiles_y <= 0)
+    if (tiles_x <= 0 || tiles_y <= 0 || !owners)
         return;
 
+    // Cost bars are scaled to the slowest tile of the last flush
+    bool costs = g_tile_cost && tiles_x == g_bin_tiles_x && tile_size == g_bin_tile_size;
+    uint32_t max_cost = 1;
+    for (int t = 0; costs && t < tiles_x * tiles_y; t++)
+    {
+        if (g_tile_cost[t] > max_cost)
+            max_cost = g_tile_cost[t];
+    }
+
     for (int ty = 0; ty < tiles_y; ty++)
     {
         for (int tx = 0; tx < tiles_x; tx++)
         {
             int tile_idx = ty * tiles_x + tx;
-            int owner = (tile_idx < 1024) ? owners[tile_idx] : 0;
+            int owner = owners[tile_idx] >= 0 ? owners[tile_idx] : 0;
             uint32_t tint = s_tile_colors[owner % num_colors];
 
-            int px = tx * TILE_SIZE;
-            int py = ty * TILE_SIZE;
-            int pw = TILE_SIZE;
-            int ph = TILE_SIZE;
+            int px = tx * tile_size;
+            int py = ty * tile_size;
+            int pw = tile_size;
+            int ph = tile_size;
             if (px + pw > RENDER_WIDTH)
                 pw = RENDER_WIDTH - px;
             if (py + ph > RENDER_HEIGHT)
@@ -1104,7 +2336,7 @@ void render_draw_tile_debug(void)
                 for (int x = px; x < px + pw; x++)
                 {
                     int idx = y * RENDER_WIDTH + x;
-                    g_framebuffer[idx] = blend_tile_color(g_framebuffer[idx], tint);
+                    g_frame->framebuffer[idx] = blend_tile_color(g_frame->framebuffer[idx], tint);
                 }
             }
 
@@ -1112,13 +2344,56 @@ void render_draw_tile_debug(void)
             for (int x = px; x < px + pw; x++)
             {
                 if (py >= 0 && py < RENDER_HEIGHT)
-                    g_framebuffer[py * RENDER_WIDTH + x] = grid_color;
+                    g_frame->framebuffer[py * RENDER_WIDTH + x] = grid_color;
             }
             for (int y = py; y < py + ph; y++)
             {
                 if (px >= 0 && px < RENDER_WIDTH)
-                    g_framebuffer[y * RENDER_WIDTH + px] = grid_color;
+                    g_frame->framebuffer[y * RENDER_WIDTH + px] = grid_color;
+            }
+
+            // Cost bar along the bottom edge
+            if (costs && ph > 3)
+            {
+                int bar = (int)((uint64_t)g_tile_cost[tile_idx] * (uint64_t)(pw - 1) / max_cost);
+                for (int y = py + ph - 3; y < py + ph; y++)
+                    for (int x = px + 1; x <= px + bar; x++)
+                        g_frame->framebuffer[y * RENDER_WIDTH + x] = 0xFFFF3030;
             }
         }
     }
 }
+
+// Overdraw heat ramp: index is the number of depth-passing writes, the
+// last entry covers everything above
+static const uint32_t s_overdraw_colors[] = {
+    0xC0000000, // Nothing drawn
+    0xC00000A0,
+    0xC00060FF,
+    0xC000C0C0,
+    0xC000D000,
+    0xC0C0E000,
+    0xC0FFA000,
+    0xC0FF4000,
+    0xC0FF0000,
+    0xC0FF00FF,
+};
+
+// Per-pixel heatmap of the last frame's overdraw; needs render_set_overdraw
+// on since the last depth clear. Like the tile view, any frame still
+// rasterizing is finished first.
+void render_draw_overdraw_debug(void)
+{
+    render_finish_frames();
+
+    if (!g_frame->overdraw || g_frame->overdraw_width != RENDER_WIDTH ||
+        g_frame->overdraw_height != RENDER_HEIGHT)
+        return;
+
+    int last = (int)(sizeof(s_overdraw_colors) / sizeof(s_overdraw_colors[0])) - 1;
+    for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++)
+    {
+        int count = g_frame->overdraw[i] < last ? g_frame->overdraw[i] : last;
+        g_frame->framebuffer[i] = blend_tile_color(g_frame->framebuffer[i], s_overdraw_colors[count]);
+    }
+}
@@ -7,6 +7,7 @@
 
 #define DEFAULT_RENDER_WIDTH 640
 #define DEFAULT_RENDER_HEIGHT 480
+#define RENDER_MAX_DIM 2048
 
 extern int g_render_width;
 extern int g_render_height;
@@ -14,8 +15,28 @@ extern int g_render_height;
 #define RENDER_WIDTH g_render_width
 #define RENDER_HEIGHT g_render_height
 
+struct RenderStats;
+
 void render_set_framebuffer(uint32_t *buffer);
 void render_set_zbuffer(float *buffer);
+// Second framebuffer / z-buffer pair for frame pipelining (NULL: none)
+void render_set_pipeline_buffers(uint32_t *framebuffer, float *zbuffer);
+
+// Frame pipelining (threaded mode, needs the pipeline buffers). While on,
+// render_flush_commands starts the frame's tiles and returns without
+// waiting: drawing switches to the previous frame, now complete, for
+// overlays and presenting, and the next frame is recorded there while the
+// pool finishes this one. At most one frame is in flight, so the added
+// latency is capped at one frame; off (the default) adds none.
+void render_set_pipelined(bool enabled);
+bool render_get_pipelined(void);
+// 1 when the buffers drawn to now hold the frame before the last flushed
+int render_get_frame_lag(void);
+// Framebuffer to present
+uint32_t *render_get_framebuffer(void);
+// Wait for any frame still rasterizing; required before freeing buffers,
+// meshes or textures it may read, or resizing the thread pool
+void render_finish_frames(void);
 void render_clear_zbuffer(void);
 void render_set_pixel(int x, int y, uint32_t color);
 
@@ -29,16 +50,18 @@ void render_draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 void render_draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 void render_fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 
+// Depth-tested triangles take sub-pixel screen positions (snapped to 28.4
+// fixed point) and follow the top-left fill rule.
 void render_fill_triangle_z(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
+    float x0, float y0, float z0, float w0,
+    float x1, float y1, float z1, float w1,
+    float x2, float y2, float z2, float w2,
     uint32_t color);
 
 void render_fill_triangle_textured(
-    int x0, int y0, float z0, float u0, float v0, float w0,
-    int x1, int y1, float z1, float u1, float v1, float w1,
-    int x2, int y2, float z2, float u2, float v2, float w2,
+    float x0, float y0, float z0, float u0, float v0, float w0,
+    float x1, float y1, float z1, float u1, float v1, float w1,
+    float x2, float y2, float z2, float u2, float v2, float w2,
     const Texture *tex, float light_intensity);
 
 void render_draw_aabb(AABB box, Mat4 vp, uint32_t color);
@@ -53,14 +76,87 @@ typedef struct
 ProjectedVertex render_project_vertex(Vec4 v);
 uint32_t render_shade_color(uint32_t base_color, float intensity);
 
+// Instruction sets the SIMD kernels are built for. AUTO picks the widest
+// one the CPU reports at startup.
+typedef enum
+{
+    RENDER_SIMD_AUTO,
+    RENDER_SIMD_SSE2,
+    RENDER_SIMD_AVX2,
+    RENDER_SIMD_AVX512,
+} RenderSimdIsa;
+
 void render_set_simd(bool enabled);
+bool render_set_simd_isa(RenderSimdIsa isa);
+const char *render_get_simd_isa_name(void);
+
+// Hierarchical-Z rejection of hidden triangles and 8x8 blocks (default on)
+void render_set_hiz(bool enabled);
 
-void render_set_threaded(bool enabled);
+// Per-pixel overdraw counts for render_draw_overdraw_debug and
+// RenderStats.pixels_visible (default off; costs an atomic per written pixel)
+void render_set_overdraw(bool enabled);
+bool render_get_overdraw(void);
+
+// How render commands are rasterized in parallel
+typedef enum
+{
+    RENDER_THREAD_OFF,       // Immediate mode on the calling thread
+    RENDER_THREAD_TILES,     // Sort-middle: triangles binned to screen tiles
+    RENDER_THREAD_SORT_LAST, // Triangle stream split evenly across the workers,
+                             // each into a private color+depth buffer, then
+                             // depth-composited
+    RENDER_THREAD_AUTO,      // Times both every few seconds and keeps the faster
+} RenderThreadMode;
+
+void render_set_threaded(RenderThreadMode mode);
+RenderThreadMode render_get_thread_mode(void);
+// True in any mode but RENDER_THREAD_OFF
 bool render_get_threaded(void);
+// Edge of the screen tiles the threaded rasterizer bins into, rounded to a
+// multiple of the 32-pixel Hi-Z tile. 0 (the default) picks it from the
+// resolution, pool size and cache sizes.
+void render_set_tile_size(int size);
+int render_get_tile_size(void);
+// True while triangles are recorded as commands for the tile rasterizer
+bool render_is_recording(void);
 void render_begin_commands(void);
+
+// Indexed recording: push post-transform vertices once and reference them
+// from any number of triangles. Only valid while recording; indices belong
+// to the current batch (or to the frame outside batches). A failed push
+// returns -1, and triangles using it are dropped.
+int render_push_vertex(float x, float y, float z, float w, float u, float v);
+void render_push_triangle(int a, int b, int c, uint32_t color);
+void render_push_triangle_textured(int a, int b, int c, const Texture *tex, float light_intensity);
+
+// Parallel recording: render_begin_batches(n) before dispatching, then each
+// job wraps its draws in render_begin_batch(i) / render_end_batch() on any
+// thread. render_merge_batches appends the batches in index order.
+bool render_begin_batches(int count);
+void render_begin_batch(int batch);
+void render_end_batch(void);
+void render_merge_batches(void);
 void render_flush_commands(void);
 int render_get_cmd_count(void);
+void render_collect_stats(struct RenderStats *stats_out);
 void render_draw_tile_debug(void);
+void render_draw_overdraw_debug(void);
+
+// Frame capture: one frame's complete rasterizer input (commands, vertices,
+// the textures they reference, fog, skybox, resolution) in a file, to replay
+// back-end work alone. render_capture_next writes the next frame
+// render_flush_commands receives, so it needs a threaded mode.
+typedef struct RenderCapture RenderCapture;
+bool render_capture_next(const char *path);
+RenderCapture *render_capture_load(const char *path);
+void render_capture_free(RenderCapture *cap);
+void render_capture_get_info(const RenderCapture *cap, int *width, int *height,
+                             int *cmd_count, int *vertex_count);
+// Clear to the capture's skybox and draw it into the current buffers,
+// through render_flush_commands in a threaded mode or the immediate
+// kernels otherwise; sets its fog. False if the resolution differs.
+bool render_capture_replay(const RenderCapture *cap);
 
 void render_set_resolution(int width, int height);
 